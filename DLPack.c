@@ -0,0 +1,119 @@
+#include "general.h"
+
+#define torch_DLPack "torch.DLPack"
+
+/* A torch.DLPack owns its descriptor until it is consumed by torch.fromDLPack
+   or released to another library, which then calls the deleter. The userdata
+   holds the descriptor pointer, which is cleared when it changes hands (so
+   that luaT_checkudata, which rejects NULL pointers, cannot be used). */
+
+static THDLManagedTensor **torch_DLPack_box(lua_State *L, int index)
+{
+  return luaL_checkudata(L, index, torch_DLPack);
+}
+
+static int torch_DLPack_free(lua_State *L)
+{
+  THDLManagedTensor *managed = *torch_DLPack_box(L, 1);
+  if(managed && managed->deleter)
+    managed->deleter(managed);
+  return 0;
+}
+
+static int torch_DLPack_release(lua_State *L)
+{
+  THDLManagedTensor **box = torch_DLPack_box(L, 1);
+  luaL_argcheck(L, *box, 1, "DLPack tensor already consumed");
+  lua_pushinteger(L, (lua_Integer)(uintptr_t)*box);
+  *box = NULL;
+  return 1;
+}
+
+static int torch_DLPack___tostring__(lua_State *L)
+{
+  THDLManagedTensor *managed = *torch_DLPack_box(L, 1);
+  THDLTensor *dl;
+  luaL_Buffer b;
+  char str[64];
+  int d;
+
+  if(!managed)
+  {
+    lua_pushstring(L, "torch.DLPack (consumed)");
+    return 1;
+  }
+  dl = &managed->dl_tensor;
+  luaL_buffinit(L, &b);
+  snprintf(str, sizeof(str), "torch.DLPack (%s%d) of size ",
+           (dl->dtype.code == TH_DL_FLOAT ? "float" : dl->dtype.code == TH_DL_UINT ? "uint" : "int"),
+           dl->dtype.bits);
+  luaL_addstring(&b, str);
+  for(d = 0; d < dl->ndim; d++)
+  {
+    snprintf(str, sizeof(str), (d > 0 ? "x%lld" : "%lld"), (long long)dl->shape[d]);
+    luaL_addstring(&b, str);
+  }
+  if(dl->ndim == 0)
+    luaL_addstring(&b, "1 (scalar)");
+  luaL_pushresult(&b);
+  return 1;
+}
+
+#define TORCH_DLPACK_IMPORT(CODE, REAL, NAME)                             \
+  if(dtype.code == CODE && dtype.bits == sizeof(REAL)*8)                  \
+  {                                                                       \
+    luaT_pushudata(L, TH##NAME##Tensor_newFromDLPack(managed),            \
+                   "torch." #NAME "Tensor");                              \
+    return 1;                                                             \
+  }
+
+static int torch_DLPack_import(lua_State *L, THDLManagedTensor *managed)
+{
+  THDLDataType dtype = managed->dl_tensor.dtype;
+  luaL_argcheck(L, dtype.lanes == 1, 1, "vector types are not supported");
+  TORCH_DLPACK_IMPORT(TH_DL_UINT, unsigned char, Byte)
+  TORCH_DLPACK_IMPORT(TH_DL_INT, char, Char)
+  TORCH_DLPACK_IMPORT(TH_DL_INT, short, Short)
+  TORCH_DLPACK_IMPORT(TH_DL_INT, int, Int)
+  TORCH_DLPACK_IMPORT(TH_DL_INT, long, Long)
+  TORCH_DLPACK_IMPORT(TH_DL_FLOAT, float, Float)
+  TORCH_DLPACK_IMPORT(TH_DL_FLOAT, double, Double)
+  TORCH_DLPACK_IMPORT(TH_DL_FLOAT, THHalf, Half)
+  return luaL_error(L, "no tensor type for type code %d and %d bits", dtype.code, dtype.bits);
+}
+
+/* a torch.DLPack, or the address of a descriptor owned by the caller: the
+   tensor owns it once it is returned */
+static int torch_DLPack_fromDLPack(lua_State *L)
+{
+  if(lua_isuserdata(L, 1))
+  {
+    THDLManagedTensor **box = torch_DLPack_box(L, 1);
+    luaL_argcheck(L, *box, 1, "DLPack tensor already consumed");
+    torch_DLPack_import(L, *box);
+    *box = NULL;
+  }
+  else
+  {
+    THDLManagedTensor *managed = (THDLManagedTensor *)(uintptr_t)luaL_checkinteger(L, 1);
+    luaL_argcheck(L, managed, 1, "null descriptor");
+    torch_DLPack_import(L, managed);
+  }
+  return 1;
+}
+
+static const struct luaL_Reg torch_DLPack_table_ [] = {
+  {"release", torch_DLPack_release},
+  {"__tostring__", torch_DLPack___tostring__},
+  {NULL, NULL}
+};
+
+void torch_DLPack_init(lua_State *L)
+{
+  luaT_newmetatable(L, torch_DLPack, NULL, NULL, torch_DLPack_free, NULL);
+  luaT_setfuncs(L, torch_DLPack_table_, 0);
+  lua_pop(L, 1);
+
+  lua_pushcfunction(L, torch_DLPack_fromDLPack);
+  lua_setfield(L, -2, "fromDLPack");
+}
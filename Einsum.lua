@@ -0,0 +1,431 @@
+-- Einstein summation over tensors.
+--
+-- The operands are first reduced on their own (repeated subscripts become
+-- diagonal views, subscripts used nowhere else are summed out), then
+-- contracted two at a time. Each pairwise contraction is a matrix product
+-- (or a batched one) of the operands viewed as batch x rows x inner and
+-- batch x inner x columns; the subscripts inside each of these groups are
+-- ordered after the strides of the operands so that the views need no copy
+-- whenever the layout allows it. The order of the contractions minimizes
+-- the number of multiply-adds, exhaustively for a few operands and greedily
+-- beyond, and is cached by spec and sizes.
+
+-- Lua 5.2 compatibility
+local unpack = unpack or table.unpack
+
+local letters = 'abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ'
+
+-- search exhaustively for the best contraction order up to this many operands
+local maxOptimalOperands = 5
+
+local plans = {}
+local nplans = 0
+local maxPlans = 256
+
+local function has(term, c)
+   return term:find(c, 1, true) ~= nil
+end
+
+-- subscripts of term (without repetitions) which appear in needed
+local function keep(term, needed)
+   local result = ''
+   for c in term:gmatch('.') do
+      if has(needed, c) and not has(result, c) then
+         result = result .. c
+      end
+   end
+   return result
+end
+
+local function parse(spec, nop)
+   spec = spec:gsub('%s', '')
+   local lhs, output = spec:match('^(.-)%->(.*)$')
+   lhs = lhs or spec
+   local inputs = {}
+   local count = {}
+   for term in (lhs .. ','):gmatch('([^,]*),') do
+      assert(term:match('^%a+$'), string.format("einsum: invalid subscripts '%s'", term))
+      for c in term:gmatch('.') do
+         count[c] = (count[c] or 0) + 1
+      end
+      table.insert(inputs, term)
+   end
+   assert(#inputs == nop,
+          string.format('einsum: %d operands in spec, %d given', #inputs, nop))
+   if output then
+      assert(output:match('^%a*$'), string.format("einsum: invalid output subscripts '%s'", output))
+      for c in output:gmatch('.') do
+         assert(count[c], string.format("einsum: output subscript '%s' is not in the inputs", c))
+         assert(select(2, output:gsub(c, '')) == 1,
+                string.format("einsum: output subscript '%s' is repeated", c))
+      end
+   else
+      -- implicit output: subscripts which appear once, in alphabetical order
+      local once = {}
+      for c, n in pairs(count) do
+         if n == 1 then
+            table.insert(once, c)
+         end
+      end
+      table.sort(once)
+      output = table.concat(once)
+   end
+   return inputs, output
+end
+
+-- subscripts needed by anything else than the operands i and j
+local function neededBy(terms, output, i, j)
+   local needed = output
+   for k, term in ipairs(terms) do
+      if k ~= i and k ~= j then
+         needed = needed .. term
+      end
+   end
+   return needed
+end
+
+-- cost (multiply-adds) and resulting subscripts of contracting a with b
+local function pairCost(a, b, needed, sizes)
+   a = keep(a, needed .. b)
+   b = keep(b, needed .. a)
+   local all = a
+   for c in b:gmatch('.') do
+      if not has(all, c) then
+         all = all .. c
+      end
+   end
+   local cost = 1
+   for c in all:gmatch('.') do
+      cost = cost * sizes[c]
+   end
+   return cost, keep(all, needed)
+end
+
+-- returns the total cost and the list of pairs {i, j} to contract; after each
+-- step the two operands are removed and their result is appended to the list
+local function search(terms, output, sizes, optimal)
+   local n = #terms
+   if n <= 1 then
+      return 0, {}
+   end
+   local best, bestSteps
+   local greedyCost, greedyPair, greedyResult
+   for i = 1, n-1 do
+      for j = i+1, n do
+         local cost, result = pairCost(terms[i], terms[j], neededBy(terms, output, i, j), sizes)
+         if optimal then
+            local rest = {}
+            for k = 1, n do
+               if k ~= i and k ~= j then
+                  table.insert(rest, terms[k])
+               end
+            end
+            table.insert(rest, result)
+            local subCost, subSteps = search(rest, output, sizes, true)
+            if not best or cost + subCost < best then
+               best = cost + subCost
+               bestSteps = {{i, j}}
+               for _, step in ipairs(subSteps) do
+                  table.insert(bestSteps, step)
+               end
+            end
+         elseif not greedyCost or cost < greedyCost then
+            greedyCost, greedyPair, greedyResult = cost, {i, j}, result
+         end
+      end
+   end
+   if optimal then
+      return best, bestSteps
+   end
+   local rest = {}
+   for k = 1, n do
+      if k ~= greedyPair[1] and k ~= greedyPair[2] then
+         table.insert(rest, terms[k])
+      end
+   end
+   table.insert(rest, greedyResult)
+   local subCost, subSteps = search(rest, output, sizes, false)
+   table.insert(subSteps, 1, greedyPair)
+   return greedyCost + subCost, subSteps
+end
+
+local function plan(spec, operands)
+   local key = {spec}
+   for _, t in ipairs(operands) do
+      table.insert(key, table.concat(t:size():totable(), 'x'))
+   end
+   key = table.concat(key, ':')
+   if plans[key] then
+      return plans[key]
+   end
+
+   local inputs, output = parse(spec, #operands)
+   local sizes = {}
+   for k, term in ipairs(inputs) do
+      local t = operands[k]
+      assert(t:dim() == #term,
+             string.format("einsum: operand %d has %d dimensions, subscripts '%s'", k, t:dim(), term))
+      for d = 1, #term do
+         local c = term:sub(d, d)
+         assert(not sizes[c] or sizes[c] == t:size(d),
+                string.format("einsum: size mismatch for subscript '%s'", c))
+         sizes[c] = t:size(d)
+      end
+   end
+
+   -- subscripts left once each operand is reduced on its own
+   local terms = {}
+   for k, term in ipairs(inputs) do
+      local reduced = keep(term, neededBy(inputs, output, k))
+      if reduced ~= '' then
+         table.insert(terms, reduced)
+      end
+   end
+   local _, steps = search(terms, output, sizes, #terms <= maxOptimalOperands)
+
+   local p = {inputs = inputs, output = output, steps = steps}
+   if nplans >= maxPlans then
+      plans = {}
+      nplans = 0
+   end
+   plans[key] = p
+   nplans = nplans + 1
+   return p
+end
+
+-- view of t with its dimensions in the order of the subscripts of
+-- newTerm; repeated subscripts of term are taken along the diagonal
+local function restride(t, term, newTerm)
+   local sizes, strides = {}, {}
+   for k = 1, #newTerm do
+      local c = newTerm:sub(k, k)
+      local stride = 0
+      for d = 1, #term do
+         if term:sub(d, d) == c then
+            sizes[k] = t:size(d)
+            stride = stride + t:stride(d)
+         end
+      end
+      strides[k] = stride
+   end
+   return t.new(t:storage(), t:storageOffset(), torch.LongStorage(sizes), torch.LongStorage(strides))
+end
+
+-- takes the diagonals and sums out the subscripts which are not needed;
+-- returns a number when no subscript is left
+local function reduce(t, term, needed)
+   if type(t) == 'number' then
+      return t, ''
+   end
+   local unique = keep(term, term)
+   if #unique < #term then
+      t = restride(t, term, unique)
+      term = unique
+   end
+   local kept = keep(term, needed)
+   if kept == '' then
+      return t:sum(), ''
+   end
+   for d = #term, 1, -1 do
+      if not has(kept, term:sub(d, d)) then
+         t = t:sum(d):select(d, 1)
+      end
+   end
+   return t, kept
+end
+
+-- sorts the subscripts of group by decreasing stride in t
+local function byStride(t, term, group)
+   local list = {}
+   for c in group:gmatch('.') do
+      table.insert(list, c)
+   end
+   table.sort(list, function(x, y)
+      return t:stride(term:find(x, 1, true)) > t:stride(term:find(y, 1, true))
+   end)
+   return table.concat(list)
+end
+
+-- view of t with the dimensions of each group merged into one, copying only
+-- if the layout of t does not allow it
+local function merge(t, term, groups)
+   local sizes, strides = {}, {}
+   local viewable = true
+   for k, group in ipairs(groups) do
+      local size, stride, nextStride = 1, nil, nil
+      for i = #group, 1, -1 do
+         local d = term:find(group:sub(i, i), 1, true)
+         if t:size(d) ~= 1 then
+            if not stride then
+               stride = t:stride(d)
+            elseif t:stride(d) ~= nextStride then
+               viewable = false
+            end
+            nextStride = t:stride(d) * t:size(d)
+            size = size * t:size(d)
+         end
+      end
+      sizes[k] = size
+      strides[k] = stride or 1
+   end
+   if viewable then
+      return t.new(t:storage(), t:storageOffset(), torch.LongStorage(sizes), torch.LongStorage(strides))
+   end
+   return restride(t, term, table.concat(groups)):contiguous():view(torch.LongStorage(sizes))
+end
+
+local function contract(ta, a, tb, b, needed)
+   ta, a = reduce(ta, a, needed .. b)
+   tb, b = reduce(tb, b, needed .. a)
+   if type(ta) == 'number' or type(tb) == 'number' then
+      if type(ta) == 'number' then
+         ta, a, tb, b = tb, b, ta, a
+      end
+      return ta * tb, a
+   end
+
+   local batch, left, inner, right = '', '', '', ''
+   for c in a:gmatch('.') do
+      if not has(b, c) then
+         left = left .. c
+      elseif has(needed, c) then
+         batch = batch .. c
+      else
+         inner = inner .. c
+      end
+   end
+   for c in b:gmatch('.') do
+      if not has(a, c) then
+         right = right .. c
+      end
+   end
+
+   -- the larger operand decides the order of the shared subscripts, so
+   -- that a copy, if any, is made of the smaller one
+   if ta:nElement() >= tb:nElement() then
+      batch, inner = byStride(ta, a, batch), byStride(ta, a, inner)
+   else
+      batch, inner = byStride(tb, b, batch), byStride(tb, b, inner)
+   end
+   left, right = byStride(ta, a, left), byStride(tb, b, right)
+
+   local A = merge(ta, a, {batch, left, inner})
+   local B = merge(tb, b, {batch, inner, right})
+   local result = ta.new()
+   if batch == '' then
+      result:mm(A:select(1, 1), B:select(1, 1))
+   else
+      result:bmm(A, B)
+   end
+
+   local term = batch .. left .. right
+   if term == '' then
+      return result:sum(), ''
+   end
+   local sizes = {}
+   for c in term:gmatch('.') do
+      if has(a, c) then
+         table.insert(sizes, ta:size(a:find(c, 1, true)))
+      else
+         table.insert(sizes, tb:size(b:find(c, 1, true)))
+      end
+   end
+   return result:view(torch.LongStorage(sizes)), term
+end
+
+function torch.einsum(spec, ...)
+   local operands = {...}
+   assert(type(spec) == 'string', 'einsum: subscripts string expected')
+   assert(#operands > 0, 'einsum: at least one operand expected')
+   for k, t in ipairs(operands) do
+      assert(torch.isTensor(t), string.format('einsum: operand %d is not a tensor', k))
+      assert(torch.type(t) == torch.type(operands[1]), 'einsum: operands must have the same type')
+   end
+
+   local p = plan(spec, operands)
+   local output = p.output
+   local scale = 1
+   local tensors, terms = {}, {}
+   for k, term in ipairs(p.inputs) do
+      local t, reduced = reduce(operands[k], term, neededBy(p.inputs, output, k))
+      if reduced == '' then
+         scale = scale * t
+      else
+         table.insert(tensors, t)
+         table.insert(terms, reduced)
+      end
+   end
+
+   for _, step in ipairs(p.steps) do
+      local i, j = unpack(step)
+      local t, term = contract(tensors[i], terms[i], tensors[j], terms[j],
+                               neededBy(terms, output, i, j))
+      table.remove(tensors, j); table.remove(terms, j)
+      table.remove(tensors, i); table.remove(terms, i)
+      table.insert(tensors, t)
+      table.insert(terms, term)
+   end
+
+   local result, term = tensors[1], terms[1]
+   if result == nil then
+      return scale
+   end
+   if type(result) ~= 'number' then
+      result, term = reduce(result, term, output)
+   end
+   if type(result) == 'number' then
+      return result * scale
+   end
+   if term ~= output then
+      result = restride(result, term, output)
+   end
+   if scale ~= 1 then
+      result = result * scale
+   end
+   return result
+end
+
+function torch.tensordot(a, b, dims)
+   local dimsA, dimsB = {}, {}
+   dims = dims or 2
+   if type(dims) == 'number' then
+      for k = 1, dims do
+         dimsA[k] = a:dim() - dims + k
+         dimsB[k] = k
+      end
+   else
+      assert(type(dims) == 'table' and #dims == 2, 'tensordot: number or {dimsA, dimsB} expected')
+      dimsA = type(dims[1]) == 'number' and {dims[1]} or dims[1]
+      dimsB = type(dims[2]) == 'number' and {dims[2]} or dims[2]
+      assert(#dimsA == #dimsB, 'tensordot: as many dimensions of a and b expected')
+   end
+   assert(a:dim() + b:dim() - #dimsA <= #letters, 'tensordot: too many dimensions')
+
+   local termA, termB, free = {}, {}, {}
+   for d = 1, a:dim() do
+      termA[d] = letters:sub(d, d)
+   end
+   local n = a:dim()
+   for k, d in ipairs(dimsB) do
+      assert(not termB[d], 'tensordot: dimension of b contracted twice')
+      termB[d] = termA[dimsA[k]]
+   end
+   local contracted = {}
+   for _, d in ipairs(dimsA) do
+      assert(not contracted[d], 'tensordot: dimension of a contracted twice')
+      contracted[d] = true
+   end
+   for d = 1, a:dim() do
+      if not contracted[d] then
+         table.insert(free, termA[d])
+      end
+   end
+   for d = 1, b:dim() do
+      if not termB[d] then
+         n = n + 1
+         termB[d] = letters:sub(n, n)
+         table.insert(free, termB[d])
+      end
+   end
+   return torch.einsum(table.concat(termA) .. ',' .. table.concat(termB) .. '->' .. table.concat(free), a, b)
+end
@@ -46,6 +46,33 @@ typedef struct {
   unsigned short x;
 } __THHalf;
 typedef __THHalf THHalf;
+]]
+
+   -- DLPack descriptors
+   ffi.cdef[[
+typedef struct THDLDataType {
+  uint8_t code;
+  uint8_t bits;
+  uint16_t lanes;
+} THDLDataType;
+typedef struct THDLDevice {
+  int device_type;
+  int device_id;
+} THDLDevice;
+typedef struct THDLTensor {
+  void *data;
+  THDLDevice device;
+  int ndim;
+  THDLDataType dtype;
+  int64_t *shape;
+  int64_t *strides;
+  uint64_t byte_offset;
+} THDLTensor;
+typedef struct THDLManagedTensor {
+  THDLTensor dl_tensor;
+  void *manager_ctx;
+  void (*deleter)(struct THDLManagedTensor *self);
+} THDLManagedTensor;
 ]]
 
    -- Storage
@@ -97,6 +124,9 @@ typedef struct THRealTensor
 
     char flag;
 
+    ptrdiff_t numel;
+    char geometry;
+
 } THRealTensor;
 ]]
       cdefs = cdefs:gsub('Real', Real):gsub('real', real)
@@ -6,6 +6,13 @@ local P9MLUtils = require('P9MLUtils')
 local P9MLMembrane = {}
 P9MLMembrane.__index = P9MLMembrane
 
+-- Execution precisions of the wrapped Linear and Conv2d modules, from the
+-- most to the least precise. 'half' computes in single precision: TH has no
+-- arithmetic on CPU half tensors, so it only saves compute on double modules.
+-- 'int8' quantizes the weights per output and the input per sample to 8 bits,
+-- and accumulates their products in 32 bits (torch.mmInt).
+P9MLMembrane.PRECISIONS = {'full', 'half', 'int8'}
+
 -- Constructor
 function P9MLMembrane.new(baseModule, config)
     local self = setmetatable({}, P9MLMembrane)
@@ -41,6 +48,25 @@ function P9MLMembrane:__init(baseModule, config)
         fitness_momentum = self.config.fitness_momentum or 0.9
     }
     
+    -- Precision-adaptive execution: the precision is chosen from the
+    -- quantization level, and its measured latency and error feed back
+    -- into the fitness
+    self.precision = {
+        mode = 'full',
+        forced = self.config.precision,
+        half_level = self.config.half_precision_level or 0.75,
+        int8_level = self.config.int8_precision_level or 0.4,
+        tolerance = self.config.precision_tolerance or 0.05,
+        probe_interval = self.config.precision_probe_interval or 20,
+        weight = self.config.precision_weight or 0.5,
+        forwards = 0,
+        cache = {},
+        telemetry = {}
+    }
+    for _, mode in ipairs(P9MLMembrane.PRECISIONS) do
+        self.precision.telemetry[mode] = {latency = nil, error = nil, calls = 0}
+    end
+    
     -- Initialize membrane properties
     self:_initializeMembrane()
 end
@@ -62,18 +88,23 @@ function P9MLMembrane:forward(input)
         self:_updateCognitiveSignature()
     end
     
-    -- Forward pass through base module
     local output
-    if self.baseModule and self.baseModule.forward then
-        output = self.baseModule:forward(input)
+    local kind = self:_precisionKind(input)
+    if kind then
+        output = self:_precisionForward(kind, input)
     else
-        -- Identity operation if no base module
-        output = input
-    end
-    
-    -- Apply quantization if needed
-    if self.evolution_state.quantization_level < 1.0 then
-        output = self:_applyQuantization(output)
+        -- Forward pass through base module
+        if self.baseModule and self.baseModule.forward then
+            output = self.baseModule:forward(input)
+        else
+            -- Identity operation if no base module
+            output = input
+        end
+        
+        -- Simulate quantization for modules without precision kernels
+        if self.evolution_state.quantization_level < 1.0 then
+            output = self:_applyQuantization(output)
+        end
     end
     
     -- Update activity level
@@ -98,6 +129,13 @@ function P9MLMembrane:backward(gradOutput)
     return gradOutput
 end
 
+function P9MLMembrane:updateParameters(learningRate)
+    if self.baseModule and self.baseModule.updateParameters then
+        self.baseModule:updateParameters(learningRate)
+    end
+    self:invalidatePrecisionCache()
+end
+
 function P9MLMembrane:_applyQuantization(tensor)
     if not torch or not torch.isTensor or not torch.isTensor(tensor) then
         return tensor
@@ -116,6 +154,266 @@ function P9MLMembrane:_applyQuantization(tensor)
     return quantized
 end
 
+-- Precision-adaptive execution
+
+local function isRealTensor(x)
+    return torch and torch.isTensor and torch.isTensor(x) and torch.typename and
+           (torch.typename(x) == 'torch.FloatTensor' or torch.typename(x) == 'torch.DoubleTensor')
+end
+
+-- 'linear' or 'conv2d' when the base module and the input can be executed at
+-- a lower precision, nil otherwise
+function P9MLMembrane:_precisionKind(input)
+    local m = self.baseModule
+    if type(m) ~= 'table' or not isRealTensor(m.weight) or not isRealTensor(input) or
+       torch.typename(input) ~= torch.typename(m.weight) or
+       (m.bias ~= nil and not isRealTensor(m.bias)) then
+        return nil
+    end
+    if m.kW and m.kH and m.nInputPlane and m.nOutputPlane then
+        if (input:dim() == 3 or input:dim() == 4) and input:size(input:dim() - 2) == m.nInputPlane then
+            return 'conv2d'
+        end
+    elseif m.weight:dim() == 2 then
+        if (input:dim() == 1 or input:dim() == 2) and input:size(input:dim()) == m.weight:size(2) then
+            return 'linear'
+        end
+    end
+    return nil
+end
+
+function P9MLMembrane:_selectPrecision()
+    local p = self.precision
+    if p.forced then
+        return p.forced
+    end
+    local q = self.evolution_state.quantization_level
+    if q < p.int8_level then
+        return 'int8'
+    elseif q < p.half_level then
+        return 'half'
+    end
+    return 'full'
+end
+
+-- weights as a 2D (outputs x inputs) matrix
+local function weightMatrix(m, kind)
+    local w = m.weight
+    if kind == 'conv2d' then
+        w = w:contiguous():view(m.nOutputPlane, -1)
+    end
+    return w
+end
+
+-- a few weights whose change reveals an update of all of them (by an
+-- optimizer) without reading the whole tensor
+local function fingerprint(w)
+    local values = {}
+    local n = w:nElement()
+    local storage, offset = w:storage(), w:storageOffset()
+    if w:isContiguous() and n > 0 then
+        local step = math.max(1, math.floor(n / 16))
+        for i = 0, n - 1, step do
+            table.insert(values, storage[offset + i])
+        end
+    end
+    return values
+end
+
+local function sameFingerprint(a, b)
+    if #a ~= #b then
+        return false
+    end
+    for i = 1, #a do
+        if a[i] ~= b[i] then
+            return false
+        end
+    end
+    return true
+end
+
+-- low precision copies of the weights, rebuilt only when the weights change
+function P9MLMembrane:_precisionWeights(kind, mode)
+    local m = self.baseModule
+    local cache = self.precision.cache[mode]
+    local stamp = fingerprint(m.weight)
+    if cache and cache.weight == m.weight and cache.data == torch.pointer(m.weight:storage()) and
+       cache.size == m.weight:nElement() and sameFingerprint(cache.stamp, stamp) and
+       cache.bias == m.bias then
+        return cache
+    end
+    
+    local w = weightMatrix(m, kind)
+    cache = {
+        weight = m.weight,
+        data = torch.pointer(m.weight:storage()),
+        size = m.weight:nElement(),
+        stamp = stamp,
+        bias = m.bias
+    }
+    if mode == 'half' then
+        cache.w = w:float()
+        cache.b = m.bias and m.bias:float()
+    else
+        -- symmetric quantization of each output to [-127, 127]
+        local scale = w:clone():abs():max(2):div(127)
+        scale:maskedFill(scale:eq(0), 1)
+        local q = torch.cdiv(w, scale:expandAs(w)):round()
+        cache.w = torch.CharTensor(q:size()):copy(q)
+        cache.scale = scale:view(-1)
+        cache.b = m.bias
+    end
+    self.precision.cache[mode] = cache
+    return cache
+end
+
+function P9MLMembrane:invalidatePrecisionCache()
+    self.precision.cache = {}
+end
+
+-- rows of x (n x inputs) through the cached weights: returns n x outputs
+local function linearRows(x, cache, mode)
+    local out
+    if mode == 'half' then
+        out = torch.mm(x:float(), cache.w:t())
+        if cache.b then
+            out:add(cache.b:float():view(1, -1):expandAs(out))
+        end
+        return out:typeAs(x)
+    end
+    
+    -- per sample quantization of the input
+    local scale = x:clone():abs():max(2):div(127)
+    scale:maskedFill(scale:eq(0), 1)
+    local q = torch.cdiv(x, scale:expandAs(x)):round()
+    local acc = torch.CharTensor(q:size()):copy(q):mmInt(cache.w:t())
+    out = x.new(acc:size()):copy(acc)
+    out:cmul(torch.ger(scale:view(-1), cache.scale))
+    if cache.b then
+        out:add(cache.b:view(1, -1):expandAs(out))
+    end
+    return out
+end
+
+-- the convolution as a product of the unfolded patches by the weights
+local function conv2dLowPrecision(m, input, cache, mode)
+    local x = input:dim() == 3 and input:view(1, input:size(1), input:size(2), input:size(3)) or input
+    local padW, padH = m.padW or 0, m.padH or 0
+    local n, c, h, w = x:size(1), x:size(2), x:size(3), x:size(4)
+    if padW > 0 or padH > 0 then
+        local padded = x.new(n, c, h + 2*padH, w + 2*padW):zero()
+        padded:narrow(3, padH + 1, h):narrow(4, padW + 1, w):copy(x)
+        x = padded
+    end
+    
+    local patches = x:unfold(3, m.kH, m.dH):unfold(4, m.kW, m.dW)
+    local oH, oW = patches:size(3), patches:size(4)
+    local rows = patches:permute(1, 3, 4, 2, 5, 6):contiguous():view(n*oH*oW, c*m.kH*m.kW)
+    local out = linearRows(rows, cache, mode):view(n, oH, oW, m.nOutputPlane)
+    out = out:permute(1, 4, 2, 3):contiguous()
+    if input:dim() == 3 then
+        out = out:view(m.nOutputPlane, oH, oW)
+    end
+    return out
+end
+
+function P9MLMembrane:_fullForward(input)
+    local timer = torch.Timer()
+    local output = self.baseModule:forward(input)
+    self:_recordPrecision('full', timer:time().real)
+    return output
+end
+
+function P9MLMembrane:_precisionForward(kind, input)
+    local p = self.precision
+    local mode = self:_selectPrecision()
+    local m = self.baseModule
+    -- the 32-bit sums of torch.mmInt are exact up to 131071 inputs
+    local inputs = kind == 'conv2d' and m.nInputPlane*m.kH*m.kW or m.weight:size(2)
+    if mode == 'int8' and inputs > 131071 then
+        mode = 'half'
+    end
+    -- no cheaper single precision path for a float module
+    if mode == 'half' and torch.typename(self.baseModule.weight) ~= 'torch.DoubleTensor' then
+        mode = 'full'
+    end
+    p.mode = mode
+    if mode == 'full' then
+        return self:_fullForward(input)
+    end
+    
+    local timer = torch.Timer()
+    local cache = self:_precisionWeights(kind, mode)
+    local output
+    if kind == 'conv2d' then
+        output = conv2dLowPrecision(self.baseModule, input, cache, mode)
+    else
+        local x = input:dim() == 1 and input:view(1, -1) or input
+        output = linearRows(x, cache, mode)
+        if input:dim() == 1 then
+            output = output:view(-1)
+        end
+    end
+    self:_recordPrecision(mode, timer:time().real)
+    
+    -- probe the error of the low precision output against the full one
+    p.forwards = p.forwards + 1
+    if p.forwards % p.probe_interval == 1 or p.probe_interval <= 1 then
+        local full = self:_fullForward(input)
+        local norm = full:norm()
+        local err = norm > 0 and (output - full):norm() / norm or 0
+        self:_recordPrecision(mode, nil, err)
+    end
+    
+    -- backward through the base module uses its own output
+    self.baseModule.output = output
+    return output
+end
+
+function P9MLMembrane:_recordPrecision(mode, latency, err)
+    local t = self.precision.telemetry[mode]
+    local momentum = 0.9
+    if latency then
+        t.latency = t.latency and momentum * t.latency + (1 - momentum) * latency or latency
+        t.calls = t.calls + 1
+    end
+    if err then
+        t.error = t.error and momentum * t.error + (1 - momentum) * err or err
+    end
+end
+
+-- in [-1, 1]: positive when the current precision loses more accuracy than
+-- tolerated or is slower than the full one, negative when it is accurate
+-- enough and saves time; 0 until both have been measured
+function P9MLMembrane:_precisionPressure()
+    local p = self.precision
+    local t, full = p.telemetry[p.mode], p.telemetry.full
+    if p.mode == 'full' or not t.error or not t.latency or not full.latency then
+        return 0
+    end
+    if t.error > p.tolerance then
+        return math.min(1, t.error / p.tolerance - 1)
+    end
+    return math.max(-1, math.min(1, t.latency / full.latency - 1))
+end
+
+function P9MLMembrane:getPrecision()
+    return self.precision.mode
+end
+
+-- forces a precision ('full', 'half' or 'int8'), or chooses it from the
+-- quantization level again with nil
+function P9MLMembrane:setPrecision(mode)
+    if mode ~= nil and mode ~= 'full' and mode ~= 'half' and mode ~= 'int8' then
+        error('precision must be full, half or int8')
+    end
+    self.precision.forced = mode
+end
+
+function P9MLMembrane:getPrecisionTelemetry()
+    return self.precision.telemetry
+end
+
 function P9MLMembrane:_updateActivity(input, output)
     local input_norm = (torch and torch.isTensor and torch.isTensor(input)) and input:norm() or 0
     local output_norm = (torch and torch.isTensor and torch.isTensor(output)) and output:norm() or 0
@@ -139,8 +437,11 @@ end
 function P9MLMembrane:_evolveState(input, output)
     self.evolution_state.generation = self.evolution_state.generation + 1
     
-    -- Compute fitness based on activity and stability
-    local current_fitness = self.activity_level * (1.0 - self:_computeInstability(input, output))
+    -- Compute fitness based on activity and stability; a precision that is
+    -- too inaccurate (or slow) raises it, and with it the quantization level
+    local pressure = self:_precisionPressure()
+    local current_fitness = self.activity_level * (1.0 - self:_computeInstability(input, output)) +
+                            self.precision.weight * pressure
     
     -- Update fitness with momentum
     local momentum = self.evolution_rules.fitness_momentum
@@ -159,9 +460,15 @@ function P9MLMembrane:_evolveState(input, output)
         generation = self.evolution_state.generation,
         fitness = self.evolution_state.fitness,
         quantization = self.evolution_state.quantization_level,
-        activity = self.activity_level
+        activity = self.activity_level,
+        precision = self.precision.mode,
+        latency = self.precision.telemetry[self.precision.mode].latency,
+        error = self.precision.telemetry[self.precision.mode].error
     })
     
+    self.evolution_state.precision = self.precision.mode
+    self.evolution_state.precision_pressure = pressure
+    
     -- Keep only recent history
     if #self.evolution_state.adaptation_history > 100 then
         table.remove(self.evolution_state.adaptation_history, 1)
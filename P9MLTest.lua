@@ -416,6 +416,133 @@ function P9MLTest:testEvolution()
     return true
 end
 
+-- Test the choice of the execution precision
+function P9MLTest:testPrecision()
+    print("Testing P9ML Precision...")
+    
+    local P9MLMembrane = require('P9MLMembrane')
+    
+    local membrane = P9MLMembrane.new({}, {initial_quantization = 1.0})
+    assert(membrane:_selectPrecision() == "full", "Full precision expected at quantization 1.0")
+    membrane.evolution_state.quantization_level = 0.5
+    assert(membrane:_selectPrecision() == "half", "Half precision expected at quantization 0.5")
+    membrane.evolution_state.quantization_level = 0.2
+    assert(membrane:_selectPrecision() == "int8", "Int8 precision expected at quantization 0.2")
+    
+    -- Forced precision overrides the quantization level
+    membrane:setPrecision("full")
+    assert(membrane:_selectPrecision() == "full", "Forced precision should be used")
+    membrane:setPrecision(nil)
+    assert(membrane:_selectPrecision() == "int8", "Precision should follow the quantization level again")
+    assert(not pcall(membrane.setPrecision, membrane, "fp4"), "Unknown precision should be rejected")
+    
+    -- Modules without tensor weights keep the simulated quantization
+    local tensor = MockTensor:new({1, 2, 3, 4})
+    membrane:forward(tensor)
+    assert(membrane:getPrecision() == "full", "Mock modules should run at full precision")
+    local telemetry = membrane:getPrecisionTelemetry()
+    assert(telemetry.full and telemetry.half and telemetry.int8, "Telemetry for each precision expected")
+    assert(membrane:getEvolutionState().precision_pressure == 0, "No precision pressure without measures")
+    
+    print("✓ P9ML Precision tests passed")
+    return true
+end
+
+-- Test the half and int8 kernels on real Linear and Conv2d weights
+function P9MLTest:testPrecisionKernels()
+    print("Testing P9ML Precision kernels...")
+    
+    if not (torch.CharTensor and torch.CharTensor.mmInt) then
+        print("✓ P9ML Precision kernels skipped (needs torch)")
+        return true
+    end
+    local P9MLMembrane = require('P9MLMembrane')
+    
+    -- relative error of the output of each precision against full precision
+    local tolerance = {half = 1e-5, int8 = 0.03}
+    local function relativeError(output, expected)
+        return (output - expected):norm() / expected:norm()
+    end
+    
+    local linear = {
+        weight = torch.DoubleTensor(20, 300):uniform(-1, 1),
+        bias = torch.DoubleTensor(20):uniform(-1, 1),
+        forward = function(self, x)
+            local x2 = x:dim() == 1 and x:view(1, -1) or x
+            local out = torch.mm(x2, self.weight:t())
+            out:add(self.bias:view(1, -1):expandAs(out))
+            self.output = x:dim() == 1 and out:view(-1) or out
+            return self.output
+        end
+    }
+    
+    -- stride 1 cross-correlation of each plane, subsampled for the stride
+    local conv = {
+        weight = torch.DoubleTensor(6, 3, 3, 5):uniform(-1, 1),
+        bias = torch.DoubleTensor(6):uniform(-1, 1),
+        nInputPlane = 3, nOutputPlane = 6, kH = 3, kW = 5, dH = 2, dW = 1, padH = 1, padW = 2,
+        forward = function(self, x)
+            local c, h, w = x:size(1), x:size(2), x:size(3)
+            local padded = x.new(c, h + 2*self.padH, w + 2*self.padW):zero()
+            padded:narrow(2, self.padH + 1, h):narrow(3, self.padW + 1, w):copy(x)
+            local full
+            for o = 1, self.nOutputPlane do
+                local plane = torch.xcorr2(padded[1], self.weight[o][1], 'V')
+                for i = 2, c do
+                    plane:add(torch.xcorr2(padded[i], self.weight[o][i], 'V'))
+                end
+                plane:add(self.bias[o])
+                full = full or x.new(self.nOutputPlane, plane:size(1), plane:size(2))
+                full[o]:copy(plane)
+            end
+            local rows = torch.range(1, full:size(2), self.dH):long()
+            local cols = torch.range(1, full:size(3), self.dW):long()
+            self.output = full:index(2, rows):index(3, cols)
+            return self.output
+        end
+    }
+    
+    local cases = {
+        {linear, torch.DoubleTensor(8, 300):uniform(-1, 1), "linear"},
+        {linear, torch.DoubleTensor(300):uniform(-1, 1), "linear vector"},
+        {conv, torch.DoubleTensor(3, 11, 9):uniform(-1, 1), "conv2d"}
+    }
+    for _, case in ipairs(cases) do
+        local module, input, name = case[1], case[2], case[3]
+        for _, mode in ipairs({"half", "int8"}) do
+            local membrane = P9MLMembrane.new(module, {precision = mode, precision_probe_interval = 1000})
+            local output = membrane:forward(input):clone()
+            assert(membrane:getPrecision() == mode, name .. ": " .. mode .. " precision expected")
+            local expected = module:forward(input):clone()
+            assert(output:isSameSizeAs(expected), name .. " " .. mode .. ": wrong output size")
+            local err = relativeError(output, expected)
+            assert(err < tolerance[mode], string.format("%s %s: relative error %g", name, mode, err))
+            
+            -- the low precision weights are kept until the weights change
+            local cache = membrane.precision.cache[mode]
+            membrane:forward(input)
+            assert(membrane.precision.cache[mode] == cache, name .. " " .. mode .. ": cache should be reused")
+            
+            local weight = module.weight
+            weight:mul(-0.5)
+            output = membrane:forward(input):clone()
+            assert(membrane.precision.cache[mode] ~= cache, name .. " " .. mode .. ": updated weights not seen")
+            err = relativeError(output, module:forward(input))
+            assert(err < tolerance[mode], name .. " " .. mode .. ": stale weights after an update")
+            
+            cache = membrane.precision.cache[mode]
+            module.weight = weight:clone():uniform(-1, 1)
+            output = membrane:forward(input):clone()
+            assert(membrane.precision.cache[mode] ~= cache, name .. " " .. mode .. ": replaced weights not seen")
+            err = relativeError(output, module:forward(input))
+            assert(err < tolerance[mode], name .. " " .. mode .. ": stale weights after a replacement")
+        end
+    end
+    
+    print("✓ P9ML Precision kernels tests passed")
+    return true
+end
+
 -- Run all tests
 function P9MLTest:runAll()
     print(string.rep("=", 50))
@@ -431,7 +558,9 @@ function P9MLTest:runAll()
         self.testNamespace,
         self.testCognitiveKernel,
         self.testIntegration,
-        self.testEvolution
+        self.testEvolution,
+        self.testPrecision,
+        self.testPrecisionKernels
     }
     
     for _, test_func in ipairs(test_functions) do
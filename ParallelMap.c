@@ -0,0 +1,547 @@
+#include "general.h"
+#include "utils.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*
+ * torch.parallelMap(fn, shards [, nthreads]) calls fn(shard, i) for each
+ * shard in a pool of worker Lua states, one per thread, and returns the
+ * table of the results.
+ *
+ * Values cross between states as torch_Values: numbers, booleans, strings,
+ * plain tables of them, and tensors and storages. A tensor is received as a
+ * new tensor on the same storage and a storage as the same storage, with one
+ * more reference: the elements are never copied.
+ *
+ * The pool belongs to the calling state, and its workers are created (and
+ * torch loaded in them) by the calling thread, so that torch is never
+ * initialized concurrently.
+ */
+
+#define TORCH_VALUE_INTEGER 100
+#define TORCH_VALUE_OBJECT 101
+#define TORCH_VALUE_MAX_DEPTH 64
+#define TORCH_VALUE_ERROR_LEN 256
+
+typedef struct torch_SharedType
+{
+  const char *name;
+  void *(*share)(void *);  /* a new reference on the same elements */
+  void (*free)(void *);
+} torch_SharedType;
+
+#define TORCH_SHARED_TYPE(Real)                                               \
+  static void *torch_share##Real##Tensor(void *t) { return TH##Real##Tensor_newWithTensor(t); } \
+  static void torch_free##Real##Tensor(void *t) { TH##Real##Tensor_free(t); } \
+  static void *torch_share##Real##Storage(void *s) { TH##Real##Storage_retain(s); return s; } \
+  static void torch_free##Real##Storage(void *s) { TH##Real##Storage_free(s); }
+
+TORCH_SHARED_TYPE(Byte)
+TORCH_SHARED_TYPE(Char)
+TORCH_SHARED_TYPE(Short)
+TORCH_SHARED_TYPE(Int)
+TORCH_SHARED_TYPE(Long)
+TORCH_SHARED_TYPE(Float)
+TORCH_SHARED_TYPE(Double)
+TORCH_SHARED_TYPE(Half)
+
+#define TORCH_SHARED_ENTRIES(Real)                                            \
+  {"torch." #Real "Tensor", torch_share##Real##Tensor, torch_free##Real##Tensor}, \
+  {"torch." #Real "Storage", torch_share##Real##Storage, torch_free##Real##Storage}
+
+static const torch_SharedType torch_sharedTypes[] = {
+  TORCH_SHARED_ENTRIES(Byte),
+  TORCH_SHARED_ENTRIES(Char),
+  TORCH_SHARED_ENTRIES(Short),
+  TORCH_SHARED_ENTRIES(Int),
+  TORCH_SHARED_ENTRIES(Long),
+  TORCH_SHARED_ENTRIES(Float),
+  TORCH_SHARED_ENTRIES(Double),
+  TORCH_SHARED_ENTRIES(Half),
+  {NULL, NULL, NULL}
+};
+
+typedef struct torch_Value
+{
+  int type;
+  union
+  {
+    int boolean;
+    lua_Number number;
+    lua_Integer integer;
+    struct { char *data; size_t size; } string;
+    struct { const torch_SharedType *type; void *ptr; } object;
+    struct { struct torch_Value *entries; int n; } table;  /* key, value, ... */
+  } u;
+} torch_Value;
+
+static void torch_Value_free(torch_Value *v)
+{
+  int i;
+  switch(v->type)
+  {
+    case LUA_TSTRING:
+      THFree(v->u.string.data);
+      break;
+    case TORCH_VALUE_OBJECT:
+      v->u.object.type->free(v->u.object.ptr);
+      break;
+    case LUA_TTABLE:
+      for(i = 0; i < 2*v->u.table.n; i++)
+        torch_Value_free(&v->u.table.entries[i]);
+      THFree(v->u.table.entries);
+      break;
+  }
+  v->type = LUA_TNIL;
+}
+
+/* returns 0, or 1 with a message in err; v is left to torch_Value_free in
+   both cases */
+static int torch_Value_get(lua_State *L, int index, torch_Value *v, int depth, char *err)
+{
+  int type = lua_type(L, index);
+  const torch_SharedType *shared;
+  const char *name;
+
+  if(index < 0)
+    index = lua_gettop(L) + index + 1;
+  v->type = LUA_TNIL;
+  switch(type)
+  {
+    case LUA_TNIL:
+      return 0;
+
+    case LUA_TBOOLEAN:
+      v->type = LUA_TBOOLEAN;
+      v->u.boolean = lua_toboolean(L, index);
+      return 0;
+
+    case LUA_TNUMBER:
+#if LUA_VERSION_NUM >= 503
+      if(lua_isinteger(L, index))
+      {
+        v->type = TORCH_VALUE_INTEGER;
+        v->u.integer = lua_tointeger(L, index);
+        return 0;
+      }
+#endif
+      v->type = LUA_TNUMBER;
+      v->u.number = lua_tonumber(L, index);
+      return 0;
+
+    case LUA_TSTRING:
+    {
+      size_t size;
+      const char *data = lua_tolstring(L, index, &size);
+      v->u.string.data = THAlloc(size > 0 ? size : 1);
+      memcpy(v->u.string.data, data, size);
+      v->u.string.size = size;
+      v->type = LUA_TSTRING;
+      return 0;
+    }
+
+    case LUA_TUSERDATA:
+      name = luaT_typename(L, index);
+      for(shared = torch_sharedTypes; name && shared->name; shared++)
+      {
+        if(!strcmp(name, shared->name))
+        {
+          v->u.object.type = shared;
+          v->u.object.ptr = shared->share(luaT_toudata(L, index, name));
+          v->type = TORCH_VALUE_OBJECT;
+          return 0;
+        }
+      }
+      snprintf(err, TORCH_VALUE_ERROR_LEN, "%s cannot be shared between Lua states", name ? name : "userdata");
+      return 1;
+
+    case LUA_TTABLE:
+    {
+      int capacity = 0;
+      if(depth >= TORCH_VALUE_MAX_DEPTH || !lua_checkstack(L, 3))
+      {
+        snprintf(err, TORCH_VALUE_ERROR_LEN, "tables nested too deeply (or cyclic)");
+        return 1;
+      }
+      v->type = LUA_TTABLE;
+      v->u.table.entries = NULL;
+      v->u.table.n = 0;
+      lua_pushnil(L);
+      while(lua_next(L, index))
+      {
+        torch_Value *entry;
+        if(v->u.table.n == capacity)
+        {
+          capacity = (capacity > 0 ? 2*capacity : 8);
+          v->u.table.entries = THRealloc(v->u.table.entries, sizeof(torch_Value)*2*capacity);
+        }
+        entry = &v->u.table.entries[2*v->u.table.n];
+        entry[0].type = LUA_TNIL;
+        entry[1].type = LUA_TNIL;
+        v->u.table.n++;
+        if(torch_Value_get(L, -2, &entry[0], depth+1, err) || torch_Value_get(L, -1, &entry[1], depth+1, err))
+        {
+          lua_pop(L, 2);
+          return 1;
+        }
+        lua_pop(L, 1);
+      }
+      return 0;
+    }
+
+    default:
+      snprintf(err, TORCH_VALUE_ERROR_LEN, "a %s cannot be sent to another Lua state", lua_typename(L, type));
+      return 1;
+  }
+}
+
+/* the references on tensors and storages are handed to L */
+static void torch_Value_push(lua_State *L, torch_Value *v)
+{
+  int i;
+  luaL_checkstack(L, 3, "tables nested too deeply");
+  switch(v->type)
+  {
+    case LUA_TBOOLEAN:
+      lua_pushboolean(L, v->u.boolean);
+      break;
+    case LUA_TNUMBER:
+      lua_pushnumber(L, v->u.number);
+      break;
+    case TORCH_VALUE_INTEGER:
+      lua_pushinteger(L, v->u.integer);
+      break;
+    case LUA_TSTRING:
+      lua_pushlstring(L, v->u.string.data, v->u.string.size);
+      break;
+    case TORCH_VALUE_OBJECT:
+      luaT_pushudata(L, v->u.object.ptr, v->u.object.type->name);
+      v->type = LUA_TNIL;
+      break;
+    case LUA_TTABLE:
+      lua_createtable(L, 0, v->u.table.n);
+      for(i = 0; i < v->u.table.n; i++)
+      {
+        torch_Value_push(L, &v->u.table.entries[2*i]);
+        torch_Value_push(L, &v->u.table.entries[2*i+1]);
+        lua_rawset(L, -3);
+      }
+      break;
+    default:
+      lua_pushnil(L);
+  }
+}
+
+typedef struct torch_ParallelPool
+{
+  int n;
+  lua_State **states;
+} torch_ParallelPool;
+
+#define torch_ParallelPool_key "torch.ParallelMapPool"
+/* the pool of the state, in the registry beside its metatable */
+#define torch_ParallelPool_instance "torch.parallelMap.pool"
+
+static int torch_ParallelPool_gc(lua_State *L)
+{
+  torch_ParallelPool *pool = luaL_checkudata(L, 1, torch_ParallelPool_key);
+  int i;
+  for(i = 0; i < pool->n; i++)
+    lua_close(pool->states[i]);
+  THFree(pool->states);
+  pool->n = 0;
+  pool->states = NULL;
+  return 0;
+}
+
+/* what torch.updatethreadlocals() does for L, on the calling thread */
+static void torch_ParallelMap_updatethreadlocals(lua_State *L)
+{
+  int tracking;
+  torch_seterrorhandlers(L);
+  lua_getglobal(L, "torch");
+  lua_getfield(L, -1, "_heaptracking");
+  tracking = lua_toboolean(L, -1);
+  lua_pop(L, 2);
+  torch_setgchandlers(tracking ? L : NULL);
+}
+
+static lua_State *torch_ParallelPool_newWorker(lua_State *L)
+{
+  static const char *paths[] = {"path", "cpath"};
+  lua_State *W = luaL_newstate();
+  int i, failed;
+
+  if(!W)
+    luaL_error(L, "parallelMap: cannot create a Lua state");
+  luaL_openlibs(W);
+
+  /* the worker finds modules where the caller does */
+  lua_getglobal(L, "package");
+  lua_getglobal(W, "package");
+  for(i = 0; i < 2 && lua_istable(L, -1); i++)
+  {
+    lua_getfield(L, -1, paths[i]);
+    if(lua_isstring(L, -1))
+    {
+      lua_pushstring(W, lua_tostring(L, -1));
+      lua_setfield(W, -2, paths[i]);
+    }
+    lua_pop(L, 1);
+  }
+  lua_pop(L, 1);
+  lua_pop(W, 1);
+
+  /* loading torch makes W the handler of the TH errors and of the memory
+     pressure of this thread */
+  failed = luaL_dostring(W, "require 'torch'");
+  torch_ParallelMap_updatethreadlocals(L);
+  if(failed)
+  {
+    lua_pushstring(L, lua_tostring(W, -1));
+    lua_close(W);
+    luaL_error(L, "parallelMap: cannot load torch in a worker: %s", lua_tostring(L, -1));
+  }
+  return W;
+}
+
+static torch_ParallelPool *torch_ParallelPool_get(lua_State *L, int n)
+{
+  torch_ParallelPool *pool;
+
+  lua_getfield(L, LUA_REGISTRYINDEX, torch_ParallelPool_instance);
+  if(lua_isnil(L, -1))
+  {
+    lua_pop(L, 1);
+    pool = lua_newuserdata(L, sizeof(torch_ParallelPool));
+    pool->n = 0;
+    pool->states = NULL;
+    if(luaL_newmetatable(L, torch_ParallelPool_key))
+    {
+      lua_pushcfunction(L, torch_ParallelPool_gc);
+      lua_setfield(L, -2, "__gc");
+    }
+    lua_setmetatable(L, -2);
+    lua_pushvalue(L, -1);
+    lua_setfield(L, LUA_REGISTRYINDEX, torch_ParallelPool_instance);
+  }
+  pool = lua_touserdata(L, -1);
+  lua_pop(L, 1);
+
+  if(pool->n < n)
+  {
+    pool->states = THRealloc(pool->states, sizeof(lua_State*)*n);
+    while(pool->n < n)
+    {
+      pool->states[pool->n] = torch_ParallelPool_newWorker(L);
+      pool->n++;
+    }
+  }
+  return pool;
+}
+
+typedef struct torch_ParallelJob
+{
+  const char *code;      /* the dumped function */
+  size_t codeSize;
+  long n;
+  torch_Value *shards;
+  torch_Value *results;
+  char **errors;
+} torch_ParallelJob;
+
+static char *torch_ParallelJob_strdup(const char *str)
+{
+  size_t size = strlen(str ? str : "unknown error") + 1;
+  char *copy = THAlloc(size);
+  memcpy(copy, str ? str : "unknown error", size);
+  return copy;
+}
+
+/* in the worker: job, index, fn */
+static int torch_ParallelJob_run(lua_State *W)
+{
+  torch_ParallelJob *job = lua_touserdata(W, 1);
+  long i = (long)lua_tointeger(W, 2);
+  char err[TORCH_VALUE_ERROR_LEN];
+
+  lua_pushvalue(W, 3);
+  torch_Value_push(W, &job->shards[i]);
+  lua_pushinteger(W, i+1);
+  lua_call(W, 2, 1);
+  /* no traceback here: the function already returned */
+  if(torch_Value_get(W, -1, &job->results[i], 0, err))
+  {
+    char msg[TORCH_VALUE_ERROR_LEN + 32];
+    snprintf(msg, sizeof(msg), "cannot return the result: %s", err);
+    job->errors[i] = torch_ParallelJob_strdup(msg);
+  }
+  return 0;
+}
+
+static void torch_ParallelJob_work(lua_State *W, torch_ParallelJob *job, long i, int traceback, int fn)
+{
+  lua_pushcfunction(W, torch_ParallelJob_run);
+  lua_pushlightuserdata(W, job);
+  lua_pushinteger(W, i);
+  lua_pushvalue(W, fn);
+  if(lua_pcall(W, 3, 0, traceback))
+  {
+    job->errors[i] = torch_ParallelJob_strdup(lua_tostring(W, -1));
+    lua_pop(W, 1);
+  }
+}
+
+static void torch_ParallelJob_free(torch_ParallelJob *job)
+{
+  long i;
+  for(i = 0; i < job->n; i++)
+  {
+    torch_Value_free(&job->shards[i]);
+    torch_Value_free(&job->results[i]);
+    THFree(job->errors[i]);
+  }
+  THFree(job->shards);
+  THFree(job->results);
+  THFree(job->errors);
+}
+
+static int torch_parallelMap(lua_State *L)
+{
+  torch_ParallelJob job;
+  torch_ParallelPool *pool;
+  const char *name;
+  const char *tensorType;
+  char err[TORCH_VALUE_ERROR_LEN];
+  long nthreads, i;
+  int k;
+
+  luaL_checktype(L, 1, LUA_TFUNCTION);
+  luaL_argcheck(L, !lua_iscfunction(L, 1), 1, "Lua function expected");
+  luaL_checktype(L, 2, LUA_TTABLE);
+  nthreads = (long)luaL_optinteger(L, 3, THGetNumThreads());
+  luaL_argcheck(L, nthreads >= 1, 3, "at least one thread expected");
+  lua_settop(L, 3);
+
+  /* only the environment of the function can be rebuilt in the workers */
+  for(k = 1; (name = lua_getupvalue(L, 1, k)) != NULL; k++)
+  {
+    lua_pop(L, 1);
+    luaL_argcheck(L, k == 1 && !strcmp(name, "_ENV"), 1,
+                  "the function cannot have upvalues: pass their values in the shards");
+  }
+  lua_getglobal(L, "string");
+  lua_getfield(L, -1, "dump");
+  lua_pushvalue(L, 1);
+  lua_call(L, 1, 1);
+  job.code = lua_tolstring(L, -1, &job.codeSize);  /* stays on the stack */
+
+  job.n = (long)lua_objlen(L, 2);
+  if(nthreads > job.n)
+    nthreads = (job.n > 0 ? job.n : 1);
+#ifndef _OPENMP
+  nthreads = 1;
+#endif
+  pool = torch_ParallelPool_get(L, nthreads);
+
+  /* the workers create tensors of the default type of the caller */
+  tensorType = torch_getdefaulttensortype(L);
+  for(k = 0; k < nthreads && tensorType; k++)
+  {
+    lua_State *W = pool->states[k];
+    lua_getglobal(W, "torch");
+    lua_getfield(W, -1, "setdefaulttensortype");
+    lua_pushstring(W, tensorType);
+    if(lua_pcall(W, 1, 0, 0))
+      lua_pop(W, 1);
+    lua_pop(W, 1);
+  }
+
+  job.shards = THAlloc(sizeof(torch_Value)*(job.n > 0 ? job.n : 1));
+  job.results = THAlloc(sizeof(torch_Value)*(job.n > 0 ? job.n : 1));
+  job.errors = THAlloc(sizeof(char*)*(job.n > 0 ? job.n : 1));
+  for(i = 0; i < job.n; i++)
+  {
+    job.shards[i].type = LUA_TNIL;
+    job.results[i].type = LUA_TNIL;
+    job.errors[i] = NULL;
+  }
+  for(i = 0; i < job.n; i++)
+  {
+    int failed;
+    lua_rawgeti(L, 2, i+1);
+    failed = torch_Value_get(L, -1, &job.shards[i], 0, err);
+    lua_pop(L, 1);
+    if(failed)
+    {
+      torch_ParallelJob_free(&job);
+      luaL_error(L, "parallelMap: cannot send shard %d: %s", (int)(i+1), err);
+    }
+  }
+
+#pragma omp parallel num_threads(nthreads) private(i)
+  {
+#ifdef _OPENMP
+    lua_State *W = pool->states[omp_get_thread_num()];
+#else
+    lua_State *W = pool->states[0];
+#endif
+    int top = lua_gettop(W);
+    int traceback, fn;
+    const char *loadError = NULL;
+
+    torch_ParallelMap_updatethreadlocals(W);
+    lua_getglobal(W, "debug");
+    lua_getfield(W, -1, "traceback");
+    traceback = lua_gettop(W);
+    if(luaL_loadbuffer(W, job.code, job.codeSize, "=parallelMap"))
+      loadError = lua_tostring(W, -1);
+    fn = lua_gettop(W);
+
+#pragma omp for schedule(dynamic, 1)
+    for(i = 0; i < job.n; i++)
+    {
+      if(loadError)
+        job.errors[i] = torch_ParallelJob_strdup(loadError);
+      else
+        torch_ParallelJob_work(W, &job, i, traceback, fn);
+    }
+
+    lua_settop(W, top);
+    /* the shards are released now rather than at the next call */
+    lua_gc(W, LUA_GCCOLLECT, 0);
+
+    /* the threads of the pool outlive W */
+    THSetErrorHandler(NULL, NULL);
+    THSetArgErrorHandler(NULL, NULL);
+    torch_setgchandlers(NULL);
+  }
+  torch_ParallelMap_updatethreadlocals(L);
+
+  for(i = 0; i < job.n; i++)
+  {
+    if(job.errors[i])
+    {
+      lua_pushfstring(L, "parallelMap: shard %d: %s", (int)(i+1), job.errors[i]);
+      torch_ParallelJob_free(&job);
+      return lua_error(L);
+    }
+  }
+
+  lua_createtable(L, job.n, 0);
+  for(i = 0; i < job.n; i++)
+  {
+    torch_Value_push(L, &job.results[i]);
+    lua_rawseti(L, -2, i+1);
+  }
+  torch_ParallelJob_free(&job);
+  return 1;
+}
+
+void torch_ParallelMap_init(lua_State *L)
+{
+  lua_pushcfunction(L, torch_parallelMap);
+  lua_setfield(L, -2, "parallelMap");
+}
@@ -0,0 +1,175 @@
+-- Streaming sketches: summaries of a stream of values in a fixed amount of
+-- memory, which are updated by tensors in bulk, merged with the summaries of
+-- other streams (other threads or processes), and serialized like any other
+-- torch object.
+--
+-- torch.TDigest estimates quantiles and the CDF with a t-digest: a list of
+-- centroids (mean, weight) sorted by mean, small near the extremes and larger
+-- in the middle, so that the error on a quantile q is about proportional to
+-- q(1-q). torch.HyperLogLog estimates the number of distinct values from 2^p
+-- registers, with a standard error of 1.04/sqrt(2^p).
+
+local TDigest = torch.class('torch.TDigest')
+
+function TDigest:__init(compression)
+   self.compression = compression or 100
+   assert(self.compression >= 1, 'compression must be at least 1')
+   self.centroids = torch.DoubleTensor()
+   self.range = torch.DoubleTensor{math.huge, -math.huge}
+end
+
+-- adds the values of a tensor (or a number); NaNs are ignored
+function TDigest:add(x)
+   if type(x) == 'number' then
+      x = torch.DoubleTensor{x}
+   end
+   x:tdigestAdd(self.centroids, self.range, self.compression)
+   return self
+end
+
+function TDigest:merge(other)
+   assert(torch.isTypeOf(other, 'torch.TDigest'), 'TDigest expected')
+   self.centroids:tdigestMerge(other.centroids, self.compression)
+   self.range[1] = math.min(self.range[1], other.range[1])
+   self.range[2] = math.max(self.range[2], other.range[2])
+   return self
+end
+
+function TDigest:count()
+   if self.centroids:nElement() == 0 then
+      return 0
+   end
+   return self.centroids:select(2, 2):sum()
+end
+
+function TDigest:min()
+   return self:count() > 0 and self.range[1] or nil
+end
+
+function TDigest:max()
+   return self:count() > 0 and self.range[2] or nil
+end
+
+-- the values are interpolated linearly between the centers of the centroids
+-- (half of the weight of each centroid lies on each side of its mean), and
+-- between the extreme centroids and the min and max
+local function knots(self)
+   local n = self.centroids:size(1)
+   local c = self.centroids:storage()
+   local offset = self.centroids:storageOffset() - 1
+   local values, ranks = {self.range[1]}, {0}
+   local cumulated = 0
+   for i=1,n do
+      local weight = c[offset + 2*i]
+      table.insert(values, c[offset + 2*i - 1])
+      table.insert(ranks, cumulated + weight/2)
+      cumulated = cumulated + weight
+   end
+   table.insert(values, self.range[2])
+   table.insert(ranks, cumulated)
+   return values, ranks, cumulated
+end
+
+local function interpolate(x, xs, ys)
+   if x <= xs[1] then
+      return ys[1]
+   end
+   for i=2,#xs do
+      if x <= xs[i] then
+         if x == xs[i] then
+            return ys[i]
+         end
+         return ys[i-1] + (x - xs[i-1]) / (xs[i] - xs[i-1]) * (ys[i] - ys[i-1])
+      end
+   end
+   return ys[#ys]
+end
+
+local function map(self, x, f)
+   if self.centroids:nElement() == 0 then
+      error('empty TDigest')
+   end
+   local values, ranks, total = knots(self)
+   if type(x) == 'number' then
+      return f(x, values, ranks, total)
+   end
+   return torch.DoubleTensor(x:size()):copy(x):apply(function(v) return f(v, values, ranks, total) end)
+end
+
+-- q in [0, 1], a number or a tensor
+function TDigest:quantile(q)
+   return map(self, q, function(q, values, ranks, total)
+      assert(q >= 0 and q <= 1, 'quantile must be in [0, 1]')
+      return interpolate(q * total, ranks, values)
+   end)
+end
+
+-- fraction of the values lower or equal to x, a number or a tensor
+function TDigest:cdf(x)
+   return map(self, x, function(x, values, ranks, total)
+      if x >= values[#values] then
+         return 1
+      end
+      return interpolate(x, values, ranks) / total
+   end)
+end
+
+-- number of values lower or equal to x
+function TDigest:rank(x)
+   local count = self:count()
+   if type(x) == 'number' then
+      return self:cdf(x) * count
+   end
+   return self:cdf(x):mul(count)
+end
+
+function TDigest:__tostring__()
+   return string.format('torch.TDigest (compression %g, %d centroids, count %g)',
+                        self.compression, self.centroids:nElement()/2, self:count())
+end
+
+local HyperLogLog = torch.class('torch.HyperLogLog')
+
+function HyperLogLog:__init(precision)
+   precision = precision or 14
+   assert(precision >= 4 and precision <= 18, 'precision must be between 4 and 18')
+   self.registers = torch.ByteTensor(2^precision):zero()
+end
+
+-- adds the values of a tensor (or a number); equal values count once
+-- whatever the type of their tensors
+function HyperLogLog:add(x)
+   if type(x) == 'number' then
+      x = torch.DoubleTensor{x}
+   end
+   x:hyperLogLogAdd(self.registers)
+   return self
+end
+
+function HyperLogLog:merge(other)
+   assert(torch.isTypeOf(other, 'torch.HyperLogLog'), 'HyperLogLog expected')
+   assert(other.registers:nElement() == self.registers:nElement(), 'HyperLogLogs of different precisions')
+   self.registers:cmax(other.registers)
+   return self
+end
+
+-- estimated number of distinct values
+function HyperLogLog:count()
+   local m = self.registers:nElement()
+   local alpha = ({[16] = 0.673, [32] = 0.697, [64] = 0.709})[m] or 0.7213 / (1 + 1.079 / m)
+   local sum = self.registers:double():mul(-math.log(2)):exp():sum()
+   local estimate = alpha * m * m / sum
+   if estimate <= 2.5 * m then
+      -- linear counting is more accurate for small cardinalities
+      local zeros = self.registers:eq(0):sum()
+      if zeros > 0 then
+         estimate = m * math.log(m / zeros)
+      end
+   end
+   return estimate
+end
+
+function HyperLogLog:__tostring__()
+   return string.format('torch.HyperLogLog (%d registers, count %.0f)',
+                        self.registers:nElement(), self:count())
+end
@@ -1,4 +1,307 @@
 #include "general.h"
+#include "utils.h"
+#include <math.h>
+
+/* Tensor printing. __tostring__ gathers the displayed elements of a tensor
+   (all of them, or the edge items of each dimension once the tensor has more
+   than options->threshold elements) into a row-major buffer of doubles; the
+   helpers below pick a format from that buffer and lay it out into a single
+   luaL_Buffer. */
+
+#define TORCH_FORMAT_OMP_THRESHOLD 100000
+
+typedef struct torch_FormatView_
+{
+  int nDimension;
+  long *size;       /* sizes of the printed tensor */
+  long *dsize;      /* number of displayed items in each dimension */
+  long edgeitems;
+  double *data;     /* displayed items, row-major over dsize */
+} torch_FormatView;
+
+typedef struct torch_Format_
+{
+  char conv;        /* 'd', 'f' or 'e' */
+  int width;
+  int precision;
+  double scale;     /* common factor printed above the values, or 1 */
+} torch_Format;
+
+/* index in the tensor of the j-th displayed item of dimension dim */
+static long torch_Format_index(const torch_FormatView *view, int dim, long j)
+{
+  if(view->dsize[dim] < view->size[dim] && j >= view->edgeitems)
+    return j + view->size[dim] - view->dsize[dim];
+  return j;
+}
+
+static int torch_Format_hasgap(const torch_FormatView *view, int dim)
+{
+  return view->dsize[dim] < view->size[dim];
+}
+
+static void torch_Format_init(torch_Format *fmt, const double *data, ptrdiff_t n, int precision)
+{
+  int intMode = 1;
+  double minAbs = HUGE_VAL;
+  double maxAbs = 0;
+  int expMin, expMax;
+
+#pragma omp parallel if(n > TORCH_FORMAT_OMP_THRESHOLD)
+  {
+    int intModePart = 1;
+    double minPart = HUGE_VAL;
+    double maxPart = 0;
+    ptrdiff_t i;
+#pragma omp for
+    for(i = 0; i < n; i++)
+    {
+      double z = data[i];
+      double a = fabs(z);
+      if(z - z != 0) /* nan or inf: printed as is, ignored by the statistics */
+      {
+        intModePart = 0;
+        continue;
+      }
+      if(z != ceil(z))
+        intModePart = 0;
+      if(a < minPart)
+        minPart = a;
+      if(a > maxPart)
+        maxPart = a;
+    }
+#pragma omp critical(torchformat)
+    {
+      intMode = intMode && intModePart;
+      minAbs = THMin(minAbs, minPart);
+      maxAbs = THMax(maxAbs, maxPart);
+    }
+  }
+
+  if(minAbs == HUGE_VAL)
+    minAbs = 0;
+  expMin = (minAbs != 0 ? (int)floor(log10(minAbs)) + 1 : 1);
+  expMax = (maxAbs != 0 ? (int)floor(log10(maxAbs)) + 1 : 1);
+
+  fmt->precision = precision;
+  fmt->scale = 1;
+  if(intMode)
+  {
+    if(expMax > 9)
+    {
+      fmt->conv = 'e';
+      fmt->width = precision + 7;
+    }
+    else
+    {
+      fmt->conv = 'd';
+      fmt->width = expMax + 1;
+    }
+  }
+  else if(expMax - expMin > precision)
+  {
+    fmt->conv = 'e';
+    fmt->width = precision + 7;
+    if(abs(expMax) > 99 || abs(expMin) > 99)
+      fmt->width++;
+  }
+  else
+  {
+    fmt->conv = 'f';
+    if(expMax > 5 || expMax < 0)
+    {
+      fmt->width = precision + 3;
+      fmt->scale = pow(10, expMax-1);
+    }
+    else
+      fmt->width = (expMax == 0 ? precision + 3 : expMax + precision + 2);
+  }
+}
+
+static void torch_Format_addvalue(luaL_Buffer *b, const torch_Format *fmt, double z)
+{
+  char buf[64];
+  if(fmt->conv == 'd')
+    snprintf(buf, sizeof(buf), "%*.0f", fmt->width, z + 0.0); /* no -0 */
+  else if(fmt->conv == 'e')
+    snprintf(buf, sizeof(buf), "%*.*e", fmt->width, fmt->precision, z);
+  else
+    snprintf(buf, sizeof(buf), "%*.*f", fmt->width, fmt->precision, z/fmt->scale);
+  luaL_addstring(b, buf);
+}
+
+static void torch_Format_addscale(luaL_Buffer *b, const torch_Format *fmt)
+{
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%g *\n", fmt->scale);
+  luaL_addstring(b, buf);
+}
+
+static void torch_Format_addvector(luaL_Buffer *b, const torch_Format *fmt, const torch_FormatView *view)
+{
+  long n = view->dsize[0] + torch_Format_hasgap(view, 0);
+  long v;
+  if(fmt->scale != 1)
+    torch_Format_addscale(b, fmt);
+  for(v = 0; v < n; v++)
+  {
+    if(torch_Format_hasgap(view, 0) && v >= view->edgeitems)
+    {
+      if(v == view->edgeitems)
+      {
+        luaL_addstring(b, "...\n");
+        continue;
+      }
+      torch_Format_addvalue(b, fmt, view->data[v-1]);
+    }
+    else
+      torch_Format_addvalue(b, fmt, view->data[v]);
+    luaL_addchar(b, '\n');
+  }
+}
+
+/* prints the matrix made of the two last dimensions of view, starting at data */
+static void torch_Format_addmatrix(luaL_Buffer *b, const torch_Format *fmt, const torch_FormatView *view,
+                                   const double *data, const char *indent, int linewidth)
+{
+  int rdim = view->nDimension-2;
+  int cdim = view->nDimension-1;
+  int rowGap = torch_Format_hasgap(view, rdim);
+  int colGap = torch_Format_hasgap(view, cdim);
+  long nRow = view->dsize[rdim] + rowGap;
+  long nColumn = view->dsize[cdim] + colGap;
+  long e = view->edgeitems;
+  long nColumnPerLine = (linewidth - (long)strlen(indent)) / (fmt->width + 1);
+  long firstColumn, lastColumn, r, c;
+  char buf[64];
+
+  if(nColumnPerLine < 1)
+    nColumnPerLine = 1;
+
+  luaL_addstring(b, indent);
+  for(firstColumn = 0; firstColumn < nColumn; firstColumn = lastColumn + 1)
+  {
+    lastColumn = THMin(firstColumn + nColumnPerLine, nColumn) - 1;
+    if(nColumnPerLine < nColumn)
+    {
+      /* an elided column stands for columns e+1 to size-e */
+      long first = (colGap && firstColumn == e ? e : torch_Format_index(view, cdim, firstColumn - (colGap && firstColumn > e)));
+      long last = (colGap && lastColumn == e ? view->size[cdim] - e - 1 : torch_Format_index(view, cdim, lastColumn - (colGap && lastColumn > e)));
+      if(firstColumn != 0)
+        luaL_addchar(b, '\n');
+      snprintf(buf, sizeof(buf), "Columns %ld to %ld\n", first+1, last+1);
+      luaL_addstring(b, buf);
+      luaL_addstring(b, indent);
+    }
+    if(fmt->scale != 1)
+    {
+      torch_Format_addscale(b, fmt);
+      luaL_addchar(b, ' ');
+      luaL_addstring(b, indent);
+    }
+    for(r = 0; r < nRow; r++)
+    {
+      if(rowGap && r == e)
+        luaL_addstring(b, "...");
+      else
+      {
+        const double *row = data + (r - (rowGap && r > e)) * view->dsize[cdim];
+        for(c = firstColumn; c <= lastColumn; c++)
+        {
+          if(c != firstColumn)
+            luaL_addchar(b, ' ');
+          if(colGap && c == e)
+            luaL_addstring(b, "...");
+          else
+            torch_Format_addvalue(b, fmt, row[c - (colGap && c > e)]);
+        }
+      }
+      luaL_addchar(b, '\n');
+      if(r != nRow-1)
+      {
+        luaL_addstring(b, indent);
+        if(fmt->scale != 1)
+          luaL_addchar(b, ' ');
+      }
+    }
+  }
+}
+
+/* prints each matrix of a tensor with more than 2 dimensions, iterating the
+   leading dimensions first-fastest, as (i,j,.,.) = ... blocks */
+static void torch_Format_addtensor(luaL_Buffer *b, const torch_Format *fmt, const torch_FormatView *view, int linewidth)
+{
+  int nLead = view->nDimension-2;
+  long blockSize = view->dsize[nLead] * view->dsize[nLead+1];
+  long *counter = THAlloc(sizeof(long)*nLead);
+  char buf[64];
+  int i;
+
+  for(i = 0; i < nLead; i++)
+    counter[i] = 0;
+
+  while(1)
+  {
+    long offset = 0;
+    luaL_addchar(b, '(');
+    for(i = 0; i < nLead; i++)
+    {
+      offset = offset * view->dsize[i] + counter[i];
+      snprintf(buf, sizeof(buf), "%ld,", torch_Format_index(view, i, counter[i])+1);
+      luaL_addstring(b, buf);
+    }
+    luaL_addstring(b, ".,.) = \n");
+    torch_Format_addmatrix(b, fmt, view, view->data + offset*blockSize, " ", linewidth);
+
+    for(i = 0; i < nLead; i++)
+    {
+      if(++counter[i] < view->dsize[i])
+        break;
+      counter[i] = 0;
+    }
+    if(i == nLead)
+      break;
+    if(torch_Format_hasgap(view, i) && counter[i] == view->edgeitems)
+      luaL_addstring(b, "\n...\n");
+    luaL_addchar(b, '\n');
+  }
+  THFree(counter);
+}
+
+/* pushes the string representation of the tensor described by view */
+static void torch_Format_push(lua_State *L, const torch_FormatView *view, const char *tname)
+{
+  const torch_PrintOptions *options = torch_getprintoptions();
+  ptrdiff_t n = 1;
+  torch_Format fmt;
+  luaL_Buffer b;
+  char buf[64];
+  int i;
+
+  for(i = 0; i < view->nDimension; i++)
+    n *= view->dsize[i];
+  torch_Format_init(&fmt, view->data, n, options->precision);
+
+  luaL_buffinit(L, &b);
+  if(view->nDimension == 1)
+    torch_Format_addvector(&b, &fmt, view);
+  else if(view->nDimension == 2)
+    torch_Format_addmatrix(&b, &fmt, view, view->data, "", options->linewidth);
+  else
+    torch_Format_addtensor(&b, &fmt, view, options->linewidth);
+
+  luaL_addchar(&b, '[');
+  luaL_addstring(&b, tname);
+  luaL_addstring(&b, " of size ");
+  for(i = 0; i < view->nDimension; i++)
+  {
+    snprintf(buf, sizeof(buf), (i == 0 ? "%ld" : "x%ld"), view->size[i]);
+    luaL_addstring(&b, buf);
+  }
+  luaL_addstring(&b, "]\n");
+  luaL_pushresult(&b);
+}
+
 
 #define torch_Storage_(NAME) TH_CONCAT_4(torch_,Real,Storage_,NAME)
 #define torch_Storage TH_CONCAT_STRING_3(torch.,Real,Storage)
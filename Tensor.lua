@@ -105,131 +105,7 @@ for _,type in ipairs(types) do
    end
 end
 
-local function Tensor__printMatrix(self, indent)
-   local format,scale,sz = Storage__printformat(self:storage())
-   if format:sub(2,4) == 'nan' then format = '%f' end
---   print('format = ' .. format)
-   scale = scale or 1
-   indent = indent or ''
-   local strt = {indent}
-   local nColumnPerLine = math.floor((80-#indent)/(sz+1))
---   print('sz = ' .. sz .. ' and nColumnPerLine = ' .. nColumnPerLine)
-   local firstColumn = 1
-   local lastColumn = -1
-   while firstColumn <= self:size(2) do
-      if firstColumn + nColumnPerLine - 1 <= self:size(2) then
-         lastColumn = firstColumn + nColumnPerLine - 1
-      else
-         lastColumn = self:size(2)
-      end
-      if nColumnPerLine < self:size(2) then
-         if firstColumn ~= 1 then
-            table.insert(strt, '\n')
-         end
-         table.insert(strt, 'Columns ' .. firstColumn .. ' to ' .. lastColumn .. '\n' .. indent)
-      end
-      if scale ~= 1 then
-         table.insert(strt, string.format('%g', scale) .. ' *\n ' .. indent)
-      end
-      for l=1,self:size(1) do
-         local row = self:select(1, l)
-         for c=firstColumn,lastColumn do
-            table.insert(strt, string.format(format, row[c]/scale))
-            if c == lastColumn then
-               table.insert(strt, '\n')
-               if l~=self:size(1) then
-                  if scale ~= 1 then
-                     table.insert(strt, indent .. ' ')
-                  else
-                     table.insert(strt, indent)
-                  end
-               end
-            else
-               table.insert(strt, ' ')
-            end
-         end
-      end
-      firstColumn = lastColumn + 1
-   end
-   local str = table.concat(strt)
-   return str
-end
-
-local function Tensor__printTensor(self)
-   local counter = torch.LongStorage(self:nDimension()-2)
-   local strt = {''}
-   local finished
-   counter:fill(1)
-   counter[1] = 0
-   while true do
-      for i=1,self:nDimension()-2 do
-         counter[i] = counter[i] + 1
-         if counter[i] > self:size(i) then
-            if i == self:nDimension()-2 then
-               finished = true
-               break
-            end
-            counter[i] = 1
-         else
-            break
-         end
-      end
-      if finished then
-         break
-      end
---      print(counter)
-      if #strt > 1 then
-         table.insert(strt, '\n')
-      end
-      table.insert(strt, '(')
-      local tensor = self
-      for i=1,self:nDimension()-2 do
-         tensor = tensor:select(1, counter[i])
-         table.insert(strt, counter[i] .. ',')
-      end
-      table.insert(strt, '.,.) = \n')
-      table.insert(strt, Tensor__printMatrix(tensor, ' '))
-   end
-   return table.concat(strt)
-end
-
-function Tensor.__tostring__(self)
-   local strt = {''}
-   if self:nDimension() == 0 then
-      table.insert(strt, '[' .. torch.typename(self) .. ' with no dimension]\n')
-   else
-      local tensor = torch.DoubleTensor():resize(self:size()):copy(self)
-      if tensor:nDimension() == 1 then
-         local format,scale,sz = Storage__printformat(tensor:storage())
-         if format:sub(2,4) == 'nan' then format = '%f' end
-         if scale then
-            table.insert(strt, string.format('%g', scale) .. ' *\n')
-            for i = 1,tensor:size(1) do
-               table.insert(strt, string.format(format, tensor[i]/scale) .. '\n')
-            end
-         else
-            for i = 1,tensor:size(1) do
-               table.insert(strt, string.format(format, tensor[i]) .. '\n')
-            end
-         end
-         table.insert(strt, '[' .. torch.typename(self) .. ' of size ' .. tensor:size(1) .. ']\n')
-      elseif tensor:nDimension() == 2 then
-         table.insert(strt, Tensor__printMatrix(tensor))
-         table.insert(strt, '[' .. torch.typename(self) .. ' of size ' .. tensor:size(1) .. 'x' .. tensor:size(2) .. ']\n')
-      else
-         table.insert(strt, Tensor__printTensor(tensor))
-         table.insert(strt, '[' .. torch.typename(self) .. ' of size ')
-         for i=1,tensor:nDimension() do
-            table.insert(strt, tensor:size(i))
-            if i ~= tensor:nDimension() then
-               table.insert(strt, 'x')
-            end
-         end
-         table.insert(strt, ']\n')
-      end
-   end
-   return table.concat(strt)
-end
+-- Tensor.__tostring__ is implemented in C (Tensor.c)
 
 function Tensor.type(self,type)
    local current = torch.typename(self)
@@ -342,7 +218,8 @@ function Tensor.expandAs(result,tensor,template)
 end
 torch.expandAs = Tensor.expandAs
 
-function Tensor.repeatTensor(result,tensor,...)
+-- repeatTensor is implemented in C (TensorMath.lua), except for HalfTensor
+local function Tensor__repeatTensor(result,tensor,...)
    -- get sizes
    local sizes = {...}
 
@@ -388,7 +265,6 @@ function Tensor.repeatTensor(result,tensor,...)
    urtensor:copy(xxtensor)
    return result
 end
-torch.repeatTensor = Tensor.repeatTensor
 
 --- One of the size elements can be -1,
  --- a new LongStorage is then returned.
@@ -557,6 +433,27 @@ function Tensor.permute(tensor, ...)
 end
 torch.permute = Tensor.permute
 
+function Tensor.channelsLast(tensor)
+   local nDims = tensor:dim()
+   assert(nDims == 3 or nDims == 4, '3D or 4D tensor expected')
+   local hwc
+   if nDims == 4 then
+      hwc = tensor:permute(1, 3, 4, 2)
+   else
+      hwc = tensor:permute(2, 3, 1)
+   end
+   if hwc:isContiguous() then
+      return tensor
+   end
+   hwc = hwc:contiguous()
+   if nDims == 4 then
+      return hwc:permute(1, 4, 2, 3)
+   else
+      return hwc:permute(3, 1, 2)
+   end
+end
+torch.channelsLast = Tensor.channelsLast
+
 for _,type in ipairs(types) do
    local metatable = torch.getmetatable('torch.' .. type .. 'Tensor')
    for funcname, func in pairs(Tensor) do
@@ -571,3 +468,6 @@ for _,type in ipairs(types) do
       end
    end
 end
+-- both as a method and through the torch.repeatTensor dispatcher
+rawset(torch.getmetatable('torch.HalfTensor'), 'repeatTensor', Tensor__repeatTensor)
+rawset(rawget(torch.getmetatable('torch.HalfTensor'), 'torch'), 'repeatTensor', Tensor__repeatTensor)
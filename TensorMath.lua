@@ -8,6 +8,57 @@ local argtypes = wrap.CInterface.argtypes
 
 argtypes['ptrdiff_t'] = wrap.types.ptrdiff_t
 
+-- one of the strings arg.values, passed to C as its position in the list
+-- (from 0), e.g. {name="stringoption", values={"sum", "mean", "max"}, default="sum"}
+argtypes.stringoption = {
+
+   helpname = function(arg)
+                 return '("' .. table.concat(arg.values, '"|"') .. '")'
+              end,
+
+   declare = function(arg)
+                local default = 0
+                for i,value in ipairs(arg.values) do
+                   if value == arg.default then
+                      default = i-1
+                   end
+                end
+                return string.format("int arg%d = %d;", arg.i, default)
+             end,
+
+   check = function(arg, idx)
+              local txt = {}
+              for _,value in ipairs(arg.values) do
+                 table.insert(txt, string.format('!strcmp(lua_tostring(L, %d), "%s")', idx, value))
+              end
+              return string.format("(lua_type(L, %d) == LUA_TSTRING && (%s))", idx, table.concat(txt, ' || '))
+           end,
+
+   read = function(arg, idx)
+             local txt = {}
+             for i,value in ipairs(arg.values) do
+                table.insert(txt, string.format('!strcmp(lua_tostring(L, %d), "%s") ? %d : ', idx, value, i-1))
+             end
+             return string.format("arg%d = %s-1;", arg.i, table.concat(txt))
+          end,
+
+   init = function(arg)
+          end,
+
+   carg = function(arg)
+             return string.format('arg%d', arg.i)
+          end,
+
+   creturn = function(arg)
+             end,
+
+   precall = function(arg)
+             end,
+
+   postcall = function(arg)
+              end
+}
+
 interface:print([[
 #include "TH.h"
 #include "THMath.h"
@@ -179,6 +230,14 @@ local accreals = {ByteTensor='long',
                HalfTensor='float',
                DoubleTensor='double'}
 
+local unpack = unpack or table.unpack
+
+-- source types read by the mixed-type sum, mean, add and cmul of a tensor type
+local narrowerTensors = {FloatTensor={'ByteTensor', 'CharTensor', 'ShortTensor',
+                                      'IntTensor', 'HalfTensor'},
+                         DoubleTensor={'ByteTensor', 'CharTensor', 'ShortTensor',
+                                       'IntTensor', 'LongTensor', 'FloatTensor', 'HalfTensor'}}
+
 for _,Tensor in ipairs({"ByteTensor", "CharTensor",
                         "ShortTensor", "IntTensor", "LongTensor",
                         "FloatTensor", "HalfTensor", "DoubleTensor"}) do
@@ -236,6 +295,12 @@ for _,Tensor in ipairs({"ByteTensor", "CharTensor",
          {name=Tensor},
          {name="LongArg"}})
 
+   wrap("repeatTensor",
+        cname("repeat"),
+        {{name=Tensor, default=true, returned=true},
+         {name=Tensor},
+         {name="LongArg"}})
+
    wrap("gather",
         cname("gather"),
         {{name=Tensor, default=true, returned=true,
@@ -265,6 +330,42 @@ for _,Tensor in ipairs({"ByteTensor", "CharTensor",
          {name="IndexTensor", noreadadd=true},
          {name=real}})
 
+   for _,name in ipairs({"segmentSum", "segmentMean", "segmentMax", "segmentMin"}) do
+      wrap(name,
+           cname(name),
+           {{name=Tensor, default=true, returned=true},
+            {name=Tensor},
+            {name="IndexTensor", noreadadd=true}})
+   end
+
+   wrap("embeddingBag",
+        cname("embeddingBag"),
+        {{name=Tensor, default=true, returned=true},
+         {name=Tensor},
+         {name="IndexTensor", noreadadd=true},
+         {name="IndexTensor", noreadadd=true},
+         {name="stringoption", values={"sum", "mean", "max"}, default="sum"}},
+        cname("embeddingBagWeighted"),
+        {{name=Tensor, default=true, returned=true},
+         {name=Tensor},
+         {name="IndexTensor", noreadadd=true},
+         {name="IndexTensor", noreadadd=true},
+         {name=Tensor}})
+
+   wrap("searchsorted",
+        cname("searchsorted"),
+        {{name="IndexTensor", default=true, returned=true, noreadadd=true},
+         {name=Tensor},
+         {name=Tensor},
+         {name="stringoption", values={"left", "right"}, default="left"}})
+
+   wrap("bucketize",
+        cname("bucketize"),
+        {{name="IndexTensor", default=true, returned=true, noreadadd=true},
+         {name=Tensor},
+         {name=Tensor},
+         {name="boolean", default=false}})
+
    wrap("dot",
         cname("dot"),
         {{name=Tensor},
@@ -277,16 +378,36 @@ for _,Tensor in ipairs({"ByteTensor", "CharTensor",
          {name=Tensor},
          {name="boolean", creturned=true}})
 
-   wrap("add",
-        cname("add"),
-        {{name=Tensor, default=true, returned=true, method={default='nil'}},
-         {name=Tensor, method={default=1}},
-         {name=real}},
-        cname("cadd"),
-        {{name=Tensor, default=true, returned=true, method={default='nil'}},
-         {name=Tensor, method={default=1}},
-         {name=real, default=1},
-         {name=Tensor}})
+   local addVariants = {
+      cname("add"),
+      {{name=Tensor, default=true, returned=true, method={default='nil'}},
+       {name=Tensor, method={default=1}},
+       {name=real}},
+      cname("cadd"),
+      {{name=Tensor, default=true, returned=true, method={default='nil'}},
+       {name=Tensor, method={default=1}},
+       {name=real, default=1},
+       {name=Tensor}}}
+   local cmulVariants = {
+      cname("cmul"),
+      {{name=Tensor, default=true, returned=true, method={default='nil'}},
+       {name=Tensor, method={default=1}},
+       {name=Tensor}}}
+   for _,Source in ipairs(narrowerTensors[Tensor] or {}) do
+      local suffix = Source:gsub('Tensor$', '')
+      table.insert(addVariants, cname("cadd" .. suffix))
+      table.insert(addVariants,
+                   {{name=Tensor, default=true, returned=true, method={default='nil'}},
+                    {name=Tensor, method={default=1}},
+                    {name=real, default=1},
+                    {name=Source}})
+      table.insert(cmulVariants, cname("cmul" .. suffix))
+      table.insert(cmulVariants,
+                   {{name=Tensor, default=true, returned=true, method={default='nil'}},
+                    {name=Tensor, method={default=1}},
+                    {name=Source}})
+   end
+   wrap("add", unpack(addVariants))
 
    wrap("csub",
      cname("sub"),
@@ -376,11 +497,7 @@ for _,Tensor in ipairs({"ByteTensor", "CharTensor",
          {name=real, default=1}
         })
 
-   wrap("cmul",
-        cname("cmul"),
-        {{name=Tensor, default=true, returned=true, method={default='nil'}},
-         {name=Tensor, method={default=1}},
-         {name=Tensor}})
+   wrap("cmul", unpack(cmulVariants))
 
    wrap("cpow",
         cname("cpow"),
@@ -609,15 +726,39 @@ for _,Tensor in ipairs({"ByteTensor", "CharTensor",
             {name="index", default=1}})
    end
 
-   wrap("sum",
-        cname("sumall"),
-        {{name=Tensor},
-         {name=accreal, creturned=true}},
-        cname("sum"),
-        {{name=Tensor, default=true, returned=true},
-         {name=Tensor},
-         {name="index"},
-         {name="boolean", default=true, invisible=true}})
+   local sumVariants = {
+      cname("sumall"),
+      {{name=Tensor},
+       {name=accreal, creturned=true}},
+      cname("sum"),
+      {{name=Tensor, default=true, returned=true},
+       {name=Tensor},
+       {name="index"},
+       {name="boolean", default=true, invisible=true}}}
+   -- res:sum(src, dim) with a narrower src, accumulated in accreal
+   for _,Source in ipairs(narrowerTensors[Tensor] or {}) do
+      table.insert(sumVariants, cname("sum" .. Source:gsub('Tensor$', '')))
+      table.insert(sumVariants,
+                   {{name=Tensor, returned=true},
+                    {name=Source},
+                    {name="index"},
+                    {name="boolean", default=true, invisible=true}})
+   end
+   wrap("sum", unpack(sumVariants))
+
+   if accreal == 'long' then
+      -- the mean of an integer tensor is computed in double, without a copy
+      local suffix = Tensor:gsub('Tensor$', '')
+      wrap("mean",
+           "THDoubleTensor_meanall" .. suffix,
+           {{name=Tensor},
+            {name="double", creturned=true}},
+           "THDoubleTensor_mean" .. suffix,
+           {{name="DoubleTensor", default=true, returned=true},
+            {name=Tensor},
+            {name="index"},
+            {name="boolean", default=true, invisible=true}})
+   end
 
    wrap("prod",
         cname("prodall"),
@@ -764,6 +905,32 @@ wrap("topk",
          {name=Tensor .. "Array"},
          {name="index", default=-1}})
 
+   wrap("tdigestAdd",
+        cname("tdigestAdd"),
+        {{name=Tensor},
+         {name="DoubleTensor"},
+         {name="DoubleTensor"},
+         {name="double"}})
+
+   wrap("hyperLogLogAdd",
+        cname("hyperLogLogAdd"),
+        {{name=Tensor},
+         {name="ByteTensor"}})
+
+   wrap("unique",
+        cname("unique"),
+        {{name=Tensor, default=true, returned=true},
+         {name="IndexTensor", default=true, returned=true, noreadadd=true},
+         {name="LongTensor", default=true, returned=true},
+         {name=Tensor},
+         {name="boolean", default=true}},
+        cname("uniqueDim"),
+        {{name=Tensor, default=true, returned=true},
+         {name="IndexTensor", default=true, returned=true, noreadadd=true},
+         {name="LongTensor", default=true, returned=true},
+         {name=Tensor},
+         {name="index"}})
+
    if Tensor == 'ByteTensor' then -- we declare this only once
       interface:print(
          [[
@@ -954,6 +1121,71 @@ static void THTensor_random1__(THTensor *self, THGenerator *gen, long b)
          {name='charoption', default="X", invisible=true}}
      )
 
+   wrap("conv2nhwc",
+        cname("conv2DmvNHWC"),
+        {{name=Tensor, default=true, returned=true},
+         {name=real, default=0, invisible=true},
+         {name=real, default=1, invisible=true},
+         {name=Tensor, dim=3},
+         {name=Tensor, dim=4},
+         {name=real, default=1, invisible=true},
+         {name=real, default=1, invisible=true},
+         {name='charoption', values={'V', 'F'}, default='V'},
+         {name='charoption', default="C", invisible=true}},
+        cname("conv2DmmNHWC"),
+        {{name=Tensor, default=true, returned=true},
+         {name=real, default=0, invisible=true},
+         {name=real, default=1, invisible=true},
+         {name=Tensor, dim=4},
+         {name=Tensor, dim=4},
+         {name=real, default=1, invisible=true},
+         {name=real, default=1, invisible=true},
+         {name='charoption', values={'V', 'F'}, default='V'},
+         {name='charoption', default="C", invisible=true}}
+     )
+
+   wrap("xcorr2nhwc",
+        cname("conv2DmvNHWC"),
+        {{name=Tensor, default=true, returned=true},
+         {name=real, default=0, invisible=true},
+         {name=real, default=1, invisible=true},
+         {name=Tensor, dim=3},
+         {name=Tensor, dim=4},
+         {name=real, default=1, invisible=true},
+         {name=real, default=1, invisible=true},
+         {name='charoption', values={'V', 'F'}, default='V'},
+         {name='charoption', default="X", invisible=true}},
+        cname("conv2DmmNHWC"),
+        {{name=Tensor, default=true, returned=true},
+         {name=real, default=0, invisible=true},
+         {name=real, default=1, invisible=true},
+         {name=Tensor, dim=4},
+         {name=Tensor, dim=4},
+         {name=real, default=1, invisible=true},
+         {name=real, default=1, invisible=true},
+         {name='charoption', values={'V', 'F'}, default='V'},
+         {name='charoption', default="X", invisible=true}}
+     )
+
+   wrap("conv2revger",
+        cname("conv2DRevger"),
+        {{name=Tensor, default=true, returned=true},
+         {name=real, default=0, invisible=true},
+         {name=real, default=1, invisible=true},
+         {name=Tensor, dim=3},
+         {name=Tensor, dim=3},
+         {name="long", default=1},
+         {name="long", default=1}},
+        cname("conv2DRevgerm"),
+        {{name=Tensor, default=true, returned=true},
+         {name=real, default=0, invisible=true},
+         {name=real, default=1, invisible=true},
+         {name=Tensor, dim=4},
+         {name=Tensor, dim=4},
+         {name="long", default=1},
+         {name="long", default=1}}
+     )
+
    wrap("conv3",
         cname("conv3Dmul"),
         {{name=Tensor, default=true, returned=true},
@@ -1062,6 +1294,30 @@ static void THTensor_random1__(THTensor *self, THGenerator *gen, long b)
       end
    end
 
+   if Tensor == 'DoubleTensor' then
+      wrap("tdigestMerge",
+           cname("tdigestMerge"),
+           {{name=Tensor},
+            {name=Tensor},
+            {name="double"}})
+   end
+
+   if Tensor == 'CharTensor' then
+      wrap("mmInt",
+           cname("mmInt"),
+           {{name="IntTensor", default=true, returned=true},
+            {name=Tensor},
+            {name=Tensor}})
+   end
+
+   if Tensor == 'LongTensor' then
+      wrap("segmentOffsets",
+           cname("segmentOffsets"),
+           {{name=Tensor, default=true, returned=true},
+            {name=Tensor},
+            {name="long", default=0}})
+   end
+
    if Tensor == 'IntTensor' then
          wrap("abs",
               cname("abs"),
@@ -1082,15 +1338,24 @@ static void THTensor_random1__(THTensor *self, THGenerator *gen, long b)
 
    if Tensor == 'FloatTensor' or Tensor == 'DoubleTensor' then
 
-      wrap("mean",
-           cname("meanall"),
-           {{name=Tensor},
-            {name=accreal, creturned=true}},
-           cname("mean"),
-           {{name=Tensor, default=true, returned=true},
-            {name=Tensor},
-            {name="index"},
-            {name="boolean", default=true, invisible=true}})
+      local meanVariants = {
+         cname("meanall"),
+         {{name=Tensor},
+          {name=accreal, creturned=true}},
+         cname("mean"),
+         {{name=Tensor, default=true, returned=true},
+          {name=Tensor},
+          {name="index"},
+          {name="boolean", default=true, invisible=true}}}
+      for _,Source in ipairs(narrowerTensors[Tensor]) do
+         table.insert(meanVariants, cname("mean" .. Source:gsub('Tensor$', '')))
+         table.insert(meanVariants,
+                      {{name=Tensor, returned=true},
+                       {name=Source},
+                       {name="index"},
+                       {name="boolean", default=true, invisible=true}})
+      end
+      wrap("mean", unpack(meanVariants))
 
       for _,name in ipairs({"var", "std"}) do
          wrap(name,
@@ -1163,7 +1428,8 @@ static void THTensor_random1__(THTensor *self, THGenerator *gen, long b)
             {name=real},
             {name="long", default=100}})
 
-      for _,name in ipairs({"log", "log1p", "exp",
+      for _,name in ipairs({"log", "log1p", "log2",
+                            "exp", "expm1", "exp2",
                             "cos", "acos", "cosh",
                             "sin", "asin", "sinh",
                             "tan", "atan", "tanh",
@@ -1242,6 +1508,18 @@ static void THTensor_random1__(THTensor *self, THGenerator *gen, long b)
             {name=real},
             {name=real, creturned=true}})
 
+      for _,name in ipairs({"logaddexp", "logsubexp"}) do
+         wrap(name,
+              cname(name),
+              {{name=Tensor, default=true, returned=true, method={default='nil'}},
+               {name=Tensor, method={default=1}},
+               {name=Tensor}},
+              "TH_" .. name,
+              {{name=real},
+               {name=real},
+               {name=real, creturned=true}})
+      end
+
       wrap("pow",
            cname("pow"),
            {{name=Tensor, default=true, returned=true, method={default='nil'}},
@@ -1321,6 +1599,26 @@ static void THTensor_random1__(THTensor *self, THGenerator *gen, long b)
                {name=real, default=f.a}})
       end
 
+      interface:print(string.gsub([[
+static void THTensor_dropout__(THTensor *r_, THGenerator *gen, THTensor *t, double p)
+{
+  THTensor_dropout(r_, gen, t, p, NULL);
+}
+]], 'Tensor', Tensor))
+
+      wrap("dropout",
+           cname("dropout__"),
+           {{name=Tensor, default=true, returned=true, method={default='nil'}},
+            {name='Generator', default=true},
+            {name=Tensor, method={default=1}},
+            {name="double"}},
+           cname("dropout"),
+           {{name=Tensor, default=true, returned=true, method={default='nil'}},
+            {name='Generator', default=true},
+            {name=Tensor, method={default=1}},
+            {name="double"},
+            {name="ByteTensor"}})
+
       for _,name in ipairs({"gesv","gels"}) do
          interface:wrap(name,
                         cname(name),
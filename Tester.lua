@@ -3,6 +3,7 @@
 local unpack = unpack or table.unpack
 
 local check = {} -- helper functions, defined at the bottom of the file
+local json = {} -- minimal JSON encoding of benchmark results, same place
 
 local Tester = torch.class('torch.Tester')
 
@@ -40,6 +41,34 @@ function Tester:setSummaryOnly(summaryOnly)
    self.summaryOnly = summaryOnly
 end
 
+-- Loads benchmark results previously written by :saveBenchmarks; benchmarks
+-- run afterwards are compared against them.
+function Tester:setBenchmarkBaseline(filename, options)
+   options = options or {}
+   local f = assert(io.open(filename, 'r'), "Cannot open baseline " .. filename)
+   local baseline = json.decode(f:read('*a'))
+   f:close()
+   assert(type(baseline) == 'table', "Invalid baseline " .. filename)
+   self._benchmarkBaseline = baseline
+   self._benchmarkTolerance = options.tolerance or 0.05
+   self._benchmarkZ = options.z or 3
+   return self
+end
+
+function Tester:saveBenchmarks(filename)
+   local results = {}
+   for name, result in pairs(self.benchmarks or {}) do
+      results[name] = {median = result.median, mad = result.mad,
+                       iterations = result.iterations,
+                       samples = result.samples,
+                       bytes = result.bytes, flops = result.flops}
+   end
+   local f = assert(io.open(filename, 'w'), "Cannot open " .. filename)
+   f:write(json.encode(results), '\n')
+   f:close()
+   return self
+end
+
 -- Add a success to the test.
 function Tester:_success()
    local name = self._currentTestName
@@ -289,6 +318,88 @@ function Tester:assertErrorObj(f, errcomp, ...)
                                          tostring(err)))
 end
 
+--[[ Times `f()` from within a test.
+
+The number of iterations of a sample is calibrated (which also warms up `f`)
+so that a sample lasts at least `options.sampleTime` seconds. The time of one
+iteration is then summarized by the median and the median absolute deviation
+(MAD) over `options.samples` samples, which are robust to the occasional
+outlier. `options.bytes` or `options.flops`, the work done by one call, are
+used to report a throughput.
+
+If a baseline was set, a slowdown is a failure when it is larger than both
+`tolerance` times the baseline median and `z` times the combined noise of
+the two measures.
+]]
+function Tester:benchmark(name, f, options)
+   assert(type(name) == 'string', "benchmark expects a name")
+   assert(type(f) == 'function', "benchmark expects a function")
+   options = options or {}
+   local nSamples = options.samples or 11
+   local sampleTime = options.sampleTime or 0.02
+
+   local timer = torch.Timer()
+   local function sample(n)
+      timer:reset()
+      for i = 1, n do
+         f()
+      end
+      return timer:time().real
+   end
+
+   local n = 1
+   local elapsed = sample(n)
+   while elapsed < sampleTime do
+      if elapsed > 0 then
+         n = math.max(n + 1, math.min(n * 10,
+                                      math.ceil(n * sampleTime * 1.1 / elapsed)))
+      else
+         n = n * 10
+      end
+      elapsed = sample(n)
+   end
+   for i = 1, options.warmup or 1 do
+      sample(n)
+   end
+
+   collectgarbage()
+   local times = {}
+   for i = 1, nSamples do
+      times[i] = sample(n) / n
+   end
+   local median = check.median(times)
+   local deviations = {}
+   for i, t in ipairs(times) do
+      deviations[i] = math.abs(t - median)
+   end
+
+   local result = {median = median, mad = check.median(deviations),
+                   iterations = n, samples = nSamples,
+                   bytes = options.bytes, flops = options.flops}
+   local fullName = self._currentTestName ~= ''
+                    and self._currentTestName .. '.' .. name or name
+   self.benchmarks = self.benchmarks or {}
+   self.benchmarks[fullName] = result
+
+   local baseline = self._benchmarkBaseline
+                    and self._benchmarkBaseline[fullName]
+   if baseline then
+      result.baseline = baseline.median
+      -- 1.4826 * MAD estimates the standard deviation of normal noise
+      local noise = 1.4826 * math.sqrt(result.mad^2 + (baseline.mad or 0)^2)
+      local slowdown = result.median - baseline.median
+      self:_assert_sub(slowdown <= self._benchmarkTolerance * baseline.median
+                          or slowdown <= self._benchmarkZ * noise,
+                       string.format('BENCHMARK slowdown: %s takes %s '
+                                        .. '(MAD %s), baseline %s (MAD %s)',
+                                     name, check.formatTime(result.median),
+                                     check.formatTime(result.mad),
+                                     check.formatTime(baseline.median),
+                                     check.formatTime(baseline.mad or 0)))
+   end
+   return result
+end
+
 function Tester:add(f, name)
    if type(f) == "table" then
       assert(name == nil, "Name parameter is forbidden for a table of tests, "
@@ -346,6 +457,7 @@ function Tester:run(testNames)
    self.assertionFail = {}
    self.haveWarning = {}
    self.testError = {}
+   self.benchmarks = {}
    for name in pairs(tests) do
       self.assertionPass[name] = 0
       self.assertionFail[name] = 0
@@ -572,6 +684,34 @@ function Tester:_report(tests)
       printDashes()
    end
 
+   local benchmarkNames = {}
+   for name in pairs(self.benchmarks) do
+      table.insert(benchmarkNames, name)
+   end
+   if #benchmarkNames > 0 then
+      table.sort(benchmarkNames)
+      local lines = {'Benchmarks (median +- MAD per call)'}
+      for _, name in ipairs(benchmarkNames) do
+         local result = self.benchmarks[name]
+         local line = string.format('%-40s %10s +- %-10s', name,
+                                    check.formatTime(result.median),
+                                    check.formatTime(result.mad))
+         if result.bytes then
+            line = line .. string.format(' %8.3f GB/s',
+                                         result.bytes / result.median / 1e9)
+         elseif result.flops then
+            line = line .. string.format(' %8.3f GFLOP/s',
+                                         result.flops / result.median / 1e9)
+         end
+         if result.baseline then
+            line = line .. string.format(' (%+.1f%% vs baseline)',
+               100 * (result.median - result.baseline) / result.baseline)
+         end
+         table.insert(lines, line)
+      end
+      addSection(table.concat(lines, '\n'))
+   end
+
    if not self.summaryOnly then
       for _, v in ipairs(self.errors) do
          addSection(v)
@@ -877,3 +1017,167 @@ function check.areTablesEq(t1, t2, tolerance, negate)
    end
    return not negate, 'The tables are equal'
 end
+
+function check.median(values)
+   local sorted = {}
+   for i, v in ipairs(values) do
+      sorted[i] = v
+   end
+   table.sort(sorted)
+   local n = #sorted
+   if n % 2 == 1 then
+      return sorted[(n + 1) / 2]
+   end
+   return (sorted[n / 2] + sorted[n / 2 + 1]) / 2
+end
+
+function check.formatTime(t)
+   if t >= 1 then
+      return string.format('%.3fs', t)
+   elseif t >= 1e-3 then
+      return string.format('%.3fms', t * 1e3)
+   elseif t >= 1e-6 then
+      return string.format('%.3fus', t * 1e6)
+   end
+   return string.format('%.1fns', t * 1e9)
+end
+
+--[[ Encodes tables of strings, numbers and booleans (and nested tables), as
+written by Tester:saveBenchmarks. Keys are sorted for stable diffs. ]]
+function json.encode(value, indent)
+   indent = indent or ''
+   if type(value) == 'table' then
+      local keys = {}
+      for k in pairs(value) do
+         table.insert(keys, tostring(k))
+      end
+      table.sort(keys)
+      local items = {}
+      for _, k in ipairs(keys) do
+         table.insert(items, indent .. '  ' .. json.encode(k) .. ': '
+                             .. json.encode(value[k], indent .. '  '))
+      end
+      if #items == 0 then
+         return '{}'
+      end
+      return '{\n' .. table.concat(items, ',\n') .. '\n' .. indent .. '}'
+   elseif type(value) == 'string' then
+      return '"' .. value:gsub('[%c"\\]', function(c)
+         return string.format('\\u%04x', c:byte())
+      end) .. '"'
+   elseif type(value) == 'number' then
+      return string.format('%.17g', value)
+   end
+   return tostring(value)
+end
+
+function json.decode(str)
+   local pos = 1
+
+   local function skip()
+      pos = str:find('[^%s]', pos) or #str + 1
+   end
+
+   local function fail(what)
+      error(string.format("JSON: %s at position %d", what, pos))
+   end
+
+   local parseValue
+
+   local function parseString()
+      local chars = {}
+      pos = pos + 1
+      while true do
+         local c = str:sub(pos, pos)
+         if c == '' then
+            fail("unterminated string")
+         elseif c == '"' then
+            pos = pos + 1
+            return table.concat(chars)
+         elseif c == '\\' then
+            local e = str:sub(pos + 1, pos + 1)
+            local escapes = {b = '\b', f = '\f', n = '\n', r = '\r', t = '\t'}
+            if e == 'u' then
+               local code = tonumber(str:sub(pos + 2, pos + 5), 16)
+               if not code then fail("invalid escape") end
+               table.insert(chars, code < 256 and string.char(code) or '?')
+               pos = pos + 6
+            else
+               table.insert(chars, escapes[e] or e)
+               pos = pos + 2
+            end
+         else
+            table.insert(chars, c)
+            pos = pos + 1
+         end
+      end
+   end
+
+   local function parseContainer(close, parseItem)
+      pos = pos + 1
+      skip()
+      if str:sub(pos, pos) == close then
+         pos = pos + 1
+         return
+      end
+      while true do
+         parseItem()
+         skip()
+         local c = str:sub(pos, pos)
+         pos = pos + 1
+         if c == close then
+            return
+         elseif c ~= ',' then
+            fail("expected ',' or '" .. close .. "'")
+         end
+      end
+   end
+
+   function parseValue()
+      skip()
+      local c = str:sub(pos, pos)
+      if c == '{' then
+         local object = {}
+         parseContainer('}', function()
+            skip()
+            if str:sub(pos, pos) ~= '"' then fail("expected a key") end
+            local key = parseString()
+            skip()
+            if str:sub(pos, pos) ~= ':' then fail("expected ':'") end
+            pos = pos + 1
+            object[key] = parseValue()
+         end)
+         return object
+      elseif c == '[' then
+         local array = {}
+         parseContainer(']', function()
+            table.insert(array, parseValue())
+         end)
+         return array
+      elseif c == '"' then
+         return parseString()
+      end
+      for _, literal in ipairs({'true', 'false', 'null'}) do
+         if str:sub(pos, pos + #literal - 1) == literal then
+            pos = pos + #literal
+            if literal ~= 'null' then
+               return literal == 'true'
+            end
+            return nil
+         end
+      end
+      local number = str:match('^-?%d+%.?%d*[eE]?[-+]?%d*', pos)
+      if not number or not tonumber(number) then
+         fail("unexpected character")
+      end
+      pos = pos + #number
+      return tonumber(number)
+   end
+
+   local value = parseValue()
+   skip()
+   if pos <= #str then
+      fail("trailing characters")
+   end
+   return value
+end
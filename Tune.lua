@@ -0,0 +1,218 @@
+-- Autotuning of the TH kernels on the current host.
+--
+-- Each candidate (SIMD implementation of a vector kernel, OpenMP threshold,
+-- size and block of the transposed copy, layout of searched vectors) is
+-- timed on synthetic tensors and the fastest one is recorded as a tuning
+-- parameter (see torch.settune), which TH consults when it selects a kernel.
+-- torch.tune{save=true} writes them to the per-host cache file read when
+-- torch is loaded.
+
+local vectorOps = {
+   fill = function(x, y, z) z:fill(2) end,
+   cadd = function(x, y, z) z:add(x, 2, y) end,
+   adds = function(x, y, z) z:add(x, 2) end,
+   cmul = function(x, y, z) z:cmul(x, y) end,
+   muls = function(x, y, z) z:mul(x, 2) end,
+   cdiv = function(x, y, z) z:cdiv(x, y) end,
+   divs = function(x, y, z) z:div(x, 2) end,
+   copy = function(x, y, z) z:copy(x) end,
+}
+
+-- SIMD extensions as numbered by TH (1 is AVX2 on x86, NEON or VSX
+-- elsewhere; 2 is AVX; 4 is SSE), 0 being the plain C implementation
+local simdExtensions = {1, 2, 4, 0}
+
+-- larger than any tensor: disables a size-triggered path
+local never = 2^30
+
+local function bench(f, reps)
+   local best = math.huge
+   for r=1,3 do
+      local timer = torch.Timer()
+      for i=1,reps do
+         f()
+      end
+      best = math.min(best, timer:time().real)
+   end
+   return best
+end
+
+local function report(verbose, name, value, times)
+   if verbose then
+      local t = {}
+      for candidate, time in pairs(times) do
+         table.insert(t, string.format('%s: %.3gs', candidate, time))
+      end
+      table.sort(t)
+      print(string.format('%-30s %-8s (%s)', name, tostring(value), table.concat(t, ', ')))
+   end
+end
+
+local function tuneVector(opt)
+   for _, typename in ipairs{'Float', 'Double'} do
+      local type = 'torch.' .. typename .. 'Tensor'
+      local x = torch[typename .. 'Tensor'](opt.vectorSize):uniform(1, 2)
+      local y = x:clone():uniform(1, 2)
+      local z = x:clone()
+      for op, f in pairs(vectorOps) do
+         local name = 'vector.' .. op .. '.' .. typename
+         local best, bestTime
+         local times = {}
+         for _, ext in ipairs(simdExtensions) do
+            torch.settune(name, ext)
+            if torch.vectordispatch(op, type) == ext then
+               times[ext] = bench(function() f(x, y, z) end, opt.vectorReps)
+               if not bestTime or times[ext] < bestTime then
+                  best, bestTime = ext, times[ext]
+               end
+            end
+         end
+         torch.settune(name, best)
+         report(opt.verbose, name, best, times)
+      end
+   end
+   torch.vectordispatch()
+end
+
+-- smallest size above which OpenMP pays off for a pointwise kernel, never
+-- when it does not even for the largest size
+local function tuneThreads(opt)
+   local sizes = {}
+   local times = {}
+   for k=10,22 do
+      table.insert(sizes, 2^k)
+   end
+   local threshold = never
+   for i=#sizes,1,-1 do
+      local n = sizes[i]
+      local x = torch.FloatTensor(n):uniform()
+      local y = torch.FloatTensor(n):uniform()
+      local z = torch.FloatTensor(n)
+      local reps = math.max(1, math.floor(2^24 / n))
+      torch.settune('omp.threshold', never)
+      local serial = bench(function() z:add(x, 2, y) end, reps)
+      torch.settune('omp.threshold', 0)
+      local parallel = bench(function() z:add(x, 2, y) end, reps)
+      times[n] = parallel / serial
+      if parallel >= serial then
+         break
+      end
+      threshold = n / 2
+   end
+   torch.settune('omp.threshold', threshold)
+   report(opt.verbose, 'omp.threshold', threshold, times)
+end
+
+local function tuneTranspose(opt)
+   -- smallest transposed matrix for which the blocked copy pays off
+   local times = {}
+   local sizes = {8, 16, 24, 32, 48, 64, 96, 128}
+   local minimum = never
+   for i=#sizes,1,-1 do
+      local n = sizes[i]
+      local x = torch.FloatTensor(n, n):uniform():t()
+      local z = torch.FloatTensor(n, n)
+      local reps = math.max(1, math.floor(2^20 / (n*n)))
+      torch.settune('copy.transpose.min', never)
+      local plain = bench(function() z:copy(x) end, reps)
+      torch.settune('copy.transpose.min', 0)
+      local blocked = bench(function() z:copy(x) end, reps)
+      times[n*n] = blocked / plain
+      if blocked >= plain then
+         break
+      end
+      minimum = n*n
+   end
+   report(opt.verbose, 'copy.transpose.min', minimum, times)
+
+   -- block size of the blocked copy
+   torch.settune('copy.transpose.min', 0)
+   for _, typename in ipairs{'Byte', 'Float', 'Double'} do
+      local x = torch[typename .. 'Tensor'](opt.transposeSize, opt.transposeSize):random(100):t()
+      local z = torch[typename .. 'Tensor'](opt.transposeSize, opt.transposeSize)
+      local name = 'copy.transpose.block.' .. typename
+      local best, bestTime
+      local times = {}
+      for _, block in ipairs{16, 32, 60, 120, 240} do
+         torch.settune(name, block)
+         times[block] = bench(function() z:copy(x) end, opt.transposeReps)
+         if not bestTime or times[block] < bestTime then
+            best, bestTime = block, times[block]
+         end
+      end
+      torch.settune(name, best)
+      report(opt.verbose, name, best, times)
+   end
+   torch.settune('copy.transpose.min', minimum)
+end
+
+-- smallest sorted vector for which torch.searchsorted pays for the Eytzinger
+-- layout
+local function tuneSearch(opt)
+   local times = {}
+   local minimum = never
+   for k=14,4,-1 do
+      local n = 2^k
+      local sorted = torch.FloatTensor(n):range(1, n)
+      local values = torch.FloatTensor(opt.searchSize):uniform(0, n + 1)
+      local r = torch.LongTensor()
+      torch.settune('searchsorted.eytzinger.min', never)
+      local binary = bench(function() sorted.searchsorted(r, sorted, values) end, opt.searchReps)
+      torch.settune('searchsorted.eytzinger.min', 0)
+      local eytzinger = bench(function() sorted.searchsorted(r, sorted, values) end, opt.searchReps)
+      times[n] = eytzinger / binary
+      if eytzinger >= binary then
+         break
+      end
+      minimum = n
+   end
+   torch.settune('searchsorted.eytzinger.min', minimum)
+   report(opt.verbose, 'searchsorted.eytzinger.min', minimum, times)
+end
+
+function torch.tune(opt)
+   opt = opt or {}
+   local defaults = {
+      vector = true, vectorSize = 4096, vectorReps = 2000,
+      threads = true,
+      transpose = true, transposeSize = 1024, transposeReps = 4,
+      search = true, searchSize = 2^16, searchReps = 10,
+      save = false, verbose = false
+   }
+   for k, v in pairs(defaults) do
+      if opt[k] == nil then
+         opt[k] = v
+      end
+   end
+
+   local nthreads = torch.getnumthreads()
+   if opt.vector then
+      torch.setnumthreads(1)
+      tuneVector(opt)
+      torch.setnumthreads(nthreads)
+   end
+   if opt.threads and nthreads > 1 then
+      tuneThreads(opt)
+   end
+   if opt.transpose then
+      tuneTranspose(opt)
+   end
+   if opt.search then
+      tuneSearch(opt)
+   end
+
+   if opt.save then
+      torch.savetune(opt.path)
+   end
+   return torch.tunetable()
+end
+
+-- tune on the first use of torch on a host, when asked to
+if os.getenv('TH_AUTOTUNE') == '1' then
+   local f = io.open(torch.tunepath())
+   if f then
+      f:close()
+   else
+      torch.tune{save = true}
+   end
+end
@@ -384,6 +384,119 @@ static int torch_Tensor_(select)(lua_State *L)
   return 1;
 }
 
+/* makes self a view of the slice index of src along dimension dim, reusing
+   self instead of allocating a new tensor */
+static int torch_Tensor_(setSelect)(lua_State *L)
+{
+  THTensor *self = luaT_checkudata(L, 1, torch_Tensor);
+  THTensor *src = luaT_checkudata(L, 2, torch_Tensor);
+  int dimension = luaL_checkint(L, 3)-1;
+  long sliceIndex = luaL_checklong(L, 4)-1;
+
+  THArgCheck(src->nDimension > 1, 2, "cannot select on a vector");
+  THArgCheck((dimension >= 0) && (dimension < src->nDimension), 3, "out of range");
+  THArgCheck((sliceIndex >= 0) && (sliceIndex < src->size[dimension]), 4, "out of range");
+
+  THTensor_(select)(self, src, dimension, sliceIndex);
+  lua_settop(L, 1);
+  return 1;
+}
+
+/* iterator returned by rows(): upvalues are the source tensor, the view
+   (rebound at each step), the dimension and the last index */
+static int torch_Tensor_(rowsNext)(lua_State *L)
+{
+  THTensor *src = luaT_checkudata(L, lua_upvalueindex(1), torch_Tensor);
+  int dimension = (int)lua_tointeger(L, lua_upvalueindex(3));
+  long index = (long)lua_tointeger(L, lua_upvalueindex(4));
+
+  if(dimension >= src->nDimension || index >= src->size[dimension])
+    return 0;
+
+  lua_pushinteger(L, index+1);
+  lua_replace(L, lua_upvalueindex(4));
+  lua_pushinteger(L, index+1);
+
+  if(src->nDimension == 1)
+    luaG_(pushreal)(L, THStorage_(get)(src->storage, src->storageOffset+index*src->stride[0]));
+  else
+  {
+    THTensor *view = luaT_checkudata(L, lua_upvalueindex(2), torch_Tensor);
+    int reuse = (index > 0 && view->storage == src->storage && view->nDimension == src->nDimension-1);
+    int d;
+    /* after the first step only the offset changes, unless the view or the
+       source were modified in between: size and stride are read again from
+       the source rather than trusted from the previous step */
+    for(d = 0; reuse && d < view->nDimension; d++)
+    {
+      int sd = (d < dimension ? d : d+1);
+      reuse = (view->size[d] == src->size[sd] && view->stride[d] == src->stride[sd]);
+    }
+    if(reuse)
+      view->storageOffset = src->storageOffset + index*src->stride[dimension];
+    else
+      THTensor_(select)(view, src, dimension, index);
+    lua_pushvalue(L, lua_upvalueindex(2));
+  }
+  return 2;
+}
+
+static int torch_Tensor_(rows)(lua_State *L)
+{
+  THTensor *tensor = luaT_checkudata(L, 1, torch_Tensor);
+  int dimension = luaL_optint(L, 2, 1)-1;
+
+  THArgCheck(tensor->nDimension > 0, 1, "empty Tensor");
+  THArgCheck((dimension >= 0) && (dimension < tensor->nDimension), 2, "out of range");
+
+  lua_settop(L, 1);
+  luaT_pushudata(L, THTensor_(new)(), torch_Tensor);
+  lua_pushinteger(L, dimension);
+  lua_pushinteger(L, 0);
+  lua_pushcclosure(L, torch_Tensor_(rowsNext), 4);
+  return 1;
+}
+
+/* storage index of the element at the nidx indices found on the stack at
+   position first, without building a table or a LongStorage */
+static ptrdiff_t torch_Tensor_(c_elementIndex)(lua_State *L, THTensor *tensor, int first, int nidx)
+{
+  ptrdiff_t index = tensor->storageOffset;
+  int dim;
+
+  THArgCheck(tensor->nDimension > 0, 1, "empty Tensor");
+  THArgCheck(nidx == tensor->nDimension, first, "expected %d indices, got %d",
+             tensor->nDimension, nidx);
+
+  for(dim = 0; dim < nidx; dim++)
+  {
+    long z = luaL_checklong(L, first+dim)-1;
+    if (z < 0) z = tensor->size[dim] + z + 1;
+    THArgCheck((z >= 0) && (z < tensor->size[dim]), first+dim, "index out of bound");
+    index += z*tensor->stride[dim];
+  }
+  return index;
+}
+
+static int torch_Tensor_(value)(lua_State *L)
+{
+  THTensor *tensor = luaT_checkudata(L, 1, torch_Tensor);
+  ptrdiff_t index = torch_Tensor_(c_elementIndex)(L, tensor, 2, lua_gettop(L)-1);
+  luaG_(pushreal)(L, THStorage_(get)(tensor->storage, index));
+  return 1;
+}
+
+static int torch_Tensor_(setValue)(lua_State *L)
+{
+  THTensor *tensor = luaT_checkudata(L, 1, torch_Tensor);
+  int narg = lua_gettop(L);
+  real value = luaG_(checkreal)(L, narg);
+  ptrdiff_t index = torch_Tensor_(c_elementIndex)(L, tensor, 2, narg-2);
+  THStorage_(set)(tensor->storage, index, value);
+  lua_settop(L, 1);
+  return 1;
+}
+
 #ifndef TH_REAL_IS_HALF
 static int torch_Tensor_(indexSelect)(lua_State *L)
 {
@@ -626,6 +739,13 @@ static int torch_Tensor_(isContiguous)(lua_State *L)
   return 1;
 }
 
+static int torch_Tensor_(isDense)(lua_State *L)
+{
+  THTensor *tensor = luaT_checkudata(L, 1, torch_Tensor);
+  lua_pushboolean(L, THTensor_(isDense)(tensor));
+  return 1;
+}
+
 static int torch_Tensor_(isSize)(lua_State *L)
 {
   THTensor *tensor = luaT_checkudata(L, 1, torch_Tensor);
@@ -1293,9 +1413,72 @@ static int torch_Tensor_(read)(lua_State *L)
   if(tensor->storage)
     THStorage_(retain)(tensor->storage);
 
+  THTensor_(refreshGeometry)(tensor);
   return 0;
 }
 
+static int torch_Tensor_(__tostring__)(lua_State *L)
+{
+  THTensor *tensor = luaT_checkudata(L, 1, torch_Tensor);
+  const torch_PrintOptions *options = torch_getprintoptions();
+  int summarize = THTensor_(nElement)(tensor) > options->threshold;
+  int nDimension = tensor->nDimension;
+  torch_FormatView view;
+  real *tensor_data;
+  long *counter;
+  ptrdiff_t n = 1, i;
+  int d;
+
+  if(nDimension == 0)
+  {
+    lua_pushfstring(L, "[%s with no dimension]\n", torch_Tensor);
+    return 1;
+  }
+
+  view.nDimension = nDimension;
+  view.size = tensor->size;
+  view.edgeitems = options->edgeitems;
+  view.dsize = THAlloc(sizeof(long)*nDimension);
+  counter = THAlloc(sizeof(long)*nDimension);
+  for(d = 0; d < nDimension; d++)
+  {
+    view.dsize[d] = (summarize && tensor->size[d] > 2*options->edgeitems ? 2*options->edgeitems : tensor->size[d]);
+    counter[d] = 0;
+    n *= view.dsize[d];
+  }
+
+  /* only the displayed items are read, so a summarized tensor costs O(edgeitems^dim) */
+  view.data = THAlloc(sizeof(double)*n);
+  tensor_data = THTensor_(data)(tensor);
+  for(i = 0; i < n; i++)
+  {
+    ptrdiff_t offset = 0;
+    for(d = 0; d < nDimension; d++)
+      offset += torch_Format_index(&view, d, counter[d]) * tensor->stride[d];
+    view.data[i] = REAL_TO_LUA_NUMBER(tensor_data[offset]);
+    for(d = nDimension-1; d >= 0; d--)
+    {
+      if(++counter[d] < view.dsize[d])
+        break;
+      counter[d] = 0;
+    }
+  }
+
+  torch_Format_push(L, &view, torch_Tensor);
+  THFree(view.data);
+  THFree(view.dsize);
+  THFree(counter);
+  return 1;
+}
+
+/* the descriptor retains the storage of the tensor */
+static int torch_Tensor_(toDLPack)(lua_State *L)
+{
+  THTensor *tensor = luaT_checkudata(L, 1, torch_Tensor);
+  luaT_pushudata(L, THTensor_(toDLPack)(tensor), "torch.DLPack");
+  return 1;
+}
+
 static const struct luaL_Reg torch_Tensor_(_) [] = {
   {"retain", torch_Tensor_(retain)},
   {"free", torch_Tensor_(free)},
@@ -1316,6 +1499,10 @@ static const struct luaL_Reg torch_Tensor_(_) [] = {
   {"narrow", torch_Tensor_(narrow)},
   {"sub", torch_Tensor_(sub)},
   {"select", torch_Tensor_(select)},
+  {"setSelect", torch_Tensor_(setSelect)},
+  {"rows", torch_Tensor_(rows)},
+  {"value", torch_Tensor_(value)},
+  {"setValue", torch_Tensor_(setValue)},
 #ifndef TH_REAL_IS_HALF
   {"index", torch_Tensor_(indexSelect)},
   {"indexCopy", torch_Tensor_(indexCopy)},
@@ -1329,6 +1516,7 @@ static const struct luaL_Reg torch_Tensor_(_) [] = {
   {"t", torch_Tensor_(t)},
   {"unfold", torch_Tensor_(unfold)},
   {"isContiguous", torch_Tensor_(isContiguous)},
+  {"isDense", torch_Tensor_(isDense)},
   {"isSameSizeAs", torch_Tensor_(isSameSizeAs)},
   {"isSetTo", torch_Tensor_(isSetTo)},
   {"isSize", torch_Tensor_(isSize)},
@@ -1341,8 +1529,10 @@ static const struct luaL_Reg torch_Tensor_(_) [] = {
 #endif
   {"read", torch_Tensor_(read)},
   {"write", torch_Tensor_(write)},
+  {"toDLPack", torch_Tensor_(toDLPack)},
   {"__index__", torch_Tensor_(__index__)},
   {"__newindex__", torch_Tensor_(__newindex__)},
+  {"__tostring__", torch_Tensor_(__tostring__)},
   {NULL, NULL}
 };
 
@@ -37,6 +37,8 @@ extern void torch_DoubleTensorOperator_init(lua_State *L);
 
 
 extern void torch_TensorMath_init(lua_State *L);
+extern void torch_DLPack_init(lua_State *L);
+extern void torch_ParallelMap_init(lua_State *L);
 
 
 LUA_EXTERNC DLL_EXPORT int luaopen_libtorch(lua_State *L);
@@ -83,6 +85,8 @@ int luaopen_libtorch(lua_State *L)
   torch_MemoryFile_init(L);
 
   torch_TensorMath_init(L);
+  torch_DLPack_init(L);
+  torch_ParallelMap_init(L);
 
   torch_random_init(L);
 
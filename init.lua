@@ -153,6 +153,9 @@ end
 torch.setdefaulttensortype('torch.DoubleTensor')
 
 require('torch.Tensor')
+require('torch.Einsum')
+require('torch.Tune')
+require('torch.Sketch')
 require('torch.File')
 require('torch.CmdLine')
 require('torch.FFInterface')
@@ -9,6 +9,8 @@
 #endif
 
 #include "THAtomic.h"
+#include "THTune.h"
+#include "THThread.h"
 #include "THVector.h"
 #include "THLogAdd.h"
 #include "THRandom.h"
@@ -17,6 +19,7 @@
 #include "THTensor.h"
 #include "THTensorApply.h"
 #include "THTensorDimApply.h"
+#include "THDLPack.h"
 
 #include "THFile.h"
 #include "THDiskFile.h"
@@ -0,0 +1,20 @@
+#include "THDLPack.h"
+
+static void *THDLPackAllocator_alloc(void *ctx, ptrdiff_t size)
+{
+  THError("cannot allocate memory for a tensor imported from DLPack");
+  return NULL;
+}
+
+static void THDLPackAllocator_free(void *ctx, void *data)
+{
+  THDLManagedTensor *managed = ctx;
+  if(managed && managed->deleter)
+    managed->deleter(managed);
+}
+
+THAllocator THDLPackAllocator = {
+  &THDLPackAllocator_alloc,
+  NULL,
+  &THDLPackAllocator_free
+};
@@ -0,0 +1,64 @@
+#ifndef TH_DLPACK_INC
+#define TH_DLPACK_INC
+
+#include "THGeneral.h"
+#include "THAllocator.h"
+#include <stdint.h>
+
+/******************************************************************************
+ * Exchange of tensors with other libraries of the process, without copy
+ *
+ * The descriptors have the layout of DLManagedTensor in dlpack.h (DLPack
+ * 0.x), so a pointer to one can be handed to any library which consumes or
+ * produces DLPack tensors. The consumer of a THDLManagedTensor owns it, and
+ * calls its deleter once it does not use the memory anymore.
+ *
+ * THTensor_(toDLPack)() describes the memory of a tensor; the descriptor
+ * retains the storage, so the tensor may be freed or resized before the
+ * deleter is called. THTensor_(newFromDLPack)() takes the ownership of a
+ * descriptor and returns a tensor on its memory; the deleter is called when
+ * the storage of the tensor is freed. Such a storage cannot be resized.
+ ******************************************************************************/
+
+#define TH_DL_INT 0
+#define TH_DL_UINT 1
+#define TH_DL_FLOAT 2
+
+#define TH_DL_CPU 1
+
+typedef struct THDLDataType
+{
+  uint8_t code;      /* TH_DL_INT, TH_DL_UINT or TH_DL_FLOAT */
+  uint8_t bits;
+  uint16_t lanes;    /* 1: TH has no vector types */
+} THDLDataType;
+
+typedef struct THDLDevice
+{
+  int device_type;   /* TH_DL_CPU */
+  int device_id;
+} THDLDevice;
+
+typedef struct THDLTensor
+{
+  void *data;
+  THDLDevice device;
+  int ndim;
+  THDLDataType dtype;
+  int64_t *shape;
+  int64_t *strides;  /* in elements; NULL for a contiguous tensor */
+  uint64_t byte_offset;
+} THDLTensor;
+
+typedef struct THDLManagedTensor
+{
+  THDLTensor dl_tensor;
+  void *manager_ctx;
+  void (*deleter)(struct THDLManagedTensor *self);
+} THDLManagedTensor;
+
+/* storages of imported tensors: the context is the THDLManagedTensor, whose
+   deleter is called by free */
+extern THAllocator THDLPackAllocator;
+
+#endif
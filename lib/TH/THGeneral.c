@@ -1,5 +1,6 @@
 #include "THGeneral.h"
 #include "THAtomic.h"
+#include "THThread.h"
 
 #ifdef _OPENMP
 #include <omp.h>
@@ -133,13 +134,21 @@ void THSetDefaultArgErrorHandler(THArgErrorHandlerFunction new_handler, void *da
 
 static __thread void (*torchGCFunction)(void *data) = NULL;
 static __thread void *torchGCData;
+static __thread int (*torchGCStepFunction)(void *data, ptrdiff_t size) = NULL;
+static __thread void *torchGCStepData;
 static ptrdiff_t heapSize = 0;
 static __thread ptrdiff_t heapDelta = 0;
 static const ptrdiff_t heapMaxDelta = (ptrdiff_t)1e6; // limit to +/- 1MB before updating heapSize
 static const ptrdiff_t heapMinDelta = (ptrdiff_t)-1e6;
-static __thread ptrdiff_t heapSoftmax = (ptrdiff_t)3e8; // 300MB, adjusted upward dynamically
+static ptrdiff_t heapSoftmax = (ptrdiff_t)3e8; // process-wide, adjusted dynamically after each GC cycle
+static ptrdiff_t heapSoftmaxFloor = (ptrdiff_t)3e8; // 300MB, heapSoftmax never decays below
+static ptrdiff_t heapHardmax = 0; // full GC above this size, 0 for no hard limit
 static const double heapSoftmaxGrowthThresh = 0.8; // grow softmax if >80% max after GC
 static const double heapSoftmaxGrowthFactor = 1.4; // grow softmax by 40%
+static const double heapSoftmaxDecayFactor = 0.9; // otherwise decay softmax by 10%
+static __thread ptrdiff_t heapAllocated = 0; // bytes allocated since the last GC step
+static __thread ptrdiff_t heapAfterFullGC = 0;
+static __thread THGCStats gcStats;
 
 /* Optional hook for integrating with a garbage-collected frontend.
  *
@@ -150,6 +159,12 @@ static const double heapSoftmaxGrowthFactor = 1.4; // grow softmax by 40%
  * (1) When a memory allocation (malloc, realloc, ...) fails
  * (2) When the total TH-allocated memory hits a dynamically-adjusted
  *     soft maximum.
+ *
+ * In case (2), if a step handler is set, the GC is run incrementally: each
+ * step is given the number of bytes allocated since the previous one, so
+ * that the collection work is spread over the allocations instead of being
+ * done at once. The full GC handler is then only used for (1) and when the
+ * heap exceeds the optional hard maximum.
  */
 void THSetGCHandler( void (*torchGCFunction_)(void *data), void *data )
 {
@@ -157,6 +172,52 @@ void THSetGCHandler( void (*torchGCFunction_)(void *data), void *data )
   torchGCData = data;
 }
 
+void THSetGCStepHandler( int (*torchGCStepFunction_)(void *data, ptrdiff_t size), void *data )
+{
+  torchGCStepFunction = torchGCStepFunction_;
+  torchGCStepData = data;
+  heapAllocated = 0;
+}
+
+void THSetGCLimits(ptrdiff_t softmaxFloor, ptrdiff_t hardmax)
+{
+  if (softmaxFloor <= 0)
+    THError("THSetGCLimits: soft maximum floor must be positive");
+  if (hardmax < 0)
+    THError("THSetGCLimits: hard maximum must be positive or 0");
+  heapSoftmaxFloor = softmaxFloor;
+  heapHardmax = hardmax;
+  THAtomicSetPtrdiff(&heapSoftmax, softmaxFloor);
+}
+
+void THGetGCLimits(ptrdiff_t *softmaxFloor, ptrdiff_t *hardmax)
+{
+  *softmaxFloor = heapSoftmaxFloor;
+  *hardmax = heapHardmax;
+}
+
+void THGetGCStats(THGCStats *stats)
+{
+  *stats = gcStats;
+  stats->heapSize = THAtomicGetPtrdiff(&heapSize) + heapDelta;
+  stats->heapSoftmax = THAtomicGetPtrdiff(&heapSoftmax);
+}
+
+void THResetGCStats(void)
+{
+  memset(&gcStats, 0, sizeof(gcStats));
+}
+
+static double getGCTime(void) {
+#if defined(CLOCK_MONOTONIC) && !defined(_WIN32)
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
 /* it is guaranteed the allocated size is not bigger than PTRDIFF_MAX */
 static ptrdiff_t getAllocSize(void *ptr) {
 #if defined(__unix) && defined(HAVE_MALLOC_USABLE_SIZE)
@@ -183,20 +244,78 @@ static ptrdiff_t applyHeapDelta() {
   return newHeapSize;
 }
 
-/* (1) if the torch-allocated heap size exceeds the soft max, run GC
- * (2) if post-GC heap size exceeds 80% of the soft max, increase the
- *     soft max by 40%
+/* after a GC cycle, grow the soft max by 40% if the heap is still above 80%
+ * of it, otherwise let it decay by 10% towards the heap size (and no lower
+ * than the floor)
  */
-static void maybeTriggerGC(ptrdiff_t curHeapSize) {
-  if (torchGCFunction && curHeapSize > heapSoftmax) {
-    torchGCFunction(torchGCData);
+static void updateHeapSoftmax(ptrdiff_t curHeapSize) {
+  ptrdiff_t softmax = THAtomicGetPtrdiff(&heapSoftmax);
+
+  if (curHeapSize > softmax * heapSoftmaxGrowthThresh) {
+    softmax = (ptrdiff_t)(softmax * heapSoftmaxGrowthFactor);
+  } else {
+    ptrdiff_t target = (ptrdiff_t)(curHeapSize / heapSoftmaxGrowthThresh);
+    softmax = (ptrdiff_t)(softmax * heapSoftmaxDecayFactor);
+    if (softmax < target)
+      softmax = target;
+  }
+  if (softmax < heapSoftmaxFloor)
+    softmax = heapSoftmaxFloor;
+
+  THAtomicSetPtrdiff(&heapSoftmax, softmax);
+}
 
-    // ensure heapSize is accurate before updating heapSoftmax
-    ptrdiff_t newHeapSize = applyHeapDelta();
+static void runFullGC(void) {
+  double start = getGCTime();
+  torchGCFunction(torchGCData);
+  double elapsed = getGCTime() - start;
 
-    if (newHeapSize > heapSoftmax * heapSoftmaxGrowthThresh) {
-      heapSoftmax = (ptrdiff_t)(heapSoftmax * heapSoftmaxGrowthFactor);
-    }
+  gcStats.fullCollections++;
+  gcStats.fullTime += elapsed;
+  if (elapsed > gcStats.maxFullTime)
+    gcStats.maxFullTime = elapsed;
+  heapAllocated = 0;
+
+  // ensure heapSize is accurate before updating heapSoftmax
+  heapAfterFullGC = applyHeapDelta();
+  updateHeapSoftmax(heapAfterFullGC);
+}
+
+static void runGCStep(void) {
+  double start = getGCTime();
+  int finished = torchGCStepFunction(torchGCStepData, heapAllocated);
+  double elapsed = getGCTime() - start;
+
+  gcStats.steps++;
+  gcStats.stepTime += elapsed;
+  if (elapsed > gcStats.maxStepTime)
+    gcStats.maxStepTime = elapsed;
+  heapAllocated = 0;
+
+  if (finished) {
+    gcStats.cycles++;
+    updateHeapSoftmax(applyHeapDelta());
+  }
+}
+
+/* (1) if the torch-allocated heap size exceeds the hard max (and grew by
+ *     10% of it since the last full GC, to avoid running it continuously),
+ *     run a full GC
+ * (2) if it exceeds the soft max, run a GC step, or a full GC when there is
+ *     no step handler
+ */
+static void maybeTriggerGC(ptrdiff_t curHeapSize) {
+  if (torchGCFunction && heapHardmax > 0 && curHeapSize > heapHardmax &&
+      curHeapSize > heapAfterFullGC + heapHardmax / 10) {
+    runFullGC();
+  } else if (curHeapSize > THAtomicGetPtrdiff(&heapSoftmax)) {
+    if (torchGCStepFunction)
+      runGCStep();
+    else if (torchGCFunction)
+      runFullGC();
+  } else {
+    // steps only account for the bytes allocated above the soft max
+    heapAllocated = 0;
   }
 }
 
@@ -210,6 +329,8 @@ void THHeapUpdate(ptrdiff_t size) {
 #endif
 
   heapDelta += size;
+  if (size > 0)
+    heapAllocated += size;
 
   // batch updates to global heapSize to minimize thread contention
   if (heapDelta < heapMaxDelta && heapDelta > heapMinDelta) {
@@ -324,6 +445,9 @@ void THSetNumThreads(int num_threads)
 #ifdef _OPENMP
   omp_set_num_threads(num_threads);
 #endif
+  /* the threads added to the pool inherit the affinity of the master */
+  if(THGetThreadAffinity(NULL, 0) > 0)
+    THApplyThreadAffinity();
 }
 
 int THGetNumThreads(void)
@@ -344,6 +468,19 @@ int THGetNumCores(void)
 #endif
 }
 
+/* read by every reduction, set once by the user: a plain int is enough */
+static int deterministic = 0;
+
+void THSetDeterministic(int flag)
+{
+  deterministic = (flag != 0);
+}
+
+int THGetDeterministic(void)
+{
+  return deterministic;
+}
+
 #ifdef TH_BLAS_MKL
 extern int mkl_get_max_threads(void);
 #endif
@@ -33,4 +33,183 @@ static inline float TH_lerpf(float a, float b, float weight) {
   return a + weight * (b-a);
 }
 
+/* log(exp(a) + exp(b)) and log(exp(a) - exp(b)), without overflow */
+static inline double TH_logaddexp(double a, double b) {
+  if(a == b)  /* also when both are the same infinity */
+    return a + 0.69314718055994530942;
+  return (a > b ? a : b) + log1p(exp(-fabs(a - b)));
+}
+
+static inline double TH_logsubexp(double a, double b) {
+  if(b == -INFINITY)
+    return a;
+  return a + log(-expm1(b - a));
+}
+
+static inline float TH_logaddexpf(float a, float b) {
+  if(a == b)
+    return a + 0.69314718f;
+  return (a > b ? a : b) + log1pf(expf(-fabsf(a - b)));
+}
+
+static inline float TH_logsubexpf(float a, float b) {
+  if(b == -INFINITY)
+    return a;
+  return a + logf(-expm1f(b - a));
+}
+
+/* The helpers below avoid branches and library calls, so that loops over
+   contiguous arrays calling them are vectorized by the compiler. */
+
+/* exp(x) for -708 <= x <= 0 (0 for -709): exp(r) * 2^n with x = n*log(2) + r, |r| <= log(2)/2 */
+static inline double TH_expNonPositiveFast(double x) {
+  double n = (double)(int)(x * 1.44269504088896341 - 0.5);
+  double r = x - n * 6.93147180369123816490e-01 - n * 1.90821492927058770002e-10;
+  double p = 1 + r * (1 + r * (1/2. + r * (1/6. + r * (1/24. + r * (1/120. + r * (1/720.
+             + r * (1/5040. + r * (1/40320. + r * (1/362880. + r * (1/3628800.
+             + r * (1/39916800. + r * (1/479001600. + r * (1/6227020800.)))))))))))));
+  union { double d; long long i; } scale;
+  scale.i = (long long)((int)n + 1023) << 52;
+  return p * scale.d;
+}
+
+/* log1p(x) for 0 <= x <= 1: 2*atanh(s) with s = x/(2+x) <= 1/3 */
+static inline double TH_log1pUnitFast(double x) {
+  double s = x / (2 + x);
+  double z = s * s;
+  double p = 1 + z * (1/3. + z * (1/5. + z * (1/7. + z * (1/9. + z * (1/11. + z * (1/13.
+             + z * (1/15. + z * (1/17. + z * (1/19. + z * (1/21. + z * (1/23. + z * (1/25.
+             + z * (1/27. + z * (1/29. + z * (1/31. + z * (1/33.))))))))))))))));
+  return 2 * s * p;
+}
+
+/* every value is computed before being selected, so that the selects can be
+   turned into blends (GCC only does so without -ftrapping-math) */
+static inline double TH_logaddexpFast(double a, double b) {
+  double d = -fabs(a - b);  /* NaN when a or b is NaN */
+  double m = (a > b ? a : b);
+  double e = TH_expNonPositiveFast(d >= -708 ? d : -709);  /* exp(-709) gives 0 */
+  double r = m + TH_log1pUnitFast(e);
+  double same = a + 0.69314718055994530942;
+  double notSame = (d == d ? r : d);
+  return (a == b ? same : notSame);
+}
+
+static inline float TH_expNonPositiveFastf(float x) {
+  float n = (float)(int)(x * 1.44269504f - 0.5f);
+  float r = x - n * 0.693359375f + n * 2.12194440e-4f;
+  float p = 1 + r * (1 + r * (1/2.f + r * (1/6.f + r * (1/24.f + r * (1/120.f + r * (1/720.f
+            + r * (1/5040.f + r * (1/40320.f))))))));
+  union { float f; int i; } scale;
+  scale.i = ((int)n + 127) << 23;
+  return p * scale.f;
+}
+
+static inline float TH_log1pUnitFastf(float x) {
+  float s = x / (2 + x);
+  float z = s * s;
+  float p = 1 + z * (1/3.f + z * (1/5.f + z * (1/7.f + z * (1/9.f + z * (1/11.f + z * (1/13.f
+            + z * (1/15.f)))))));
+  return 2 * s * p;
+}
+
+static inline float TH_logaddexpFastf(float a, float b) {
+  float d = -fabsf(a - b);
+  float m = (a > b ? a : b);
+  float e = TH_expNonPositiveFastf(d >= -87 ? d : -88);  /* exp(-88) gives 0 */
+  float r = m + TH_log1pUnitFastf(e);
+  float same = a + 0.69314718f;
+  float notSame = (d == d ? r : d);
+  return (a == b ? same : notSame);
+}
+
+/* Division of w-bit integers by a divisor d known at run time, by a
+   multiplication and shifts instead of a hardware divide (Granlund and
+   Montgomery; Hacker's Delight, 10-1). For |d| >= 2 and a magic number M,
+     x / d = (hi(M*x) + add*x) >> shift, plus 1 if negative,
+   hi() being the high w bits of the 2w-bit product and add 1 if M < 0 < d,
+   -1 if d < 0 < M. For d = 1 and -1, M = 0, add = d and nothing is added
+   to negative quotients. Loops calling THIntDivider_divN are vectorized by
+   the compiler (as multiplications of the double width for N <= 32). */
+typedef struct THIntDivider
+{
+  long long magic;
+  long long add;
+  long long divisor;
+  int shift;
+  int round;
+} THIntDivider;
+
+static inline THIntDivider THIntDivider_new(long long d, int bits)
+{
+  THIntDivider dv;
+  unsigned long long ad = (d < 0 ? 0ULL - (unsigned long long)d : (unsigned long long)d);
+  int wide = 64 - bits;
+
+  dv.divisor = d;
+  if(ad == 1)
+  {
+    dv.magic = 0;
+    dv.add = d;
+    dv.shift = 0;
+    dv.round = 0;
+  }
+  else
+  {
+    unsigned long long two = 1ULL << (bits - 1);
+    unsigned long long t = two + (d < 0);
+    unsigned long long anc = t - 1 - t % ad;
+    unsigned long long q1 = two / anc, r1 = two - q1 * anc;
+    unsigned long long q2 = two / ad, r2 = two - q2 * ad;
+    unsigned long long delta, m;
+    int p = bits - 1;
+
+    do
+    {
+      p++;
+      q1 = 2 * q1; r1 = 2 * r1;
+      if(r1 >= anc) { q1++; r1 -= anc; }
+      q2 = 2 * q2; r2 = 2 * r2;
+      if(r2 >= ad) { q2++; r2 -= ad; }
+      delta = ad - r2;
+    } while(q1 < delta || (q1 == delta && r1 == 0));
+
+    m = q2 + 1;
+    if(d < 0)
+      m = 0ULL - m;
+    /* sign extension of the w-bit magic number */
+    dv.magic = (long long)(m << wide) >> wide;
+    dv.add = (d > 0 && dv.magic < 0 ? 1 : (d < 0 && dv.magic > 0 ? -1 : 0));
+    dv.shift = p - bits;
+    dv.round = 1;
+  }
+  return dv;
+}
+
+/* the sums are computed modulo 2^64, so that -x wraps for x = -2^(w-1) like
+   the hardware divide would */
+#define TH_INT_DIVIDER_QUOTIENT(DV, HI, X) \
+  ((long long)((unsigned long long)(HI) + (unsigned long long)(DV).add * (unsigned long long)(X)) >> (DV).shift)
+
+#define TH_INT_DIVIDER_IMPLEMENT(BITS, TYPE)                                   \
+static inline TYPE THIntDivider_div##BITS(THIntDivider dv, TYPE x)             \
+{                                                                              \
+  long long q = TH_INT_DIVIDER_QUOTIENT(dv, (dv.magic * x) >> BITS, x);        \
+  return (TYPE)(q + ((q >> 63) & dv.round));                                   \
+}
+
+TH_INT_DIVIDER_IMPLEMENT(8, signed char)
+TH_INT_DIVIDER_IMPLEMENT(16, short)
+TH_INT_DIVIDER_IMPLEMENT(32, int)
+
+#if defined(__SIZEOF_INT128__)
+#define TH_INT_DIVIDER_64
+static inline long long THIntDivider_div64(THIntDivider dv, long long x)
+{
+  long long hi = (long long)(((__int128)dv.magic * x) >> 64);
+  long long q = TH_INT_DIVIDER_QUOTIENT(dv, hi, x);
+  return q + ((q >> 63) & dv.round);
+}
+#endif
+
 #endif // _THMATH_H
@@ -1,5 +1,6 @@
 #include "THGeneral.h"
 #include "THRandom.h"
+#include "THTune.h"
 
 #ifndef _WIN32
 #include <fcntl.h>
@@ -270,3 +271,56 @@ int THRandom_bernoulli(THGenerator *_generator, double p)
   THArgCheck(p >= 0 && p <= 1, 1, "must be >= 0 and <= 1");
   return(__uniform__(_generator) <= p);
 }
+
+/* random words are drawn in chunks of that many trials, then expanded in parallel */
+#define TH_BERNOULLI_CHUNK (1 << 20)
+
+void THRandom_bernoulliMask(THGenerator *_generator, double p, unsigned char *mask, ptrdiff_t nTrials)
+{
+  int bits;
+  int trialsPerWord;
+  unsigned long long bitMask;
+  unsigned long long threshold;
+  unsigned int *words;
+  ptrdiff_t start;
+
+  THArgCheck(p >= 0 && p <= 1, 2, "must be >= 0 and <= 1");
+
+  /* smallest b such that p*2^b is an integer */
+  for(bits = 0; bits < 32 && ldexp(p, bits) != floor(ldexp(p, bits)); bits++);
+
+  if(bits == 0)
+  {
+    memset(mask, (p == 1), nTrials);
+    return;
+  }
+
+  trialsPerWord = 32/bits;
+  bitMask = (1ULL << bits) - 1;
+  threshold = (unsigned long long)floor(ldexp(p, bits) + 0.5);
+  words = THAlloc(sizeof(unsigned int) * ((TH_BERNOULLI_CHUNK + trialsPerWord - 1) / trialsPerWord));
+
+  for(start = 0; start < nTrials; start += TH_BERNOULLI_CHUNK)
+  {
+    ptrdiff_t chunkSize = THMin(nTrials - start, TH_BERNOULLI_CHUNK);
+    ptrdiff_t nWords = (chunkSize + trialsPerWord - 1) / trialsPerWord;
+    unsigned char *chunk = mask + start;
+    ptrdiff_t w;
+
+    /* the generator is sequential; only the expansion is parallel */
+    for(w = 0; w < nWords; w++)
+      words[w] = (unsigned int)THRandom_random(_generator);
+
+#pragma omp parallel for if(chunkSize > TH_OMP_OVERHEAD_THRESHOLD) private(w)
+    for(w = 0; w < nWords; w++)
+    {
+      unsigned long long word = words[w];
+      ptrdiff_t i = w * trialsPerWord;
+      ptrdiff_t end = THMin(i + trialsPerWord, chunkSize);
+      for(; i < end; i++, word >>= bits)
+        chunk[i] = ((word & bitMask) < threshold);
+    }
+  }
+
+  THFree(words);
+}
@@ -78,4 +78,9 @@ TH_API int THRandom_geometric(THGenerator *_generator, double p);
 
 /* Returns true with probability $p$ and false with probability $1-p$ (p > 0). */
 TH_API int THRandom_bernoulli(THGenerator *_generator, double p);
+
+/* Fills mask with nTrials Bernoulli trials (0 or 1) of probability p.
+   When p = k/2^b, a trial consumes b bits of a random word, so that up to 32
+   trials are drawn from a single THRandom_random() call. */
+TH_API void THRandom_bernoulliMask(THGenerator *_generator, double p, unsigned char *mask, ptrdiff_t nTrials);
 #endif
@@ -3,6 +3,7 @@
 
 #include "THStorage.h"
 #include "THTensorApply.h"
+#include "THDLPack.h"
 
 #define THTensor          TH_CONCAT_3(TH,Real,Tensor)
 #define THTensor_(NAME)   TH_CONCAT_4(TH,Real,Tensor_,NAME)
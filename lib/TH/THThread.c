@@ -0,0 +1,329 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "THThread.h"
+
+#include <ctype.h>
+#include <limits.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#ifdef __linux__
+#include <sched.h>
+#include <dirent.h>
+#define TH_THREAD_AFFINITY 1
+#define TH_MAX_CPUS CPU_SETSIZE
+#else
+#define TH_MAX_CPUS 1024
+#endif
+
+static THCpu topology[TH_MAX_CPUS];
+static int nCpus = -1;
+
+/* CPUs of the current subset, in the order they are given to the threads */
+static int order[TH_MAX_CPUS];
+static int nOrder = 0;
+static int placement = TH_PLACEMENT_NONE;
+
+static int nested = 0;
+
+#ifdef TH_THREAD_AFFINITY
+static int THThread_readInt(int cpu, const char *file, int def)
+{
+  char path[128];
+  int value;
+  FILE *f;
+
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/%s", cpu, file);
+  f = fopen(path, "r");
+  if(!f)
+    return def;
+  if(fscanf(f, "%d", &value) != 1)
+    value = def;
+  fclose(f);
+  return value;
+}
+
+/* the directory of a CPU has a link "node<k>" to its NUMA node */
+static int THThread_readNode(int cpu)
+{
+  char path[128];
+  struct dirent *entry;
+  int node = 0;
+  DIR *dir;
+
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+  dir = opendir(path);
+  if(!dir)
+    return 0;
+  while((entry = readdir(dir)))
+  {
+    if(strncmp(entry->d_name, "node", 4) == 0 && isdigit((unsigned char)entry->d_name[4]))
+    {
+      node = atoi(entry->d_name + 4);
+      break;
+    }
+  }
+  closedir(dir);
+  return node;
+}
+#endif
+
+static void THThread_initTopology(void)
+{
+  int i, j;
+
+  if(nCpus >= 0)
+    return;
+
+  nCpus = 0;
+#ifdef TH_THREAD_AFFINITY
+  {
+    cpu_set_t allowed;
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+    {
+      for(i = 0; i < CPU_SETSIZE; i++)
+      {
+        if(!CPU_ISSET(i, &allowed))
+          continue;
+        topology[nCpus].id = i;
+        topology[nCpus].core = THThread_readInt(i, "topology/core_id", i);
+        topology[nCpus].package = THThread_readInt(i, "topology/physical_package_id", 0);
+        topology[nCpus].node = THThread_readNode(i);
+        nCpus++;
+      }
+    }
+  }
+#endif
+  if(nCpus == 0)
+  {
+    nCpus = THGetNumCores();
+    if(nCpus > TH_MAX_CPUS)
+      nCpus = TH_MAX_CPUS;
+    for(i = 0; i < nCpus; i++)
+    {
+      topology[i].id = i;
+      topology[i].core = i;
+      topology[i].package = 0;
+      topology[i].node = 0;
+    }
+  }
+
+  /* SMT siblings share package and core_id, and are numbered in CPU order */
+  for(i = 0; i < nCpus; i++)
+  {
+    topology[i].smt = 0;
+    for(j = 0; j < i; j++)
+      if(topology[j].package == topology[i].package && topology[j].core == topology[i].core)
+        topology[i].smt++;
+  }
+}
+
+int THGetCpuTopology(THCpu *cpus, int max)
+{
+  THThread_initTopology();
+  if(cpus && max > 0)
+    memcpy(cpus, topology, sizeof(THCpu)*(max < nCpus ? max : nCpus));
+  return nCpus;
+}
+
+#ifdef TH_THREAD_AFFINITY
+/* position of a CPU in the subset for the scatter placement: rank among
+   the CPUs of its core, and rank of its core among the cores of its node */
+typedef struct THThreadSlot
+{
+  const THCpu *cpu;
+  int smt;
+  int core;
+} THThreadSlot;
+
+static void THThread_rankSlot(THThreadSlot *slot, const THCpu **subset, int n)
+{
+  const THCpu *cpu = slot->cpu;
+  int i, j;
+
+  slot->smt = 0;
+  slot->core = 0;
+  for(i = 0; i < n; i++)
+  {
+    const THCpu *other = subset[i];
+    if(other->node != cpu->node)
+      continue;
+    if(other->package == cpu->package && other->core == cpu->core)
+    {
+      if(other->smt < cpu->smt)
+        slot->smt++;
+    }
+    else if(other->package < cpu->package || (other->package == cpu->package && other->core < cpu->core))
+    {
+      /* count each core once, through its first CPU in the subset */
+      for(j = 0; j < i; j++)
+        if(subset[j]->package == other->package && subset[j]->core == other->core)
+          break;
+      if(j == i)
+        slot->core++;
+    }
+  }
+}
+
+static int THThread_before(const THThreadSlot *a, const THThreadSlot *b)
+{
+  if(placement == TH_PLACEMENT_SCATTER)
+  {
+    if(a->smt != b->smt)
+      return a->smt < b->smt;
+    if(a->core != b->core)
+      return a->core < b->core;
+    if(a->cpu->node != b->cpu->node)
+      return a->cpu->node < b->cpu->node;
+    return a->cpu->package < b->cpu->package;
+  }
+  if(a->cpu->node != b->cpu->node)
+    return a->cpu->node < b->cpu->node;
+  if(a->cpu->package != b->cpu->package)
+    return a->cpu->package < b->cpu->package;
+  if(a->cpu->core != b->cpu->core)
+    return a->cpu->core < b->cpu->core;
+  return a->cpu->smt < b->cpu->smt;
+}
+
+static int THThread_pin(int thread)
+{
+  cpu_set_t mask;
+  int i;
+
+  CPU_ZERO(&mask);
+  if(nOrder == 0)
+  {
+    for(i = 0; i < nCpus; i++)
+      CPU_SET(topology[i].id, &mask);
+  }
+  else if(placement == TH_PLACEMENT_NONE)
+  {
+    for(i = 0; i < nOrder; i++)
+      CPU_SET(order[i], &mask);
+  }
+  else
+    CPU_SET(order[thread % nOrder], &mask);
+
+  /* pid 0: the calling thread */
+  return sched_setaffinity(0, sizeof(mask), &mask) == 0;
+}
+#endif
+
+void THApplyThreadAffinity(void)
+{
+#ifdef TH_THREAD_AFFINITY
+  THThread_initTopology();
+#ifdef _OPENMP
+  /* the threads of the pool survive between parallel regions of the same
+     size, so pinning them once in a region is enough */
+#pragma omp parallel num_threads(omp_get_max_threads())
+  THThread_pin(omp_get_thread_num());
+#else
+  THThread_pin(0);
+#endif
+#endif
+}
+
+int THSetThreadAffinity(const int *cpus, int n, int placement_)
+{
+#ifdef TH_THREAD_AFFINITY
+  const THCpu *subset[TH_MAX_CPUS];
+  THThreadSlot slots[TH_MAX_CPUS];
+#endif
+  int i, j;
+
+  THArgCheck(placement_ == TH_PLACEMENT_NONE || placement_ == TH_PLACEMENT_COMPACT ||
+             placement_ == TH_PLACEMENT_SCATTER, 3, "invalid placement");
+  THArgCheck(n >= 0 && n <= TH_MAX_CPUS && (cpus || n == 0), 2, "invalid number of CPUs");
+  THThread_initTopology();
+
+  for(i = 0; i < n; i++)
+  {
+    for(j = 0; j < nCpus && topology[j].id != cpus[i]; j++);
+    THArgCheck(j < nCpus, 1, "CPU %d is not available to the process", cpus[i]);
+    for(j = 0; j < i && cpus[j] != cpus[i]; j++);
+    THArgCheck(j == i, 1, "CPU %d is given twice", cpus[i]);
+  }
+
+#ifndef TH_THREAD_AFFINITY
+  return 0;
+#else
+  placement = placement_;
+  if(n == 0)
+  {
+    for(i = 0; i < nCpus; i++)
+      subset[i] = &topology[i];
+    n = nCpus;
+  }
+  else
+  {
+    for(i = 0; i < n; i++)
+      for(j = 0; j < nCpus; j++)
+        if(topology[j].id == cpus[i])
+          subset[i] = &topology[j];
+  }
+
+  for(i = 0; i < n; i++)
+  {
+    slots[i].cpu = subset[i];
+    THThread_rankSlot(&slots[i], subset, n);
+  }
+
+  /* insertion sort: n is at most a few hundred, and this is done once */
+  for(i = 1; i < n; i++)
+  {
+    THThreadSlot slot = slots[i];
+    for(j = i; j > 0 && THThread_before(&slot, &slots[j-1]); j--)
+      slots[j] = slots[j-1];
+    slots[j] = slot;
+  }
+  for(i = 0; i < n; i++)
+    order[i] = slots[i].cpu->id;
+  nOrder = (cpus && n < nCpus) || placement != TH_PLACEMENT_NONE ? n : 0;
+
+  /* more threads than CPUs would only compete for them */
+  if(nOrder > 0 && THGetNumThreads() > nOrder)
+    THSetNumThreads(nOrder);
+  else
+    THApplyThreadAffinity();
+  return 1;
+#endif
+}
+
+int THGetThreadAffinity(int *cpus, int max)
+{
+  if(cpus && max > 0)
+    memcpy(cpus, order, sizeof(int)*(max < nOrder ? max : nOrder));
+  return nOrder;
+}
+
+int THGetThreadPlacement(void)
+{
+  return placement;
+}
+
+void THSetNestedParallelism(int flag)
+{
+  nested = (flag != 0);
+#ifdef _OPENMP
+#if _OPENMP < 201811
+  /* deprecated since OpenMP 5.0, where max-active-levels alone decides */
+  omp_set_nested(nested);
+#endif
+  omp_set_max_active_levels(nested ? INT_MAX : 1);
+#endif
+}
+
+int THGetNestedParallelism(void)
+{
+#ifdef _OPENMP
+  return omp_get_max_active_levels() > 1;
+#else
+  return nested;
+#endif
+}
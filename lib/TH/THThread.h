@@ -0,0 +1,62 @@
+#ifndef TH_THREAD_INC
+#define TH_THREAD_INC
+
+#include "THGeneral.h"
+
+/******************************************************************************
+ * Placement of the TH threads
+ *
+ * The topology is read once from /sys/devices/system/cpu (Linux), and is
+ * restricted to the CPUs the process was allowed to run on at that time.
+ * CPUs are designated by their number in the operating system.
+ *
+ * THSetThreadAffinity() restricts TH to a subset of these CPUs, and pins
+ * the threads of the OpenMP pool (or the calling thread without OpenMP):
+ *  - TH_PLACEMENT_NONE: each thread may run on any CPU of the subset
+ *  - TH_PLACEMENT_COMPACT: thread i on the i-th CPU of the subset ordered by
+ *    node, package, core and SMT sibling, so threads share caches
+ *  - TH_PLACEMENT_SCATTER: threads spread over the nodes first, then over
+ *    the cores, and only then over the SMT siblings of a core
+ * The pool is re-pinned by THSetNumThreads(). Threads which already exist
+ * outside the pool, such as those of a BLAS library, keep their placement.
+ * Threads created later inherit the affinity of the thread creating them:
+ * with COMPACT or SCATTER, a BLAS library started after the pinning runs all
+ * its threads on the single CPU of the calling thread.
+ ******************************************************************************/
+
+#define TH_PLACEMENT_NONE 0
+#define TH_PLACEMENT_COMPACT 1
+#define TH_PLACEMENT_SCATTER 2
+
+typedef struct THCpu
+{
+  int id;        /* number of the CPU in the operating system */
+  int core;      /* core_id, unique within a package */
+  int package;   /* physical package (socket) */
+  int node;      /* NUMA node */
+  int smt;       /* rank of the CPU among the SMT siblings of its core */
+} THCpu;
+
+/* fills at most max CPUs and returns their total number */
+TH_API int THGetCpuTopology(THCpu *cpus, int max);
+
+/*
+ * n CPU ids (all the CPUs of the topology when n == 0). Returns 1 when the
+ * threads were pinned, 0 when thread affinity is not supported on this
+ * platform. The number of threads is lowered to n when it is larger.
+ */
+TH_API int THSetThreadAffinity(const int *cpus, int n, int placement);
+/* fills at most max CPU ids of the current subset and returns their number,
+   0 when TH is not restricted */
+TH_API int THGetThreadAffinity(int *cpus, int max);
+TH_API int THGetThreadPlacement(void);
+
+/* nested parallel regions: with flag 0, a region started inside another
+   one runs on the thread that reaches it */
+TH_API void THSetNestedParallelism(int flag);
+TH_API int THGetNestedParallelism(void);
+
+/* pins the threads of the current pool again, after its size changed */
+TH_API void THApplyThreadAffinity(void);
+
+#endif
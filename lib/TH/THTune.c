@@ -0,0 +1,227 @@
+#include "THTune.h"
+
+#include <ctype.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#define TH_TUNE_NAME_LEN 64
+#define TH_TUNE_MAX_ENTRIES 256
+#define TH_TUNE_PATH_LEN 1024
+
+typedef struct THTuneParameter
+{
+  char name[TH_TUNE_NAME_LEN];
+  long value;
+} THTuneParameter;
+
+static THTuneParameter parameters[TH_TUNE_MAX_ENTRIES];
+static int nParameters = 0;
+static int generation = 0;
+
+static int THTune_find(const char *name)
+{
+  int i;
+  for(i = 0; i < nParameters; i++)
+    if(strcmp(parameters[i].name, name) == 0)
+      return i;
+  return -1;
+}
+
+/* "vector.cadd.Float" -> "TH_TUNE_VECTOR_CADD_FLOAT" */
+static const char *THTune_getenv(const char *name)
+{
+  char envname[TH_TUNE_NAME_LEN + 8];
+  size_t i, len = strlen(name);
+
+  if(len >= TH_TUNE_NAME_LEN)
+    return NULL;
+  memcpy(envname, "TH_TUNE_", 8);
+  for(i = 0; i < len; i++)
+    envname[8+i] = (name[i] == '.' ? '_' : toupper((unsigned char)name[i]));
+  envname[8+len] = '\0';
+  return getenv(envname);
+}
+
+long THTuneGet(const char *name, long def)
+{
+  const char *env = THTune_getenv(name);
+  int i;
+
+  if(env)
+  {
+    char *end;
+    long value = strtol(env, &end, 10);
+    if(end != env && *end == '\0')
+      return value;
+  }
+
+  i = THTune_find(name);
+  return (i >= 0 ? parameters[i].value : def);
+}
+
+void THTuneSet(const char *name, long value)
+{
+  int i = THTune_find(name);
+
+  if(i < 0)
+  {
+    THArgCheck(strlen(name) > 0 && strlen(name) < TH_TUNE_NAME_LEN, 1,
+               "tuning parameter name must have between 1 and %d characters", TH_TUNE_NAME_LEN-1);
+    THArgCheck(nParameters < TH_TUNE_MAX_ENTRIES, 1, "too many tuning parameters");
+    i = nParameters++;
+    strcpy(parameters[i].name, name);
+  }
+  parameters[i].value = value;
+  generation++;
+}
+
+void THTuneUnset(const char *name)
+{
+  int i = THTune_find(name);
+  if(i >= 0)
+  {
+    parameters[i] = parameters[--nParameters];
+    generation++;
+  }
+}
+
+void THTuneClear(void)
+{
+  nParameters = 0;
+  generation++;
+}
+
+int THTuneEntry(int i, const char **name, long *value)
+{
+  if(i < 0 || i >= nParameters)
+    return 0;
+  *name = parameters[i].name;
+  *value = parameters[i].value;
+  return 1;
+}
+
+int THTuneGeneration(void)
+{
+  return generation;
+}
+
+const char *THTuneDefaultPath(void)
+{
+  static char path[TH_TUNE_PATH_LEN];
+  char host[256] = "localhost";
+  const char *env = getenv("TH_TUNE_CACHE");
+  const char *home;
+
+  if(env)
+    return env;
+
+#ifdef _WIN32
+  home = getenv("USERPROFILE");
+  if(getenv("COMPUTERNAME"))
+    snprintf(host, sizeof(host), "%s", getenv("COMPUTERNAME"));
+#else
+  home = getenv("HOME");
+  if(gethostname(host, sizeof(host)) != 0)
+    strcpy(host, "localhost");
+  host[sizeof(host)-1] = '\0';
+#endif
+
+  snprintf(path, sizeof(path), "%s/.th_tune.%s", (home ? home : "."), host);
+  return path;
+}
+
+int THTuneLoad(const char *path)
+{
+  char line[TH_TUNE_NAME_LEN + 64];
+  char name[TH_TUNE_NAME_LEN];
+  long value;
+  int count = 0;
+  FILE *f = fopen(path ? path : THTuneDefaultPath(), "r");
+
+  if(!f)
+    return -1;
+
+  while(fgets(line, sizeof(line), f))
+  {
+    if(line[0] == '#')
+      continue;
+    if(sscanf(line, "%63s %ld", name, &value) == 2)
+    {
+      THTuneSet(name, value);
+      count++;
+    }
+  }
+  fclose(f);
+  return count;
+}
+
+int THTuneSave(const char *path)
+{
+  FILE *f = fopen(path ? path : THTuneDefaultPath(), "w");
+  int i;
+
+  if(!f)
+    return 0;
+
+  fprintf(f, "# TH tuning parameters, see THTune.h\n");
+  for(i = 0; i < nParameters; i++)
+    fprintf(f, "%s %ld\n", parameters[i].name, parameters[i].value);
+  return fclose(f) == 0;
+}
+
+ptrdiff_t THTuneOmpThreshold(void)
+{
+  /* called by every parallel kernel: look the table up only when it changed */
+  static ptrdiff_t threshold = 100000;
+  static int cached = -1;
+
+  if(cached != generation)
+  {
+    threshold = THTuneGet("omp.threshold", 100000);
+    cached = generation;
+  }
+  return threshold;
+}
+
+ptrdiff_t THTuneCopyTransposeMin(void)
+{
+  /* called by every copy of a transposed matrix */
+  static ptrdiff_t minimum = 60 * 60;
+  static int cached = -1;
+
+  if(cached != generation)
+  {
+    minimum = THTuneGet("copy.transpose.min", 60 * 60);
+    cached = generation;
+  }
+  return minimum;
+}
+
+ptrdiff_t THTuneSearchsortedEytzingerMin(void)
+{
+  /* called by every searchsorted */
+  static ptrdiff_t minimum = 64;
+  static int cached = -1;
+
+  if(cached != generation)
+  {
+    minimum = THTuneGet("searchsorted.eytzinger.min", 64);
+    cached = generation;
+  }
+  return minimum;
+}
+
+ptrdiff_t THTuneConv2RevgerUnfoldMin(void)
+{
+  /* called by every conv2DRevger(m) */
+  static ptrdiff_t minimum = 16;
+  static int cached = -1;
+
+  if(cached != generation)
+  {
+    minimum = THTuneGet("conv2.revger.unfold.min", 16);
+    cached = generation;
+  }
+  return minimum;
+}
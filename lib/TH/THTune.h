@@ -0,0 +1,54 @@
+#ifndef TH_TUNE_INC
+#define TH_TUNE_INC
+
+#include "THGeneral.h"
+
+/******************************************************************************
+ * Tuning parameters for TH kernels
+ *
+ * Each parameter has a name such as "omp.threshold", "copy.transpose.min" or
+ * "vector.cadd.Float", and a long value. A value is looked up in:
+ *  - the environment variable TH_TUNE_<NAME>, the name being upper-cased with
+ *    dots replaced by underscores (e.g. TH_TUNE_OMP_THRESHOLD)
+ *  - the tuning table, filled by THTuneSet() or read by THTuneLoad()
+ *  - the default given by the caller
+ *
+ * The table is meant to be written from a single thread, before or between
+ * parallel sections; lookups never modify it.
+ ******************************************************************************/
+
+TH_API long THTuneGet(const char *name, long def);
+TH_API void THTuneSet(const char *name, long value);
+TH_API void THTuneUnset(const char *name);
+TH_API void THTuneClear(void);
+
+/* iterate over the table: returns 0 when i is out of range */
+TH_API int THTuneEntry(int i, const char **name, long *value);
+
+/* changes each time the table changes, to invalidate cached lookups */
+TH_API int THTuneGeneration(void);
+
+/*
+ * Cache file, one "name value" pair per line. A NULL path stands for
+ * THTuneDefaultPath(): $TH_TUNE_CACHE if set, else $HOME/.th_tune.<hostname>.
+ * THTuneLoad() adds the entries to the table and returns their number, or -1
+ * if the file cannot be read. THTuneSave() returns 1 on success.
+ */
+TH_API const char *THTuneDefaultPath(void);
+TH_API int THTuneLoad(const char *path);
+TH_API int THTuneSave(const char *path);
+
+/* "omp.threshold": number of elements above which kernels use OpenMP */
+TH_API ptrdiff_t THTuneOmpThreshold(void);
+#define TH_OMP_OVERHEAD_THRESHOLD THTuneOmpThreshold()
+/* "copy.transpose.min": number of elements from which the copy of a
+   transposed matrix goes through blocks */
+TH_API ptrdiff_t THTuneCopyTransposeMin(void);
+/* "searchsorted.eytzinger.min": length of the sorted sequence from which
+   searchsorted searches a breadth-first copy of it */
+TH_API ptrdiff_t THTuneSearchsortedEytzingerMin(void);
+/* "conv2.revger.unfold.min": kernel size (rows x columns) from which
+   conv2DRevger(m) go through unfold + gemm */
+TH_API ptrdiff_t THTuneConv2RevgerUnfoldMin(void);
+
+#endif
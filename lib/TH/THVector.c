@@ -1,4 +1,5 @@
 #include "THVector.h"
+#include "THTune.h"
 
 #include "generic/simd/simd.h"
 
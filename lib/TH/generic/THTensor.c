@@ -444,6 +444,7 @@ void THTensor_(narrow)(THTensor *self, THTensor *src, int dimension, long firstI
     self->storageOffset += firstIndex*self->stride[dimension];
 
   self->size[dimension] = size;
+  THTensor_(refreshGeometry)(self);
 }
 
 void THTensor_(select)(THTensor *self, THTensor *src, int dimension, long sliceIndex)
@@ -465,6 +466,7 @@ void THTensor_(select)(THTensor *self, THTensor *src, int dimension, long sliceI
     self->stride[d] = self->stride[d+1];
   }
   self->nDimension--;
+  THTensor_(refreshGeometry)(self);
 }
 
 void THTensor_(transpose)(THTensor *self, THTensor *src, int dimension1, int dimension2)
@@ -488,6 +490,7 @@ void THTensor_(transpose)(THTensor *self, THTensor *src, int dimension1, int dim
   z = self->size[dimension1];
   self->size[dimension1] = self->size[dimension2];
   self->size[dimension2] = z;
+  THTensor_(refreshGeometry)(self);
 }
 
 void THTensor_(unfold)(THTensor *self, THTensor *src, int dimension, long size, long step)
@@ -531,6 +534,7 @@ void THTensor_(unfold)(THTensor *self, THTensor *src, int dimension, long size,
   self->size = newSize;
   self->stride = newStride;
   self->nDimension++;
+  THTensor_(refreshGeometry)(self);
 }
 
 /* we have to handle the case where the result is a number */
@@ -565,6 +569,7 @@ void THTensor_(squeeze)(THTensor *self, THTensor *src)
     ndim = 1;
   }
   self->nDimension = ndim;
+  THTensor_(refreshGeometry)(self);
 }
 
 void THTensor_(squeeze1d)(THTensor *self, THTensor *src, int dimension)
@@ -586,6 +591,7 @@ void THTensor_(squeeze1d)(THTensor *self, THTensor *src, int dimension)
       self->stride[d] = self->stride[d+1];
     }
     self->nDimension--;
+    THTensor_(refreshGeometry)(self);
   }
 }
 
@@ -614,6 +620,7 @@ void THTensor_(unsqueeze1d)(THTensor *self, THTensor *src, int dimension)
     self->stride[dimension] = 1;
   }
   self->size[dimension] = 1;
+  THTensor_(refreshGeometry)(self);
 }
 
 int THTensor_(isTransposed)(const THTensor *self)
@@ -640,7 +647,7 @@ int THTensor_(isTransposed)(const THTensor *self)
   return 0;
 }
 
-int THTensor_(isContiguous)(const THTensor *self)
+static int THTensor_(computeContiguous)(const THTensor *self)
 {
   long z = 1;
   int d;
@@ -657,6 +664,78 @@ int THTensor_(isContiguous)(const THTensor *self)
   return 1;
 }
 
+/* the elements cover a single block of storage without holes or overlaps,
+   in any dimension order (e.g. a channels-last view of an NCHW tensor) */
+static int THTensor_(computeDense)(const THTensor *self)
+{
+  long z = 1;
+  int n = 0;
+  int d, e;
+  for(d = 0; d < self->nDimension; d++)
+  {
+    if(self->size[d] != 1)
+      n++;
+  }
+  /* take the dimensions by increasing stride, each must start where the
+     previous one ends */
+  for(e = 0; e < n; e++)
+  {
+    for(d = 0; d < self->nDimension; d++)
+    {
+      if(self->size[d] != 1 && self->stride[d] == z)
+        break;
+    }
+    if(d == self->nDimension)
+      return 0;
+    z *= self->size[d];
+  }
+  return 1;
+}
+
+/* ops query the geometry of their operands several times per call, which for
+   small tensors costs as much as the arithmetic: it is computed once here,
+   whenever size, stride or nDimension change */
+void THTensor_(refreshGeometry)(THTensor *self)
+{
+  ptrdiff_t numel = (self->nDimension > 0);
+  int d;
+  for(d = 0; d < self->nDimension; d++)
+    numel *= self->size[d];
+  self->numel = numel;
+  self->geometry = 0;
+  if(THTensor_(computeContiguous)(self))
+    self->geometry = TH_TENSOR_CONTIGUOUS | TH_TENSOR_DENSE;
+  else if(THTensor_(computeDense)(self))
+    self->geometry = TH_TENSOR_DENSE;
+}
+
+int THTensor_(isContiguous)(const THTensor *self)
+{
+  return (self->geometry & TH_TENSOR_CONTIGUOUS) != 0;
+}
+
+int THTensor_(isDense)(const THTensor *self)
+{
+  return (self->geometry & TH_TENSOR_DENSE) != 0;
+}
+
+/* same sizes, and both tensors dense with the same strides: they can be
+   walked together as flat arrays */
+int THTensor_(isSameLayoutAs)(const THTensor *self, const THTensor* src)
+{
+  int d;
+  if (self->nDimension != src->nDimension || !THTensor_(isDense)(self))
+    return 0;
+  for(d = 0; d < self->nDimension; ++d)
+  {
+    if(self->size[d] != src->size[d])
+      return 0;
+    if(self->size[d] != 1 && self->stride[d] != src->stride[d])
+      return 0;
+  }
+  return 1;
+}
+
 int THTensor_(isSize)(const THTensor *self, const THLongStorage *dims)
 {
   int d;
@@ -705,16 +784,7 @@ int THTensor_(isSetTo)(const THTensor *self, const THTensor* src)
 
 ptrdiff_t THTensor_(nElement)(const THTensor *self)
 {
-  if(self->nDimension == 0)
-    return 0;
-  else
-  {
-    ptrdiff_t nElement = 1;
-    int d;
-    for(d = 0; d < self->nDimension; d++)
-      nElement *= self->size[d];
-    return nElement;
-  }
+  return self->numel;
 }
 
 void THTensor_(retain)(THTensor *self)
@@ -760,6 +830,8 @@ static void THTensor_(rawInit)(THTensor *self)
   self->stride = NULL;
   self->nDimension = 0;
   self->flag = TH_TENSOR_REFCOUNTED;
+  self->numel = 0;
+  self->geometry = TH_TENSOR_CONTIGUOUS | TH_TENSOR_DENSE;
 }
 
 void THTensor_(setStorageNd)(THTensor *self, THStorage *storage, ptrdiff_t storageOffset, int nDimension, long *size, long *stride)
@@ -853,6 +925,8 @@ void THTensor_(resizeNd)(THTensor *self, int nDimension, long *size, long *strid
   }
   else
     self->nDimension = 0;
+
+  THTensor_(refreshGeometry)(self);
 }
 
 void THTensor_(set1d)(THTensor *tensor, long x0, real value)
@@ -911,6 +985,115 @@ real THTensor_(get4d)(const THTensor *tensor, long x0, long x1, long x2, long x3
   return THStorage_(get)(tensor->storage, tensor->storageOffset+x0*tensor->stride[0]+x1*tensor->stride[1]+x2*tensor->stride[2]+x3*tensor->stride[3]);
 }
 
+#if defined(TH_REAL_IS_BYTE)
+#define TH_DL_REAL_CODE TH_DL_UINT
+#elif defined(TH_REAL_IS_FLOAT) || defined(TH_REAL_IS_DOUBLE) || defined(TH_REAL_IS_HALF)
+#define TH_DL_REAL_CODE TH_DL_FLOAT
+#else
+#define TH_DL_REAL_CODE TH_DL_INT
+#endif
+
+static void THTensor_(freeDLPack)(THDLManagedTensor *managed)
+{
+  THStorage_(free)(managed->manager_ctx);
+  THFree(managed);
+}
+
+THDLManagedTensor *THTensor_(toDLPack)(THTensor *self)
+{
+  /* an empty tensor is exported as a 1D tensor of size 0, since 0 dimensions
+     stand for a scalar in DLPack */
+  int ndim = (self->nDimension > 0 ? self->nDimension : 1);
+  THDLManagedTensor *managed = THAlloc(sizeof(THDLManagedTensor) + 2*ndim*sizeof(int64_t));
+  THDLTensor *dl = &managed->dl_tensor;
+  int d;
+
+  dl->data = (self->storage ? THStorage_(data)(self->storage) + self->storageOffset : NULL);
+  dl->device.device_type = TH_DL_CPU;
+  dl->device.device_id = 0;
+  dl->ndim = ndim;
+  dl->dtype.code = TH_DL_REAL_CODE;
+  dl->dtype.bits = sizeof(real)*8;
+  dl->dtype.lanes = 1;
+  dl->shape = (int64_t*)(managed+1);
+  dl->strides = dl->shape + ndim;
+  dl->byte_offset = 0;
+  if(self->nDimension == 0)
+  {
+    dl->shape[0] = 0;
+    dl->strides[0] = 1;
+  }
+  for(d = 0; d < self->nDimension; d++)
+  {
+    dl->shape[d] = self->size[d];
+    dl->strides[d] = self->stride[d];
+  }
+
+  managed->manager_ctx = self->storage;
+  if(self->storage)
+    THStorage_(retain)(self->storage);
+  managed->deleter = THTensor_(freeDLPack);
+  return managed;
+}
+
+THTensor *THTensor_(newFromDLPack)(THDLManagedTensor *src)
+{
+  THDLTensor *dl = &src->dl_tensor;
+  real *data = (real*)((char*)dl->data + dl->byte_offset);
+  int ndim = (dl->ndim > 0 ? dl->ndim : 1);
+  ptrdiff_t extent = 1;
+  long *size, *stride;
+  THStorage *storage;
+  THTensor *self;
+  int d;
+
+  /* on error, the descriptor still belongs to the caller */
+  THArgCheck(dl->device.device_type == TH_DL_CPU, 1, "CPU tensor expected");
+  THArgCheck(dl->dtype.code == TH_DL_REAL_CODE && dl->dtype.bits == sizeof(real)*8 && dl->dtype.lanes == 1, 1,
+             "tensor of type code %d and %d bits expected, got code %d and %d bits (%d lanes)",
+             TH_DL_REAL_CODE, (int)(sizeof(real)*8), dl->dtype.code, dl->dtype.bits, dl->dtype.lanes);
+  THArgCheck(dl->ndim >= 0, 1, "invalid number of dimensions");
+  THArgCheck(((uintptr_t)data) % sizeof(real) == 0, 1, "data is not aligned on its elements");
+  for(d = 0; d < dl->ndim; d++)
+  {
+    THArgCheck(dl->shape[d] >= 0 && (int64_t)(long)dl->shape[d] == dl->shape[d], 1,
+               "invalid size %lld of dimension %d", (long long)dl->shape[d], d);
+    if(dl->strides)
+      THArgCheck(dl->strides[d] >= 0 && (int64_t)(long)dl->strides[d] == dl->strides[d], 1,
+                 "invalid stride %lld of dimension %d", (long long)dl->strides[d], d);
+  }
+
+  /* a scalar is a 1D tensor of size 1; NULL strides stand for a contiguous
+     tensor */
+  size = THAlloc(sizeof(long)*ndim);
+  stride = THAlloc(sizeof(long)*ndim);
+  size[0] = 1;
+  stride[0] = 1;
+  for(d = dl->ndim-1; d >= 0; d--)
+  {
+    size[d] = dl->shape[d];
+    if(dl->strides)
+      stride[d] = dl->strides[d];
+    else
+      stride[d] = (d == dl->ndim-1 ? 1 : size[d+1]*stride[d+1]);
+    if(size[d] == 0)
+      extent = 0;
+    else if(extent > 0)
+      extent += (size[d]-1)*stride[d];
+  }
+
+  storage = THStorage_(newWithDataAndAllocator)(data, extent, &THDLPackAllocator, src);
+  storage->flag = TH_STORAGE_REFCOUNTED | TH_STORAGE_FREEMEM;
+  self = THTensor_(new)();
+  THTensor_(setStorageNd)(self, storage, 0, (extent > 0 ? ndim : 0), size, stride);
+  THStorage_(free)(storage);
+  THFree(size);
+  THFree(stride);
+  return self;
+}
+
+#undef TH_DL_REAL_CODE
+
 THDescBuff THTensor_(desc)(const THTensor *tensor) {
   const int L = TH_DESC_BUFF_LEN;
   THDescBuff buf;
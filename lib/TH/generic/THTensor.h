@@ -6,6 +6,10 @@
 
 #define TH_TENSOR_REFCOUNTED 1
 
+/* bits of THTensor.geometry */
+#define TH_TENSOR_CONTIGUOUS 1
+#define TH_TENSOR_DENSE 2
+
 typedef struct THTensor
 {
     long *size;
@@ -18,6 +22,10 @@ typedef struct THTensor
 
     char flag;
 
+    /* cached from size and stride by THTensor_(refreshGeometry) */
+    ptrdiff_t numel;
+    char geometry;
+
 } THTensor;
 
 
@@ -110,7 +118,12 @@ TH_API void THTensor_(squeeze)(THTensor *self, THTensor *src);
 TH_API void THTensor_(squeeze1d)(THTensor *self, THTensor *src, int dimension_);
 TH_API void THTensor_(unsqueeze1d)(THTensor *self, THTensor *src, int dimension_);
 
+/* to be called by code which writes size, stride or nDimension directly */
+TH_API void THTensor_(refreshGeometry)(THTensor *self);
+
 TH_API int THTensor_(isContiguous)(const THTensor *self);
+TH_API int THTensor_(isDense)(const THTensor *self);
+TH_API int THTensor_(isSameLayoutAs)(const THTensor *self, const THTensor *src);
 TH_API int THTensor_(isSameSizeAs)(const THTensor *self, const THTensor *src);
 TH_API int THTensor_(isSetTo)(const THTensor *self, const THTensor *src);
 TH_API int THTensor_(isSize)(const THTensor *self, const THLongStorage *dims);
@@ -131,6 +144,10 @@ TH_API real THTensor_(get2d)(const THTensor *tensor, long x0, long x1);
 TH_API real THTensor_(get3d)(const THTensor *tensor, long x0, long x1, long x2);
 TH_API real THTensor_(get4d)(const THTensor *tensor, long x0, long x1, long x2, long x3);
 
+/* Exchange with other libraries, see THDLPack.h */
+TH_API THDLManagedTensor *THTensor_(toDLPack)(THTensor *self);
+TH_API THTensor *THTensor_(newFromDLPack)(THDLManagedTensor *src);
+
 /* Debug methods */
 TH_API THDescBuff THTensor_(desc)(const THTensor *tensor);
 TH_API THDescBuff THTensor_(sizeDesc)(const THTensor *tensor);
@@ -2,6 +2,15 @@
 #define TH_GENERIC_FILE "generic/THTensorConv.c"
 #else
 
+/* conv2DRevger(m) switch to the unfold + gemm path above these sizes */
+#define TH_CONV2D_REVGER_UNFOLD_MIN_PLANES 4
+#define TH_CONV2D_REVGER_UNFOLD_MIN_KERNEL THTuneConv2RevgerUnfoldMin()
+/* conv3Dmv switches to the unfold + gemm path above these sizes */
+#define TH_CONV3D_UNFOLD_MIN_PLANES 4
+#define TH_CONV3D_UNFOLD_MIN_KERNEL 32
+/* maximum number of elements in an unfolded buffer */
+#define TH_CONV_UNFOLD_TILE 1048576
+
 /*
   2D Input, 2D kernel  : convolve given image with the given kernel.
 */
@@ -278,31 +287,61 @@ void THTensor_(validXCorr3Dptr)(real *r_,
 
   long zz, xx, yy;
 
-  for (zz = 0; zz < ot; zz++)
-  {
-    for(yy = 0; yy < or; yy++)
+  if ((sc != 1) || (oc < 4))  {
+    /* regular convolution */
+    for (zz = 0; zz < ot; zz++)
     {
-      for(xx = 0; xx < oc; xx++)
+      for(yy = 0; yy < or; yy++)
       {
-        /* Dot product in two dimensions... (between input image and the mask) */
-        real *pi_ = t_ + zz*st*ir*ic + yy*sr*ic + xx*sc;
+        for(xx = 0; xx < oc; xx++)
+        {
+          /* Dot product in two dimensions... (between input image and the mask) */
+          real *pi_ = t_ + zz*st*ir*ic + yy*sr*ic + xx*sc;
+          real *pw_ = k_;
+          real sum = 0;
+          long kz, kx, ky;
+          for(kz = 0; kz < kt; kz++)
+          {
+            for(ky = 0; ky < kr; ky++)
+            {
+              for(kx = 0; kx < kc; kx++) {
+                sum += pi_[kx]*pw_[kx];
+              }
+              pi_ += ic; /* next input line */
+              pw_ += kc; /* next mask line */
+            }
+            pi_ += (ir-kr)*ic; /* next input slice */
+          }
+          /* Update output */
+          *r_++ += sum*alpha;
+        }
+      }
+    }
+
+  } else {
+    /* SSE-based convolution */
+    for (zz = 0; zz < ot; zz++)
+    {
+      for(yy = 0; yy < or; yy++)
+      {
+        real *pi_ = t_ + zz*st*ir*ic + yy*sr*ic;
         real *pw_ = k_;
-        real sum = 0;
         long kz, kx, ky;
         for(kz = 0; kz < kt; kz++)
         {
           for(ky = 0; ky < kr; ky++)
           {
+            real *pis_ = pi_;
             for(kx = 0; kx < kc; kx++) {
-              sum += pi_[kx]*pw_[kx];
+              THVector_(cadd)(r_, r_, pis_, alpha*pw_[kx], oc);
+              pis_++;
             }
             pi_ += ic; /* next input line */
             pw_ += kc; /* next mask line */
           }
           pi_ += (ir-kr)*ic; /* next input slice */
         }
-        /* Update output */
-        *r_++ += sum*alpha;
+        r_ += oc;
       }
     }
   }
@@ -323,31 +362,61 @@ void THTensor_(validConv3Dptr)(real *r_,
 
   long zz, xx, yy;
 
-  for(zz = 0; zz < ot; zz++)
-  {
-    for(yy = 0; yy < or; yy++)
+  if ((sc != 1) || (oc < 4))  {
+    /* regular convolution */
+    for(zz = 0; zz < ot; zz++)
     {
-      for(xx = 0; xx < oc; xx++)
+      for(yy = 0; yy < or; yy++)
       {
-        /* Dot product in two dimensions... (between input image and the mask) */
-        real *pi_ = t_ + zz*st*ir*ic + yy*sr*ic + xx*sc;
+        for(xx = 0; xx < oc; xx++)
+        {
+          /* Dot product in two dimensions... (between input image and the mask) */
+          real *pi_ = t_ + zz*st*ir*ic + yy*sr*ic + xx*sc;
+          real *pw_ = k_ + kt*kr*kc - 1;
+          real sum = 0;
+          long kz, kx, ky;
+          for(kz = 0; kz < kt; kz++)
+          {
+            for(ky = 0; ky < kr; ky++)
+            {
+              for(kx = 0; kx < kc; kx++) {
+                sum += pi_[kx]*pw_[-kx];
+              }
+              pi_ += ic; /* next input line */
+              pw_ -= kc; /* next mask line */
+            }
+            pi_ += (ir-kr)*ic; /* next input slice */
+          }
+          /* Update output */
+          *r_++ += alpha*sum;
+        }
+      }
+    }
+
+  } else {
+    /* SSE-based convolution */
+    for(zz = 0; zz < ot; zz++)
+    {
+      for(yy = 0; yy < or; yy++)
+      {
+        real *pi_ = t_ + zz*st*ir*ic + yy*sr*ic;
         real *pw_ = k_ + kt*kr*kc - 1;
-        real sum = 0;
         long kz, kx, ky;
         for(kz = 0; kz < kt; kz++)
         {
           for(ky = 0; ky < kr; ky++)
           {
+            real *pis_ = pi_;
             for(kx = 0; kx < kc; kx++) {
-              sum += pi_[kx]*pw_[-kx];
+              THVector_(cadd)(r_, r_, pis_, alpha*pw_[-kx], oc);
+              pis_++;
             }
             pi_ += ic; /* next input line */
             pw_ -= kc; /* next mask line */
           }
           pi_ += (ir-kr)*ic; /* next input slice */
         }
-        /* Update output */
-        *r_++ += alpha*sum;
+        r_ += oc;
       }
     }
   }
@@ -368,35 +437,65 @@ void THTensor_(fullConv3Dptr)(real *r_,
 
   long zz, xx, yy;
 
-  for(zz = 0; zz < it; zz++)
-  {
-    for(yy = 0; yy < ir; yy++)
+  if ((sc != 1) || (ic < 4))  {
+    /* regular convolution */
+    for(zz = 0; zz < it; zz++)
     {
-      for(xx = 0; xx < ic; xx++)
+      for(yy = 0; yy < ir; yy++)
       {
-        /* Outer product in two dimensions... (between input image and the mask) */
-        real *po_ = r_ + zz*st*or*oc + yy*sr*oc + xx*sc;
+        for(xx = 0; xx < ic; xx++)
+        {
+          /* Outer product in two dimensions... (between input image and the mask) */
+          real *po_ = r_ + zz*st*or*oc + yy*sr*oc + xx*sc;
+          real *pw_ = k_;
+          long kz, kx, ky;
+          /* printf("Output Plane : %ld,%ld,%ld, input val=%g\n",zz,yy,xx,*t_); */
+          for(kz = 0; kz < kt; kz++)
+          {
+            for(ky = 0; ky < kr; ky++)
+            {
+              real z = *t_ * alpha;
+              for(kx = 0; kx < kc; kx++) {
+                /* printf("o=%g,k=%g," , po_[kx],pw_[kx]); */
+                po_[kx] += z * pw_[kx];
+                /* printf("o=%g " , po_[kx]); */
+              }
+              /* printf("\n"); */
+              po_ += oc; /* next input line */
+              pw_ += kc; /* next mask line */
+            }
+            po_ += (or-kr)*oc; /* next output slice */
+            /* printf("\n"); */
+          }
+          t_++;
+        }
+      }
+    }
+
+  } else {
+    /* SSE-based convolution */
+    for(zz = 0; zz < it; zz++)
+    {
+      for(yy = 0; yy < ir; yy++)
+      {
+        real *po_ = r_ + zz*st*or*oc + yy*sr*oc;
         real *pw_ = k_;
         long kz, kx, ky;
-        /* printf("Output Plane : %ld,%ld,%ld, input val=%g\n",zz,yy,xx,*t_); */
         for(kz = 0; kz < kt; kz++)
         {
           for(ky = 0; ky < kr; ky++)
           {
-            real z = *t_ * alpha;
+            real *pos_ = po_;
             for(kx = 0; kx < kc; kx++) {
-              /* printf("o=%g,k=%g," , po_[kx],pw_[kx]); */
-              po_[kx] += z * pw_[kx];
-              /* printf("o=%g " , po_[kx]); */
+              THVector_(cadd)(pos_, pos_, t_, pw_[kx]*alpha, ic);
+              pos_++;
             }
-            /* printf("\n"); */
             po_ += oc; /* next input line */
             pw_ += kc; /* next mask line */
           }
           po_ += (or-kr)*oc; /* next output slice */
-          /* printf("\n"); */
         }
-        t_++;
+        t_ += ic;
       }
     }
   }
@@ -416,30 +515,60 @@ void THTensor_(fullXCorr3Dptr)(real *r_,
 
   long zz, xx, yy;
 
-  for(zz = 0; zz < it; zz++)
-  {
-    for(yy = 0; yy < ir; yy++)
+  if ((sc != 1) || (ic < 4))  {
+    /* regular convolution */
+    for(zz = 0; zz < it; zz++)
     {
-      for(xx = 0; xx < ic; xx++)
+      for(yy = 0; yy < ir; yy++)
       {
-        /* Outer product in two dimensions... (between input image and the mask) */
-        real *po_ = r_ + zz*st*or*oc + yy*sr*oc + xx*sc;
+        for(xx = 0; xx < ic; xx++)
+        {
+          /* Outer product in two dimensions... (between input image and the mask) */
+          real *po_ = r_ + zz*st*or*oc + yy*sr*oc + xx*sc;
+          real *pw_ = k_ + kt*kr*kc -1;
+          long kz, kx, ky;
+          for(kz = 0; kz < kt; kz++)
+          {
+            for(ky = 0; ky < kr; ky++)
+            {
+              real z = *t_ * alpha;
+              for(kx = 0; kx < kc; kx++) {
+                po_[kx] += z * pw_[-kx];
+              }
+              po_ += oc; /* next input line */
+              pw_ -= kc; /* next mask line */
+            }
+            po_ += (or-kr)*oc; /* next output slice */
+          }
+          t_++;
+        }
+      }
+    }
+
+  } else {
+    /* SSE-based convolution */
+    for(zz = 0; zz < it; zz++)
+    {
+      for(yy = 0; yy < ir; yy++)
+      {
+        real *po_ = r_ + zz*st*or*oc + yy*sr*oc;
         real *pw_ = k_ + kt*kr*kc -1;
         long kz, kx, ky;
         for(kz = 0; kz < kt; kz++)
         {
           for(ky = 0; ky < kr; ky++)
           {
-            real z = *t_ * alpha;
+            real *pos_ = po_;
             for(kx = 0; kx < kc; kx++) {
-              po_[kx] += z * pw_[-kx];
+              THVector_(cadd)(pos_, pos_, t_, pw_[-kx]*alpha, ic);
+              pos_++;
             }
             po_ += oc; /* next input line */
             pw_ -= kc; /* next mask line */
           }
           po_ += (or-kr)*oc; /* next output slice */
         }
-        t_++;
+        t_ += ic;
       }
     }
   }
@@ -461,26 +590,56 @@ void THTensor_(validXCorr3DRevptr)(real *r_,
   long oc = ic - (kc - 1) * sc;
 
   long zz, xx, yy;
-  for(zz = 0; zz < kt; zz++)
-  {
-    for(yy = 0; yy < kr; yy++)
+
+  if ((sc != 1) || (oc < 4))  {
+    /* regular convolution */
+    for(zz = 0; zz < kt; zz++)
     {
-      for(xx = 0; xx < kc; xx++)
+      for(yy = 0; yy < kr; yy++)
       {
-        real *po_ = r_;
-        real *pi_ = t_ + zz*st*ir*ic + yy*sr*ic + xx*sc;
-        real z = *k_++ * alpha;
-        long kz, kx, ky;
-        for(kz = 0; kz < ot; kz++)
+        for(xx = 0; xx < kc; xx++)
         {
-          for(ky = 0; ky < or; ky++)
+          real *po_ = r_;
+          real *pi_ = t_ + zz*st*ir*ic + yy*sr*ic + xx*sc;
+          real z = *k_++ * alpha;
+          long kz, kx, ky;
+          for(kz = 0; kz < ot; kz++)
           {
-            for(kx = 0; kx < oc; kx++)
-              po_[kx] += z * pi_[kx];
-            pi_ += ic;
-            po_ += oc;
+            for(ky = 0; ky < or; ky++)
+            {
+              for(kx = 0; kx < oc; kx++)
+                po_[kx] += z * pi_[kx];
+              pi_ += ic;
+              po_ += oc;
+            }
+            pi_ += (ir-or)*ic; /* next input slice */
+          }
+        }
+      }
+    }
+
+  } else {
+    /* SSE-based convolution */
+    for(zz = 0; zz < kt; zz++)
+    {
+      for(yy = 0; yy < kr; yy++)
+      {
+        for(xx = 0; xx < kc; xx++)
+        {
+          real *po_ = r_;
+          real *pi_ = t_ + zz*st*ir*ic + yy*sr*ic + xx*sc;
+          real z = *k_++ * alpha;
+          long kz, ky;
+          for(kz = 0; kz < ot; kz++)
+          {
+            for(ky = 0; ky < or; ky++)
+            {
+              THVector_(cadd)(po_, po_, pi_, z, oc);
+              pi_ += ic;
+              po_ += oc;
+            }
+            pi_ += (ir-or)*ic; /* next input slice */
           }
-          pi_ += (ir-or)*ic; /* next input slice */
         }
       }
     }
@@ -571,6 +730,65 @@ long THTensor_(convsize)(long x, long k, long s, const char* vf)
 }
 
 
+/*
+  weight gradient (conv2DRevger and conv2DRevgerm) as a gemm:
+  for each batch element p, output[k][i] += alpha * xcorrRev(input[p][i], kernel[p][k])
+  is the product of the kernel planes (nKernelPlane x kr*kc) with the
+  unfolded input (kr*kc x nInputPlane*or*oc). The kernel rows are unfolded
+  a tile at a time, each tile accumulating into the output, which bounds
+  the unfolded buffer to TH_CONV_UNFOLD_TILE elements.
+*/
+static void THTensor_(unfoldedConv2DRevger)(real *output_data, real alpha,
+                                            real *input_data, long nbatch, long istride0,
+                                            long nInputPlane, long ir, long ic,
+                                            real *weight_data, long kstride0, long kstride1,
+                                            long nKernelPlane, long kr, long kc,
+                                            long sr, long sc)
+{
+  long or = ir - (kr - 1) * sr;
+  long oc = ic - (kc - 1) * sc;
+  long n = nInputPlane*or*oc;
+  long tileRows = THMin(kr, THMax(1, TH_CONV_UNFOLD_TILE / (kc*n)));
+  real *columns = (real*)THAlloc(sizeof(real)*tileRows*kc*n);
+  long p, a0;
+
+  for(p = 0; p < nbatch; p++)
+  {
+    for(a0 = 0; a0 < kr; a0 += tileRows)
+    {
+      long nrows = THMin(tileRows, kr - a0);
+      long j;
+
+#pragma omp parallel for private(j)
+      for(j = 0; j < nrows*kc; j++)
+      {
+        long a = a0 + j / kc;
+        long b = j % kc;
+        real *col = columns + j*n;
+        long i, yy;
+        for(i = 0; i < nInputPlane; i++)
+        {
+          real *pi_ = input_data + p*istride0 + i*ir*ic + a*sr*ic + b*sc;
+          for(yy = 0; yy < or; yy++)
+          {
+            THVector_(copy)(col, pi_, oc);
+            col += oc;
+            pi_ += ic;
+          }
+        }
+      }
+
+      /* output += alpha * kernel[p][:][a0:a0+nrows][:] x columns */
+#pragma omp critical(blasgemm)
+      THBlas_(gemm)('n', 'n', n, nKernelPlane, nrows*kc,
+                    alpha, columns, n,
+                    weight_data + p*kstride0 + a0*kc, kstride1,
+                    1, output_data, n);
+    }
+  }
+  THFree(columns);
+}
+
 /*
   3D input, 3D kernel, 4D output
   like rank1 update
@@ -649,6 +867,18 @@ void THTensor_(conv2DRevger)(THTensor *r_, real beta, real alpha, THTensor *t_,
     }
   }
 
+  if (nKernelPlane >= TH_CONV2D_REVGER_UNFOLD_MIN_PLANES
+      && nKernelRows*nKernelCols >= TH_CONV2D_REVGER_UNFOLD_MIN_KERNEL)
+  {
+    THTensor_(unfoldedConv2DRevger)(output_data, alpha,
+                                    input_data, 1, 0, nInputPlane, nInputRows, nInputCols,
+                                    weight_data, 0, kstride0, nKernelPlane, nKernelRows, nKernelCols,
+                                    srow, scol);
+    THTensor_(free)(input);
+    THTensor_(free)(kernel);
+    return;
+  }
+
 #pragma omp parallel for private(k)
   for(k = 0; k < nKernelPlane; k++)
   {
@@ -759,6 +989,18 @@ void THTensor_(conv2DRevgerm)(THTensor *r_, real beta, real alpha, THTensor *t_,
     }
   }
 
+  if (nKernelPlane >= TH_CONV2D_REVGER_UNFOLD_MIN_PLANES
+      && nKernelRows*nKernelCols >= TH_CONV2D_REVGER_UNFOLD_MIN_KERNEL)
+  {
+    THTensor_(unfoldedConv2DRevger)(output_data, alpha,
+                                    input_data, nbatch, istride0, nInputPlane, nInputRows, nInputCols,
+                                    weight_data, kstride0, kstride1, nKernelPlane, nKernelRows, nKernelCols,
+                                    srow, scol);
+    THTensor_(free)(input);
+    THTensor_(free)(kernel);
+    return;
+  }
+
 #pragma omp parallel for private(k)
   for(k = 0; k < nKernelPlane; k++)
   {
@@ -1211,6 +1453,191 @@ void THTensor_(conv2Dmm)(THTensor *r_, real beta, real alpha, THTensor *t_, THTe
 }
 
 
+/*
+  Channels-last (NHWC) convolution.
+  The kernel keeps the usual nOutputPlane x nInputPlane x kH x kW layout
+  and is repacked into kH x kW x nInputPlane x nOutputPlane, flipped when
+  needed. Each output row is then a single gemm of the unfolded receptive
+  fields with the kernel, vectorized across the channels, and rows are
+  computed independently. In full mode the taps that fall outside the
+  input are unfolded as zeros.
+*/
+static THTensor* THTensor_(newNHWCKernel)(THTensor *k_, const char *vf, const char *xc)
+{
+  long nOutputPlane = k_->size[0];
+  long nInputPlane = k_->size[1];
+  long nKernelRows = k_->size[2];
+  long nKernelCols = k_->size[3];
+  int flip = (*vf == 'V') ? (*xc == 'C') : (*xc == 'X');
+  THTensor *kernel = THTensor_(newWithSize4d)(nKernelRows, nKernelCols, nInputPlane, nOutputPlane);
+  real *src = THTensor_(data)(k_);
+  real *dst = THTensor_(data)(kernel);
+  long kx, ky, i, k;
+
+  for(ky = 0; ky < nKernelRows; ky++)
+  {
+    long sy = flip ? nKernelRows - 1 - ky : ky;
+    for(kx = 0; kx < nKernelCols; kx++)
+    {
+      long sx = flip ? nKernelCols - 1 - kx : kx;
+      for(i = 0; i < nInputPlane; i++)
+        for(k = 0; k < nOutputPlane; k++)
+          *dst++ = src[k*k_->stride[0] + i*k_->stride[1] + sy*k_->stride[2] + sx*k_->stride[3]];
+    }
+  }
+  return kernel;
+}
+
+/*
+  channels-last input, kernel laid out by THTensor_(newNHWCKernel)
+  output rows (nbatch*or of them, contiguous in NHWC even across the batch)
+  are unfolded a tile at a time, one receptive field per column, in
+  parallel; each tile then goes through a single gemm. The unfolded buffer
+  is bounded by TH_CONV_UNFOLD_TILE elements.
+*/
+static void THTensor_(conv2DNHWCptr)(real *output_data, real alpha,
+                                     real *input_data, long nbatch, long ir, long ic, long nInputPlane,
+                                     real *weight_data, long kr, long kc, long nOutputPlane,
+                                     long or, long oc, long sr, long sc, int full)
+{
+  long patch = kr*kc*nInputPlane;
+  long nrowsTotal = nbatch*or;
+  long tileRows = THMin(nrowsTotal, THMax(1, TH_CONV_UNFOLD_TILE / (oc*patch)));
+  real *columns = (real*)THAlloc(sizeof(real)*tileRows*oc*patch);
+  long r0;
+
+  for(r0 = 0; r0 < nrowsTotal; r0 += tileRows)
+  {
+    long nrows = THMin(tileRows, nrowsTotal - r0);
+    long j;
+
+    /* unfold the receptive field of each output position of the tile */
+#pragma omp parallel for private(j)
+    for(j = 0; j < nrows*oc; j++)
+    {
+      long r = r0 + j / oc;
+      long yy = r % or;
+      long xx = j % oc;
+      real *ptr_input = input_data + (r / or)*ir*ic*nInputPlane;
+      real *col = columns + j*patch;
+      long ky, kx;
+
+      for(ky = 0; ky < kr; ky++)
+      {
+        long iy = yy*sr + ky;
+        int rowvalid = 1;
+        if (full) {
+          iy = yy - ky;
+          rowvalid = (iy >= 0 && iy % sr == 0 && iy / sr < ir);
+          iy /= sr;
+        }
+        for(kx = 0; kx < kc; kx++)
+        {
+          long ix = xx*sc + kx;
+          int valid = rowvalid;
+          if (full) {
+            ix = xx - kx;
+            valid = valid && (ix >= 0 && ix % sc == 0 && ix / sc < ic);
+            ix /= sc;
+          }
+          if (valid)
+            memcpy(col, ptr_input + (iy*ic + ix)*nInputPlane, sizeof(real)*nInputPlane);
+          else
+            memset(col, 0, sizeof(real)*nInputPlane);
+          col += nInputPlane;
+        }
+      }
+    }
+
+    /* output rows r0:r0+nrows (nrows*oc x nOutputPlane) += alpha * columns x kernel */
+    THBlas_(gemm)('n', 'n', nOutputPlane, nrows*oc, patch,
+                  alpha, weight_data, nOutputPlane,
+                  columns, patch,
+                  1, output_data + r0*oc*nOutputPlane, nOutputPlane);
+  }
+  THFree(columns);
+}
+
+static void THTensor_(conv2DNHWC)(THTensor *r_, real beta, real alpha, THTensor *t_, THTensor *k_, long srow, long scol, const char *vf, const char *xc)
+{
+  long nbatch, nInputPlane, nInputRows, nInputCols;
+  long nKernelRows, nKernelCols;
+  long nOutputPlane, nOutputRows, nOutputCols;
+  THTensor *input;
+  THTensor *kernel;
+  ptrdiff_t nelem;
+
+  THArgCheck(k_->nDimension == 4 , 4, "kernel: 4D Tensor expected");
+  THArgCheck(srow >= 1, 5, "Stride should be a positive integer");
+  THArgCheck(scol >= 1, 6, "Stride should be a positive integer");
+  THArgCheck(*vf == 'V' || *vf == 'F', 7, "type of convolution can 'V' or 'F'");
+  THArgCheck(*xc == 'C' || *xc == 'X', 7, "type of convolution can 'X' or 'C'");
+
+  input = THTensor_(newContiguous)(t_);
+  nbatch      = (input->nDimension == 4 ? input->size[0] : 1);
+  nInputRows  = input->size[input->nDimension-3];
+  nInputCols  = input->size[input->nDimension-2];
+  nInputPlane = input->size[input->nDimension-1];
+
+  nKernelRows = k_->size[2];
+  nKernelCols = k_->size[3];
+  nOutputPlane = k_->size[0];
+  THArgCheck(k_->size[1] == nInputPlane, 2, "invalid number of input planes");
+
+  THArgCheck( (nInputRows >= nKernelRows && nInputCols >= nKernelCols) || *vf == 'F', 2, "conv2DNHWC : Input image is smaller than kernel");
+
+  if (*vf == 'F') {
+    nOutputRows = (nInputRows - 1) * srow + nKernelRows;
+    nOutputCols = (nInputCols - 1) * scol + nKernelCols;
+  } else { /* valid */
+    nOutputRows = (nInputRows - nKernelRows) / srow + 1;
+    nOutputCols = (nInputCols - nKernelCols) / scol + 1;
+  }
+
+  nelem = THTensor_(nElement)(r_);
+  if (input->nDimension == 4)
+    THTensor_(resize4d)(r_, nbatch, nOutputRows, nOutputCols, nOutputPlane);
+  else
+    THTensor_(resize3d)(r_, nOutputRows, nOutputCols, nOutputPlane);
+
+  if (nelem == 0 || beta == 0 || nelem != THTensor_(nElement)(r_))
+    THTensor_(zero)(r_);
+  else if (beta != 1)
+    THTensor_(mul)(r_, r_, beta);
+
+  kernel = THTensor_(newNHWCKernel)(k_, vf, xc);
+  THTensor_(conv2DNHWCptr)(THTensor_(data)(r_), alpha,
+                           THTensor_(data)(input), nbatch, nInputRows, nInputCols, nInputPlane,
+                           THTensor_(data)(kernel), nKernelRows, nKernelCols, nOutputPlane,
+                           nOutputRows, nOutputCols, srow, scol, *vf == 'F');
+
+  THTensor_(free)(input);
+  THTensor_(free)(kernel);
+}
+
+/*
+  3D channels-last input (H x W x C), 4D kernel, 3D output (oH x oW x nOutputPlane)
+  matrix vector product like
+  y <- Ax + beta*y
+*/
+void THTensor_(conv2DmvNHWC)(THTensor *r_, real beta, real alpha, THTensor *t_, THTensor *k_, long srow, long scol, const char *vf, const char *xc)
+{
+  THArgCheck(t_->nDimension == 3 , 3, "input: 3D Tensor expected");
+  THTensor_(conv2DNHWC)(r_, beta, alpha, t_, k_, srow, scol, vf, xc);
+}
+
+/*
+  4D channels-last input (N x H x W x C), 4D kernel, 4D output (N x oH x oW x nOutputPlane)
+  matrix matrix product like
+  y <- Ax + beta*y
+*/
+void THTensor_(conv2DmmNHWC)(THTensor *r_, real beta, real alpha, THTensor *t_, THTensor *k_, long srow, long scol, const char *vf, const char *xc)
+{
+  THArgCheck(t_->nDimension == 4 , 3, "input: 4D Tensor expected");
+  THTensor_(conv2DNHWC)(r_, beta, alpha, t_, k_, srow, scol, vf, xc);
+}
+
+
 /*
   2D input, 2D kernel, 2D output
   scalar multiplication like
@@ -1453,7 +1880,7 @@ void THTensor_(conv3DRevger)(THTensor *r_, real beta, real alpha, THTensor *t_,
   real *weight_data;
   real *output_data;
   ptrdiff_t nelem;
-  long k, i;
+  long k;
 
   THArgCheck(t_->nDimension == 4 , 3, "input: 4D Tensor expected");
   THArgCheck(k_->nDimension == 4 , 4, "kernel: 4D Tensor expected");
@@ -1497,25 +1924,22 @@ void THTensor_(conv3DRevger)(THTensor *r_, real beta, real alpha, THTensor *t_,
   weight_data = THTensor_(data)(kernel);
   output_data = THTensor_(data)(r_);
 
-  for(k = 0; k < nKernelPlane; k++)
+#pragma omp parallel for private(k)
+  for(k = 0; k < nKernelPlane*nInputPlane; k++)
   {
     /* get kernel */
-    real *ptr_weight = weight_data+k*kstride0;
-
-    for(i = 0; i < nInputPlane; i++)
-    {
-      /* get input */
-      real *ptr_input = input_data+i*istride0;
+    real *ptr_weight = weight_data + (k/nInputPlane)*kstride0;
+    /* get input */
+    real *ptr_input = input_data + (k%nInputPlane)*istride0;
+    /* get output */
+    real *ptr_output = output_data + k*nOutputDepth*nOutputCols*nOutputRows;
 
-      /* do image, kernel convolution */
-      THTensor_(validXCorr3DRevptr)(output_data,
-                                    alpha,
-                                    ptr_input,  nInputDepth, nInputRows,  nInputCols,
-                                    ptr_weight, nKernelDepth, nKernelRows, nKernelCols,
-                                    sdepth, srow, scol);
-      /* Next output plane */
-      output_data += nOutputDepth*nOutputCols*nOutputRows;
-    }
+    /* do image, kernel convolution */
+    THTensor_(validXCorr3DRevptr)(ptr_output,
+                                  alpha,
+                                  ptr_input,  nInputDepth, nInputRows,  nInputCols,
+                                  ptr_weight, nKernelDepth, nKernelRows, nKernelCols,
+                                  sdepth, srow, scol);
   }
   THTensor_(free)(input);
   THTensor_(free)(kernel);
@@ -1540,7 +1964,7 @@ void THTensor_(conv3Dger)(THTensor *r_, real beta, real alpha, THTensor *t_, THT
   real *weight_data;
   real *output_data;
   ptrdiff_t nelem;
-  long k, i;
+  long k;
 
   THArgCheck(t_->nDimension == 4 , 3, "input: 4D Tensor expected");
   THArgCheck(k_->nDimension == 4 , 4, "kernel: 4D Tensor expected");
@@ -1589,29 +2013,94 @@ void THTensor_(conv3Dger)(THTensor *r_, real beta, real alpha, THTensor *t_, THT
   weight_data = THTensor_(data)(kernel);
   output_data = THTensor_(data)(r_);
 
-  for(k = 0; k < nKernelPlane; k++)
+#pragma omp parallel for private(k)
+  for(k = 0; k < nKernelPlane*nInputPlane; k++)
   {
     /* get kernel */
-    real *ptr_weight = weight_data+k*kstride0;
+    real *ptr_weight = weight_data + (k/nInputPlane)*kstride0;
+    /* get input */
+    real *ptr_input = input_data + (k%nInputPlane)*istride0;
+    /* get output */
+    real *ptr_output = output_data + k*nOutputDepth*nOutputCols*nOutputRows;
 
-    for(i = 0; i < nInputPlane; i++)
+    /* do image, kernel convolution */
+    THTensor_(conv3d)(ptr_output,
+                      alpha,
+                      ptr_input,  nInputDepth, nInputRows,  nInputCols,
+                      ptr_weight, nKernelDepth, nKernelRows, nKernelCols,
+                      sdepth, srow, scol, vf, xc);
+  }
+  THTensor_(free)(input);
+  THTensor_(free)(kernel);
+}
+
+/*
+  4D input, 5D kernel, 4D output, valid convolution only
+  unfolds the input (im2col) one tile of output rows at a time, and computes
+  all the output planes of the tile with a single gemm. The unfolded buffer
+  is bounded by TH_CONV_UNFOLD_TILE elements.
+*/
+static void THTensor_(unfoldedConv3Dmv)(real *output_data, real alpha,
+                                        real *input_data, long nInputPlane, long it, long ir, long ic,
+                                        real *weight_data, long nOutputPlane, long kt, long kr, long kc,
+                                        long st, long sr, long sc, int flip)
+{
+  long ot = (it - kt) / st + 1;
+  long or = (ir - kr) / sr + 1;
+  long oc = (ic - kc) / sc + 1;
+  long nk = nInputPlane*kt*kr*kc;
+  long tileRows = THMin(or, THMax(1, TH_CONV_UNFOLD_TILE / (nk*oc)));
+  real *columns = (real*)THAlloc(sizeof(real)*nk*tileRows*oc);
+  long zz, y0;
+
+  for(zz = 0; zz < ot; zz++)
+  {
+    for(y0 = 0; y0 < or; y0 += tileRows)
     {
-      /* get input */
-      real *ptr_input = input_data+i*istride0;
+      long nrows = THMin(tileRows, or - y0);
+      long n = nrows*oc;
+      long j;
 
-      /* do image, kernel convolution */
-      THTensor_(conv3d)(output_data,
-                        alpha,
-                        ptr_input,  nInputDepth, nInputRows,  nInputCols,
-                        ptr_weight, nKernelDepth, nKernelRows, nKernelCols,
-                        sdepth, srow, scol, vf, xc);
+#pragma omp parallel for private(j)
+      for(j = 0; j < nk; j++)
+      {
+        long i  = j / (kt*kr*kc);
+        long kz = (j / (kr*kc)) % kt;
+        long ky = (j / kc) % kr;
+        long kx = j % kc;
+        real *col = columns + j*n;
+        real *pi_;
+        long yy, xx;
+
+        /* convolution: kernel element j meets the mirrored input offset */
+        if (flip)
+        {
+          kz = kt-1-kz;
+          ky = kr-1-ky;
+          kx = kc-1-kx;
+        }
+        pi_ = input_data + i*it*ir*ic + (zz*st+kz)*ir*ic + (y0*sr+ky)*ic + kx;
+        for(yy = 0; yy < nrows; yy++)
+        {
+          if (sc == 1)
+            THVector_(copy)(col, pi_, oc);
+          else
+            for(xx = 0; xx < oc; xx++)
+              col[xx] = pi_[xx*sc];
+          col += oc;
+          pi_ += sr*ic;
+        }
+      }
 
-      /* Next output plane */
-      output_data += nOutputDepth*nOutputCols*nOutputRows;
+      /* output[:][zz][y0:y0+nrows][:] += alpha * weight x columns */
+#pragma omp critical(blasgemm)
+      THBlas_(gemm)('n', 'n', n, nOutputPlane, nk,
+                    alpha, columns, n,
+                    weight_data, nk,
+                    1, output_data + zz*or*oc + y0*oc, ot*or*oc);
     }
   }
-  THTensor_(free)(input);
-  THTensor_(free)(kernel);
+  THFree(columns);
 }
 
 /*
@@ -1632,7 +2121,7 @@ void THTensor_(conv3Dmv)(THTensor *r_, real beta, real alpha, THTensor *t_, THTe
   real *weight_data;
   real *output_data;
   ptrdiff_t nelem;
-  long k, i;
+  long k;
 
   THArgCheck(t_->nDimension == 4 , 3, "input: 4D Tensor expected");
   THArgCheck(k_->nDimension == 5 , 4, "kernel: 5D Tensor expected");
@@ -1684,8 +2173,25 @@ void THTensor_(conv3Dmv)(THTensor *r_, real beta, real alpha, THTensor *t_, THTe
   weight_data = THTensor_(data)(kernel);
   output_data = THTensor_(data)(r_);
 
+  if (*vf == 'V' && THTensor_(isContiguous)(kernel)
+      && nOutputPlane >= TH_CONV3D_UNFOLD_MIN_PLANES
+      && nInputPlane*nKernelDepth*nKernelRows*nKernelCols >= TH_CONV3D_UNFOLD_MIN_KERNEL)
+  {
+    THTensor_(unfoldedConv3Dmv)(output_data, alpha,
+                                input_data, nInputPlane, nInputDepth, nInputRows, nInputCols,
+                                weight_data, nOutputPlane, nKernelDepth, nKernelRows, nKernelCols,
+                                sdepth, srow, scol, *xc == 'C');
+    THTensor_(free)(input);
+    THTensor_(free)(kernel);
+    return;
+  }
+
+#pragma omp parallel for private(k)
   for(k = 0; k < nOutputPlane; k++)
   {
+    long i;
+    /* get output */
+    real *ptr_output = output_data + k*nOutputDepth*nOutputCols*nOutputRows;
     for(i = 0; i < nInputPlane; i++)
     {
       /* get kernel */
@@ -1694,14 +2200,12 @@ void THTensor_(conv3Dmv)(THTensor *r_, real beta, real alpha, THTensor *t_, THTe
       real *ptr_input = input_data + i*istride0;
 
       /* do image, kernel convolution */
-      THTensor_(conv3d)(output_data,
+      THTensor_(conv3d)(ptr_output,
                         alpha,
                         ptr_input,  nInputDepth, nInputRows,  nInputCols,
                         ptr_weight, nKernelDepth, nKernelRows, nKernelCols,
                         sdepth, srow, scol, vf, xc);
     }
-    /* Next output plane */
-    output_data += nOutputDepth*nOutputCols*nOutputRows;
   }
   THTensor_(free)(input);
   THTensor_(free)(kernel);
@@ -1839,22 +2343,22 @@ void THTensor_(conv3Dcmul)(THTensor *r_, real beta, real alpha, THTensor *t_, TH
   weight_data = THTensor_(data)(kernel);
   output_data = THTensor_(data)(r_);
 
+#pragma omp parallel for private(k)
   for(k = 0; k < nOutputPlane; k++)
   {
     /* get kernel */
     real *ptr_weight = weight_data + k*kstride0;
     /* get input */
     real *ptr_input = input_data + k*istride0;
+    /* get output */
+    real *ptr_output = output_data + k*nOutputDepth*nOutputCols*nOutputRows;
 
     /* do image, kernel convolution */
-    THTensor_(conv3d)(output_data,
+    THTensor_(conv3d)(ptr_output,
                       alpha,
                       ptr_input,  nInputDepth, nInputRows,  nInputCols,
                       ptr_weight, nKernelDepth, nKernelRows, nKernelCols,
                       sdepth, srow, scol, vf, xc);
-
-    /* Next output plane */
-    output_data += nOutputDepth*nOutputCols*nOutputRows;
   }
   THTensor_(free)(input);
   THTensor_(free)(kernel);
@@ -1889,6 +2393,21 @@ void THTensor_(conv3Dmap)(THTensor *r_, real beta, real alpha, THTensor *t_, THT
   THArgCheck(scol >= 1, 7, "Stride should be a positive integer");
   THArgCheck(*vf == 'V' || *vf == 'F', 8, "type of convolution can 'V' or 'F'");
   THArgCheck(*xc == 'C' || *xc == 'X', 8, "type of convolution can 'X' or 'C'");
+  THArgCheck(k_->size[0] == t_->size[0], 2, "invalid number of input/kernel planes");
+  THArgCheck((t_->size[1] >= k_->size[1]
+              && t_->size[2] >= k_->size[2]
+              && t_->size[3] >= k_->size[3]) || *vf == 'F',
+             2, "conv3Dmap : Input image is smaller than kernel");
+
+  /* the map is checked before anything is copied or r_ is touched */
+  THArgCheck(map->size[1] == 2, 4, "map: 2 columns expected");
+  nmaps = map->size[0];
+  for(k = 0; k < nmaps; k++)
+  {
+    long from = (long)THTensor_(get2d)(map,k,0)-1;
+    long to   = (long)THTensor_(get2d)(map,k,1)-1;
+    THArgCheck(from >= 0 && from < t_->size[0] && to >= 0 && to < k_->size[0], 4, "map: index out of range");
+  }
 
   input = THTensor_(newContiguous)(t_);
   kernel = THTensor_(newContiguous)(k_);
@@ -1905,12 +2424,6 @@ void THTensor_(conv3Dmap)(THTensor *r_, real beta, real alpha, THTensor *t_, THT
   nKernelRows = kernel->size[2];
   nKernelCols = kernel->size[3];
 
-  THArgCheck(nOutputPlane == nInputPlane, 2, "invalid number of input/kernel planes");
-  THArgCheck((nInputDepth >= nKernelDepth
-              && nInputRows >= nKernelRows
-              && nInputCols >= nKernelCols) || *vf == 'F',
-             2, "conv3Dmap : Input image is smaller than kernel");
-
   nOutputDepth = THTensor_(convsize)(nInputDepth, nKernelDepth, sdepth, vf);
   nOutputRows = THTensor_(convsize)(nInputRows, nKernelRows, srow, vf);
   nOutputCols = THTensor_(convsize)(nInputCols, nKernelCols, scol, vf);
@@ -1929,27 +2442,38 @@ void THTensor_(conv3Dmap)(THTensor *r_, real beta, real alpha, THTensor *t_, THT
   weight_data = THTensor_(data)(kernel);
   output_data = THTensor_(data)(r_);
 
-  nmaps = map->size[0];
-
-  for(k = 0; k < nmaps; k++)
+  /* several maps can share an output plane: each thread owns whole output */
+  /* planes and applies their maps in map order */
+#pragma omp parallel for private(k)
+  for(k = 0; k < nOutputPlane; k++)
   {
-    /* get indices */
-    long from = (long)THTensor_(get2d)(map,k,0)-1;
-    long to   = (long)THTensor_(get2d)(map,k,1)-1;
-
-    /* get kernel */
-    real *ptr_weight = weight_data + k*kstride0;
-    /* get input */
-    real *ptr_input = input_data + from*istride0;
     /* get output */
-    real *ptr_output = output_data + to*nOutputDepth*nOutputRows*nOutputCols;
+    real *ptr_output = output_data + k*nOutputDepth*nOutputRows*nOutputCols;
+    long l;
 
-    /* do image, kernel convolution */
-    THTensor_(conv3d)(ptr_output,
-                      alpha,
-                      ptr_input,  nInputDepth, nInputRows,  nInputCols,
-                      ptr_weight, nKernelDepth, nKernelRows, nKernelCols,
-                      sdepth, srow, scol, vf, xc);
+    for(l = 0; l < nmaps; l++)
+    {
+      /* get indices */
+      long from = (long)THTensor_(get2d)(map,l,0)-1;
+      long to   = (long)THTensor_(get2d)(map,l,1)-1;
+      real *ptr_weight;
+      real *ptr_input;
+
+      if (to != k)
+        continue;
+
+      /* get kernel */
+      ptr_weight = weight_data + l*kstride0;
+      /* get input */
+      ptr_input = input_data + from*istride0;
+
+      /* do image, kernel convolution */
+      THTensor_(conv3d)(ptr_output,
+                        alpha,
+                        ptr_input,  nInputDepth, nInputRows,  nInputCols,
+                        ptr_weight, nKernelDepth, nKernelRows, nKernelCols,
+                        sdepth, srow, scol, vf, xc);
+    }
   }
   THTensor_(free)(input);
   THTensor_(free)(kernel);
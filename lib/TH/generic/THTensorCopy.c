@@ -3,12 +3,11 @@
 #else
 
 int THTensor_(copyTransposeValid)(THTensor *tensor, THTensor *src) {
-  const int MIN_SZ = 60 * 60;
   return THTensor_(isContiguous)(tensor) &&
          THTensor_(nDimension)(src) == 2 &&
          THTensor_(stride)(src, 0) == 1 &&
          THTensor_(stride)(src, 1) == THTensor_(size)(src, 0) &&
-         THTensor_(nElement)(tensor) >= MIN_SZ;
+         THTensor_(nElement)(tensor) >= THTuneCopyTransposeMin();
 }
 
 // special case copy where tensor is contiguous and src is a transposed matrix
@@ -18,10 +17,11 @@ void THTensor_(copyTranspose)(THTensor *tensor, THTensor *src) {
   #define MAX(x, y) (((x) > (y)) ? (x) : (y))
 
 #ifdef TH_REAL_IS_BYTE
-  const int BLOCK_SZ = 120;
+  const long DEFAULT_BLOCK_SZ = 120;
 #else
-  const int BLOCK_SZ = 60;
+  const long DEFAULT_BLOCK_SZ = 60;
 #endif
+  const int BLOCK_SZ = THMax(1, THTuneGet("copy.transpose.block." TH_CONCAT_STRING_2(Real,), DEFAULT_BLOCK_SZ));
 
   THTensor *buf = THTensor_(newWithSize2d)(BLOCK_SZ, BLOCK_SZ);
   real *sp = THTensor_(data)(src);
@@ -69,7 +69,8 @@ void THTensor_(copyTranspose)(THTensor *tensor, THTensor *src) {
 void THTensor_(copy)(THTensor *tensor, THTensor *src)
 {
   if (tensor == src) return;
-  if (THTensor_(isContiguous)(tensor) && THTensor_(isContiguous)(src) && THTensor_(nElement)(tensor) == THTensor_(nElement)(src)) {
+  if ((THTensor_(isContiguous)(tensor) && THTensor_(isContiguous)(src) && THTensor_(nElement)(tensor) == THTensor_(nElement)(src)) ||
+      THTensor_(isSameLayoutAs)(tensor, src)) {
     real *sp = THTensor_(data)(src);
     real *rp = THTensor_(data)(tensor);
     ptrdiff_t sz = THTensor_(nElement)(tensor);
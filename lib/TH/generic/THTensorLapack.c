@@ -261,6 +261,7 @@ void THTensor_(gels)(THTensor *rb_, THTensor *ra_, THTensor *b, THTensor *a)
 
   /* rb__ is currently ldb by nrhs; resize it to n by nrhs */
   rb__->size[0] = n;
+  THTensor_(refreshGeometry)(rb__);
   if (rb__ != rb_)
     THTensor_(resize2d)(rb_, n, nrhs);
 
@@ -10,7 +10,21 @@
 #include <omp.h>
 #endif
 
-#define TH_OMP_OVERHEAD_THRESHOLD 100000
+#undef th_isnan
+#if defined(TH_REAL_IS_FLOAT) || defined(TH_REAL_IS_DOUBLE)
+#define th_isnan(val) \
+(isnan(val))
+#else
+#define th_isnan(val) (0)
+#endif
+
+/* the _CONTIG kernels can walk tensors as flat arrays when they are all
+   contiguous, or all dense with identical strides (e.g. channels-last);
+   the first test only reads the geometry cached in the tensors */
+#define TH_TENSOR_FLAT2(A, B) \
+  ((((A)->geometry & (B)->geometry & TH_TENSOR_CONTIGUOUS) && (A)->numel == (B)->numel) || \
+   THTensor_(isSameLayoutAs)(A, B))
+#define TH_TENSOR_FLAT3(A, B, C) (TH_TENSOR_FLAT2(A, B) && TH_TENSOR_FLAT2(A, C))
 
 #ifdef _OPENMP
 
@@ -20,26 +34,35 @@
 #define PRAGMA(P) __pragma(P)
 #endif
 
+/* entering a parallel region costs hundreds of nanoseconds even when its if
+   clause keeps it serial, as much as the whole op on a small tensor: below
+   the threshold, CODE is run directly */
 #define TH_TENSOR_APPLY_CONTIG(TYPE, TENSOR, CODE) \
 { \
-  ptrdiff_t TH_TENSOR_size = THTensor_(nElement)(TENSOR); \
-  PRAGMA(omp parallel if (TH_TENSOR_size > TH_OMP_OVERHEAD_THRESHOLD)) \
-  { \
-    size_t num_threads = omp_get_num_threads(); \
-    size_t tid = omp_get_thread_num(); \
-    ptrdiff_t TH_TENSOR_offset = tid * (TH_TENSOR_size / num_threads); \
-    ptrdiff_t TH_TENSOR_end = tid == num_threads - 1 ? TH_TENSOR_size : \
-      TH_TENSOR_offset + TH_TENSOR_size / num_threads; \
-    ptrdiff_t TENSOR##_len = TH_TENSOR_end - TH_TENSOR_offset; \
-    TYPE *TENSOR##_data = THTensor_(data)(TENSOR) + TH_TENSOR_offset; \
+  ptrdiff_t TH_TENSOR_size = (TENSOR)->numel; \
+  if (TH_TENSOR_size <= TH_OMP_OVERHEAD_THRESHOLD) { \
+    ptrdiff_t TENSOR##_len = TH_TENSOR_size; \
+    TYPE *TENSOR##_data = THTensor_(data)(TENSOR); \
     CODE \
+  } else { \
+    PRAGMA(omp parallel) \
+    { \
+      size_t num_threads = omp_get_num_threads(); \
+      size_t tid = omp_get_thread_num(); \
+      ptrdiff_t TH_TENSOR_offset = tid * (TH_TENSOR_size / num_threads); \
+      ptrdiff_t TH_TENSOR_end = tid == num_threads - 1 ? TH_TENSOR_size : \
+        TH_TENSOR_offset + TH_TENSOR_size / num_threads; \
+      ptrdiff_t TENSOR##_len = TH_TENSOR_end - TH_TENSOR_offset; \
+      TYPE *TENSOR##_data = THTensor_(data)(TENSOR) + TH_TENSOR_offset; \
+      CODE \
+    } \
   } \
 }
 #else
 #define TH_TENSOR_APPLY_CONTIG(TYPE, TENSOR, CODE) \
 { \
   TYPE *TENSOR##_data = THTensor_(data)(TENSOR); \
-  ptrdiff_t TENSOR##_len = THTensor_(nElement)(TENSOR); \
+  ptrdiff_t TENSOR##_len = (TENSOR)->numel; \
   CODE \
 }
 #endif
@@ -47,18 +70,25 @@
 #ifdef _OPENMP
 #define TH_TENSOR_APPLY2_CONTIG(TYPE1, TENSOR1, TYPE2, TENSOR2, CODE) \
 { \
-  ptrdiff_t TH_TENSOR_size = THTensor_(nElement)(TENSOR1); \
-  PRAGMA(omp parallel if (TH_TENSOR_size > TH_OMP_OVERHEAD_THRESHOLD)) \
-  { \
-    size_t num_threads = omp_get_num_threads(); \
-    size_t tid = omp_get_thread_num(); \
-    ptrdiff_t TH_TENSOR_offset = tid * (TH_TENSOR_size / num_threads); \
-    ptrdiff_t TH_TENSOR_end = tid == num_threads - 1 ? TH_TENSOR_size : \
-      TH_TENSOR_offset + TH_TENSOR_size / num_threads; \
-    ptrdiff_t TENSOR1##_len = TH_TENSOR_end - TH_TENSOR_offset; \
-    TYPE1 *TENSOR1##_data = THTensor_(data)(TENSOR1) + TH_TENSOR_offset; \
-    TYPE2 *TENSOR2##_data = THTensor_(data)(TENSOR2) + TH_TENSOR_offset; \
+  ptrdiff_t TH_TENSOR_size = (TENSOR1)->numel; \
+  if (TH_TENSOR_size <= TH_OMP_OVERHEAD_THRESHOLD) { \
+    ptrdiff_t TENSOR1##_len = TH_TENSOR_size; \
+    TYPE1 *TENSOR1##_data = THTensor_(data)(TENSOR1); \
+    TYPE2 *TENSOR2##_data = THTensor_(data)(TENSOR2); \
     CODE \
+  } else { \
+    PRAGMA(omp parallel) \
+    { \
+      size_t num_threads = omp_get_num_threads(); \
+      size_t tid = omp_get_thread_num(); \
+      ptrdiff_t TH_TENSOR_offset = tid * (TH_TENSOR_size / num_threads); \
+      ptrdiff_t TH_TENSOR_end = tid == num_threads - 1 ? TH_TENSOR_size : \
+        TH_TENSOR_offset + TH_TENSOR_size / num_threads; \
+      ptrdiff_t TENSOR1##_len = TH_TENSOR_end - TH_TENSOR_offset; \
+      TYPE1 *TENSOR1##_data = THTensor_(data)(TENSOR1) + TH_TENSOR_offset; \
+      TYPE2 *TENSOR2##_data = THTensor_(data)(TENSOR2) + TH_TENSOR_offset; \
+      CODE \
+    } \
   } \
 }
 #else
@@ -66,7 +96,7 @@
 { \
   TYPE1 *TENSOR1##_data = THTensor_(data)(TENSOR1); \
   TYPE2 *TENSOR2##_data = THTensor_(data)(TENSOR2); \
-  ptrdiff_t TENSOR1##_len = THTensor_(nElement)(TENSOR1); \
+  ptrdiff_t TENSOR1##_len = (TENSOR1)->numel; \
   CODE \
 }
 #endif
@@ -74,19 +104,27 @@
 #ifdef _OPENMP
 #define TH_TENSOR_APPLY3_CONTIG(TYPE1, TENSOR1, TYPE2, TENSOR2, TYPE3, TENSOR3, CODE) \
 { \
-  ptrdiff_t TH_TENSOR_size = THTensor_(nElement)(TENSOR1); \
-  PRAGMA(omp parallel if (TH_TENSOR_size > TH_OMP_OVERHEAD_THRESHOLD)) \
-  { \
-    size_t num_threads = omp_get_num_threads(); \
-    size_t tid = omp_get_thread_num(); \
-    ptrdiff_t TH_TENSOR_offset = tid * (TH_TENSOR_size / num_threads); \
-    ptrdiff_t TH_TENSOR_end = tid == num_threads - 1 ? TH_TENSOR_size : \
-      TH_TENSOR_offset + TH_TENSOR_size / num_threads; \
-    ptrdiff_t TENSOR1##_len = TH_TENSOR_end - TH_TENSOR_offset; \
-    TYPE1 *TENSOR1##_data = THTensor_(data)(TENSOR1) + TH_TENSOR_offset; \
-    TYPE2 *TENSOR2##_data = THTensor_(data)(TENSOR2) + TH_TENSOR_offset; \
-    TYPE3 *TENSOR3##_data = THTensor_(data)(TENSOR3) + TH_TENSOR_offset; \
+  ptrdiff_t TH_TENSOR_size = (TENSOR1)->numel; \
+  if (TH_TENSOR_size <= TH_OMP_OVERHEAD_THRESHOLD) { \
+    ptrdiff_t TENSOR1##_len = TH_TENSOR_size; \
+    TYPE1 *TENSOR1##_data = THTensor_(data)(TENSOR1); \
+    TYPE2 *TENSOR2##_data = THTensor_(data)(TENSOR2); \
+    TYPE3 *TENSOR3##_data = THTensor_(data)(TENSOR3); \
     CODE \
+  } else { \
+    PRAGMA(omp parallel) \
+    { \
+      size_t num_threads = omp_get_num_threads(); \
+      size_t tid = omp_get_thread_num(); \
+      ptrdiff_t TH_TENSOR_offset = tid * (TH_TENSOR_size / num_threads); \
+      ptrdiff_t TH_TENSOR_end = tid == num_threads - 1 ? TH_TENSOR_size : \
+        TH_TENSOR_offset + TH_TENSOR_size / num_threads; \
+      ptrdiff_t TENSOR1##_len = TH_TENSOR_end - TH_TENSOR_offset; \
+      TYPE1 *TENSOR1##_data = THTensor_(data)(TENSOR1) + TH_TENSOR_offset; \
+      TYPE2 *TENSOR2##_data = THTensor_(data)(TENSOR2) + TH_TENSOR_offset; \
+      TYPE3 *TENSOR3##_data = THTensor_(data)(TENSOR3) + TH_TENSOR_offset; \
+      CODE \
+    } \
   } \
 }
 #else
@@ -95,11 +133,70 @@
   TYPE1 *TENSOR1##_data = THTensor_(data)(TENSOR1); \
   TYPE2 *TENSOR2##_data = THTensor_(data)(TENSOR2); \
   TYPE3 *TENSOR3##_data = THTensor_(data)(TENSOR3); \
-  ptrdiff_t TENSOR1##_len = THTensor_(nElement)(TENSOR1); \
+  ptrdiff_t TENSOR1##_len = (TENSOR1)->numel; \
   CODE \
 }
 #endif
 
+#ifndef _OPENMP
+#define PRAGMA(P)
+#endif
+
+/*
+  Deterministic reductions (see THSetDeterministic): contiguous data is cut
+  into blocks of TH_REDUCE_BLOCK elements whatever the number of threads,
+  each block is summed pairwise, and the block sums are added pairwise in
+  order. The result then only depends on the data, not on how the blocks
+  were shared between threads.
+*/
+#define TH_REDUCE_BLOCK 4096
+
+#define IMPLEMENT_PAIRWISE_SUM(NAME, TYPE, TERM)                         \
+static accreal THTensor_(NAME)(const TYPE *x, const TYPE *y, ptrdiff_t n) \
+{                                                                       \
+  if (n <= 64) {                                                        \
+    accreal acc[8] = {0, 0, 0, 0, 0, 0, 0, 0};                          \
+    ptrdiff_t i, j, k;                                                  \
+    for (j = 0; j + 8 <= n; j += 8) {                                   \
+      for (k = 0; k < 8; k++) {                                         \
+        i = j + k;                                                      \
+        acc[k] += TERM;                                                 \
+      }                                                                 \
+    }                                                                   \
+    for (k = 0; j + k < n; k++) {                                       \
+      i = j + k;                                                        \
+      acc[k] += TERM;                                                   \
+    }                                                                   \
+    return ((acc[0] + acc[1]) + (acc[2] + acc[3])) +                    \
+           ((acc[4] + acc[5]) + (acc[6] + acc[7]));                     \
+  } else {                                                              \
+    ptrdiff_t h = n / 2;                                                \
+    return THTensor_(NAME)(x, y, h) + THTensor_(NAME)(x + h, y + h, n - h); \
+  }                                                                     \
+}
+
+/* unary sums are called with y = x */
+IMPLEMENT_PAIRWISE_SUM(pairwiseSumAcc, accreal, x[i])
+IMPLEMENT_PAIRWISE_SUM(pairwiseSum, real, x[i])
+IMPLEMENT_PAIRWISE_SUM(pairwiseDot, real, (accreal)x[i] * y[i])
+
+/* SUM = sum over the blocks of N elements of BLOCK_SUM, an expression of
+   block_offset and block_len */
+#define TH_BLOCKED_SUM(SUM, N, BLOCK_SUM)                                \
+{                                                                       \
+  ptrdiff_t TH_nblocks = ((N) + TH_REDUCE_BLOCK - 1) / TH_REDUCE_BLOCK;  \
+  accreal *TH_partial = (accreal*)THAlloc(sizeof(accreal) * (TH_nblocks > 0 ? TH_nblocks : 1)); \
+  ptrdiff_t TH_b;                                                       \
+  PRAGMA(omp parallel for if((N) > TH_OMP_OVERHEAD_THRESHOLD) private(TH_b)) \
+  for (TH_b = 0; TH_b < TH_nblocks; TH_b++) {                           \
+    ptrdiff_t block_offset = TH_b * TH_REDUCE_BLOCK;                    \
+    ptrdiff_t block_len = THMin((N) - block_offset, TH_REDUCE_BLOCK);   \
+    TH_partial[TH_b] = BLOCK_SUM;                                       \
+  }                                                                     \
+  SUM = THTensor_(pairwiseSumAcc)(TH_partial, TH_partial, TH_nblocks);  \
+  THFree(TH_partial);                                                   \
+}
+
 void THTensor_(fill)(THTensor *r_, real value)
 {
   if (THTensor_(isContiguous)(r_) || THTensor_(isTransposed)(r_)) {
@@ -518,9 +615,392 @@ void THTensor_(scatterFill)(THTensor *tensor, int dim, THLongTensor *index, real
                        })
 }
 
+#define TH_SEGMENT_SUM  0
+#define TH_SEGMENT_MEAN 1
+#define TH_SEGMENT_MAX  2
+#define TH_SEGMENT_MIN  3
+
+/* reduces the rows start to end-1 of base (rows index[start] to
+   index[end-1] if index is given), each scaled by its weight if weights is
+   given, into out; an empty range reduces to 0 */
+static void THTensor_(reduceRows)(real *out, real *base, long rowStride, long rowSize,
+                                  long *index, real *weights, long start, long end, int mode)
+{
+  long j, k;
+
+#define TH_ROW(J) (base + (index ? index[J] - TH_INDEX_BASE : (J)) * rowStride)
+  if (start >= end) {
+    THVector_(fill)(out, 0, rowSize);
+    return;
+  }
+
+  if (weights)
+    THVector_(muls)(out, TH_ROW(start), weights[start], rowSize);
+  else
+    memcpy(out, TH_ROW(start), rowSize * sizeof(real));
+
+  for (j = start + 1; j < end; j++) {
+    real *row = TH_ROW(j);
+    switch (mode) {
+      case TH_SEGMENT_SUM:
+      case TH_SEGMENT_MEAN:
+        THVector_(cadd)(out, out, row, (weights ? weights[j] : 1), rowSize);
+        break;
+      case TH_SEGMENT_MAX:
+        for (k = 0; k < rowSize; k++)
+          if (row[k] > out[k] || th_isnan(row[k]))
+            out[k] = row[k];
+        break;
+      case TH_SEGMENT_MIN:
+        for (k = 0; k < rowSize; k++)
+          if (row[k] < out[k] || th_isnan(row[k]))
+            out[k] = row[k];
+        break;
+    }
+  }
+#undef TH_ROW
+
+  if (mode == TH_SEGMENT_MEAN)
+    THVector_(divs)(out, out, (real)(end - start), rowSize);
+}
+
+/* whether the offsets cut n rows into segments */
+static int THTensor_(validSegmentOffsets)(THLongTensor *offsets, long n)
+{
+  long nseg = THLongTensor_nElement(offsets);
+  long *off = THLongTensor_data(offsets);
+  long s;
+
+  for (s = 0; s < nseg; s++) {
+    long start = off[s] - TH_INDEX_BASE;
+    long end = (s + 1 < nseg ? off[s+1] - TH_INDEX_BASE : n);
+    if (start < 0 || start > end || end > n)
+      return 0;
+  }
+  return 1;
+}
+
+static void THTensor_(segmentReduce)(THTensor *r_, THTensor *src, THLongTensor *offsets, int mode)
+{
+  THLongStorage *size;
+  THTensor *r;
+  long *off;
+  real *sp, *rp;
+  long n, nseg, rowSize, s;
+
+  THArgCheck(src->nDimension > 0, 2, "Source tensor is empty");
+  THArgCheck(offsets->nDimension == 1, 3, "offsets must be a vector");
+
+  src = THTensor_(newContiguous)(src);
+  offsets = THLongTensor_newContiguous(offsets);
+  n = src->size[0];
+  nseg = THLongTensor_nElement(offsets);
+  rowSize = (n > 0 ? THTensor_(nElement)(src) / n : 0);
+  if (!THTensor_(validSegmentOffsets)(offsets, n)) {
+    THLongTensor_free(offsets);
+    THTensor_(free)(src);
+    THArgCheck(0, 3, "offsets must be non-decreasing, between %d and %ld", TH_INDEX_BASE, n + TH_INDEX_BASE);
+  }
+
+  size = THLongStorage_newWithSize(src->nDimension);
+  THLongStorage_rawCopy(size, src->size);
+  size->data[0] = nseg;
+  THTensor_(resize)(r_, size, NULL);
+  THLongStorage_free(size);
+
+  r = THTensor_(newContiguous)(r_);
+  off = THLongTensor_data(offsets);
+  sp = THTensor_(data)(src);
+  rp = THTensor_(data)(r);
+
+  #pragma omp parallel for if(n * rowSize > TH_OMP_OVERHEAD_THRESHOLD) private(s)
+  for (s = 0; s < nseg; s++) {
+    long start = off[s] - TH_INDEX_BASE;
+    long end = (s + 1 < nseg ? off[s+1] - TH_INDEX_BASE : n);
+    THTensor_(reduceRows)(rp + s * rowSize, sp, rowSize, rowSize, NULL, NULL, start, end, mode);
+  }
+
+  THTensor_(freeCopyTo)(r, r_);
+  THLongTensor_free(offsets);
+  THTensor_(free)(src);
+}
+
+void THTensor_(segmentSum)(THTensor *r_, THTensor *src, THLongTensor *offsets)
+{
+  THTensor_(segmentReduce)(r_, src, offsets, TH_SEGMENT_SUM);
+}
+
+void THTensor_(segmentMean)(THTensor *r_, THTensor *src, THLongTensor *offsets)
+{
+  THTensor_(segmentReduce)(r_, src, offsets, TH_SEGMENT_MEAN);
+}
+
+void THTensor_(segmentMax)(THTensor *r_, THTensor *src, THLongTensor *offsets)
+{
+  THTensor_(segmentReduce)(r_, src, offsets, TH_SEGMENT_MAX);
+}
+
+void THTensor_(segmentMin)(THTensor *r_, THTensor *src, THLongTensor *offsets)
+{
+  THTensor_(segmentReduce)(r_, src, offsets, TH_SEGMENT_MIN);
+}
+
+#if defined(TH_REAL_IS_LONG)
+void THTensor_(segmentOffsets)(THTensor *offsets, THTensor *ids, long nsegments)
+{
+  long n, s, j;
+  long *id, *off;
+
+  THArgCheck(ids->nDimension <= 1, 2, "ids must be a vector");
+  ids = THTensor_(newContiguous)(ids);
+  n = THTensor_(nElement)(ids);
+  id = THTensor_(data)(ids);
+  if (nsegments <= 0)
+    nsegments = (n > 0 ? id[n-1] - TH_INDEX_BASE + 1 : 0);
+
+  for (j = 0; j < n; j++) {
+    if (id[j] < TH_INDEX_BASE || id[j] >= nsegments + TH_INDEX_BASE || (j > 0 && id[j] < id[j-1])) {
+      THTensor_(free)(ids);
+      THArgCheck(0, 2, "ids must be sorted, between %d and %ld", TH_INDEX_BASE, nsegments - 1 + TH_INDEX_BASE);
+    }
+  }
+
+  THTensor_(resize1d)(offsets, nsegments);
+  off = THTensor_(data)(offsets);
+  for (s = 0, j = 0; s < nsegments; s++) {
+    while (j < n && id[j] - TH_INDEX_BASE < s)
+      j++;
+    off[s * offsets->stride[0]] = j + TH_INDEX_BASE;
+  }
+  THTensor_(free)(ids);
+}
+#endif
+
+static void THTensor_(embeddingBagReduce)(THTensor *r_, THTensor *weight, THLongTensor *indices,
+                                          THLongTensor *offsets, THTensor *perSampleWeights, int mode)
+{
+  THTensor *r;
+  long *idx, *off;
+  real *wp, *sw, *rp;
+  long n, nbags, num, dim, rowStride, b, j;
+
+  THArgCheck(weight->nDimension == 2, 2, "weight must be a matrix");
+  THArgCheck(indices->nDimension <= 1, 3, "indices must be a vector");
+  THArgCheck(offsets->nDimension == 1, 4, "offsets must be a vector");
+  THArgCheck(mode >= TH_SEGMENT_SUM && mode <= TH_SEGMENT_MAX, 5, "invalid mode");
+  THArgCheck(!perSampleWeights || THTensor_(nElement)(perSampleWeights) == THLongTensor_nElement(indices), 5,
+             "perSampleWeights must have as many elements as indices");
+
+  /* the rows of a large table are read in place, whatever their stride */
+  if (weight->stride[1] == 1) {
+    THTensor_(retain)(weight);
+  } else {
+    weight = THTensor_(newContiguous)(weight);
+  }
+  indices = THLongTensor_newContiguous(indices);
+  offsets = THLongTensor_newContiguous(offsets);
+  num = weight->size[0];
+  dim = weight->size[1];
+  rowStride = weight->stride[0];
+  n = THLongTensor_nElement(indices);
+  nbags = THLongTensor_nElement(offsets);
+  idx = THLongTensor_data(indices);
+
+  for (j = 0; j < n; j++) {
+    if (idx[j] < TH_INDEX_BASE || idx[j] >= num + TH_INDEX_BASE) {
+      THLongTensor_free(offsets);
+      THLongTensor_free(indices);
+      THTensor_(free)(weight);
+      THError("index out of range");
+    }
+  }
+  if (!THTensor_(validSegmentOffsets)(offsets, n)) {
+    THLongTensor_free(offsets);
+    THLongTensor_free(indices);
+    THTensor_(free)(weight);
+    THArgCheck(0, 4, "offsets must be non-decreasing, between %d and %ld", TH_INDEX_BASE, n + TH_INDEX_BASE);
+  }
+
+  sw = NULL;
+  if (perSampleWeights) {
+    perSampleWeights = THTensor_(newContiguous)(perSampleWeights);
+    sw = THTensor_(data)(perSampleWeights);
+  }
+
+  THTensor_(resize2d)(r_, nbags, dim);
+  r = THTensor_(newContiguous)(r_);
+  off = THLongTensor_data(offsets);
+  wp = THTensor_(data)(weight);
+  rp = THTensor_(data)(r);
+
+  #pragma omp parallel for if(n * dim > TH_OMP_OVERHEAD_THRESHOLD) private(b)
+  for (b = 0; b < nbags; b++) {
+    long start = off[b] - TH_INDEX_BASE;
+    long end = (b + 1 < nbags ? off[b+1] - TH_INDEX_BASE : n);
+    THTensor_(reduceRows)(rp + b * dim, wp, rowStride, dim, idx, sw, start, end, mode);
+  }
+
+  THTensor_(freeCopyTo)(r, r_);
+  if (perSampleWeights)
+    THTensor_(free)(perSampleWeights);
+  THLongTensor_free(offsets);
+  THLongTensor_free(indices);
+  THTensor_(free)(weight);
+}
+
+void THTensor_(embeddingBag)(THTensor *r_, THTensor *weight, THLongTensor *indices, THLongTensor *offsets, int mode)
+{
+  THTensor_(embeddingBagReduce)(r_, weight, indices, offsets, NULL, mode);
+}
+
+void THTensor_(embeddingBagWeighted)(THTensor *r_, THTensor *weight, THLongTensor *indices, THLongTensor *offsets, THTensor *perSampleWeights)
+{
+  THTensor_(embeddingBagReduce)(r_, weight, indices, offsets, perSampleWeights, TH_SEGMENT_SUM);
+}
+
+/* number of elements of the n sorted s[i] lower than v (lower or equal if
+   right), NaN being after everything: a binary search whose steps are
+   computed from the comparisons instead of branching on them, which would
+   be mispredicted half of the time */
+static inline long THTensor_(sortedRank)(const real *s, long n, real v, int right)
+{
+  const real *base = s;
+  long len = n;
+
+  if (n == 0)
+    return 0;
+  if (th_isnan(v))
+    return n;
+  while (len > 1) {
+    long half = len / 2;
+    base += half * ((base[half-1] < v) | (right & (base[half-1] == v)));
+    len -= half;
+  }
+  return (base - s) + ((*base < v) | (right & (*base == v)));
+}
+
+/* s stored in the order of a breadth-first walk of its binary search tree
+   (Eytzinger layout): e[1] is the root and e[2k], e[2k+1] are the children of
+   e[k], so that the first levels, visited by every search, share a few cache
+   lines; pos[k] is the index of e[k] in s */
+static void THTensor_(eytzingerLayout)(real *e, long *pos, const real *s, long n, long *i, long k)
+{
+  if (k <= n) {
+    THTensor_(eytzingerLayout)(e, pos, s, n, i, 2*k);
+    e[k] = s[*i];
+    pos[k] = (*i)++;
+    THTensor_(eytzingerLayout)(e, pos, s, n, i, 2*k+1);
+  }
+}
+
+static inline long THTensor_(eytzingerRank)(const real *e, const long *pos, long n, real v, int right)
+{
+  long k = 1;
+
+  if (th_isnan(v))
+    return n;
+  while (k <= n) {
+#if defined(__GNUC__)
+    /* the descendants of k four levels down are contiguous */
+    __builtin_prefetch(e + 16*k);
+#endif
+    k = 2*k + ((e[k] < v) | (right & (e[k] == v)));
+  }
+  /* undo the right turns taken below the last left one, which was the
+     lower bound */
+#if defined(__GNUC__)
+  k >>= __builtin_ffsl(~k);
+#else
+  while (k & 1)
+    k >>= 1;
+  k >>= 1;
+#endif
+  return (k ? pos[k] : n);
+}
+
+void THTensor_(searchsorted)(THLongTensor *r_, THTensor *sorted, THTensor *values, int right)
+{
+  THLongStorage *size;
+  THLongTensor *r;
+  real *sp, *vp, *e = NULL;
+  long *rp, *pos = NULL;
+  long nrows, n, nv, perRow, depth, i;
+
+  THArgCheck(sorted->nDimension <= 2, 2,
+             "sorted must be a vector or a matrix of sorted rows");
+  if (sorted->nDimension == 2) {
+    THArgCheck(values->nDimension == 2 && values->size[0] == sorted->size[0], 3,
+               "values must be a matrix with a row per sorted row");
+  }
+
+  sorted = THTensor_(newContiguous)(sorted);
+  values = THTensor_(newContiguous)(values);
+  nrows = (sorted->nDimension == 2 ? sorted->size[0] : 1);
+  n = (sorted->nDimension > 0 ? sorted->size[sorted->nDimension-1] : 0);
+  nv = THTensor_(nElement)(values);
+  perRow = (sorted->nDimension == 2 ? values->size[1] : nv);
+
+  size = THTensor_(newSizeOf)(values);
+  THLongTensor_resize(r_, size, NULL);
+  THLongStorage_free(size);
+  r = THLongTensor_newContiguous(r_);
+
+  sp = THTensor_(data)(sorted);
+  vp = THTensor_(data)(values);
+  rp = THLongTensor_data(r);
+  for (depth = 1; (1L << depth) <= n; depth++);
+
+  /* a single sequence searched at least once per element: laying it out for
+     the cache pays for itself */
+  if (nrows == 1 && n >= THTuneSearchsortedEytzingerMin() && nv >= n) {
+    long next = 0;
+    e = (real *)THAlloc((n + 1) * sizeof(real));
+    pos = (long *)THAlloc((n + 1) * sizeof(long));
+    THTensor_(eytzingerLayout)(e, pos, sp, n, &next, 1);
+  }
+
+  /* the searches are inlined with a constant right, which saves the test
+     for equality when it is 0 */
+  #pragma omp parallel for if(nv * depth > TH_OMP_OVERHEAD_THRESHOLD) private(i)
+  for (i = 0; i < nv; i++) {
+    const real *row = (nrows == 1 ? sp : sp + (i / perRow) * n);
+    if (e)
+      rp[i] = (right ? THTensor_(eytzingerRank)(e, pos, n, vp[i], 1)
+                     : THTensor_(eytzingerRank)(e, pos, n, vp[i], 0));
+    else
+      rp[i] = (right ? THTensor_(sortedRank)(row, n, vp[i], 1)
+                     : THTensor_(sortedRank)(row, n, vp[i], 0));
+  }
+
+  THFree(e);
+  THFree(pos);
+  THLongTensor_freeCopyTo(r, r_);
+  THTensor_(free)(values);
+  THTensor_(free)(sorted);
+}
+
+void THTensor_(bucketize)(THLongTensor *r_, THTensor *values, THTensor *boundaries, int right)
+{
+  THArgCheck(boundaries->nDimension <= 1, 3, "boundaries must be a vector");
+  THTensor_(searchsorted)(r_, boundaries, values, right);
+}
+
 accreal THTensor_(dot)(THTensor *tensor, THTensor *src)
 {
   accreal sum = 0;
+  if (THGetDeterministic()) {
+    THArgCheck(THTensor_(nElement)(tensor) == THTensor_(nElement)(src), 2, "sizes do not match");
+    if (THTensor_(isContiguous)(tensor) && THTensor_(isContiguous)(src)) {
+      real *tp = THTensor_(data)(tensor);
+      real *sp = THTensor_(data)(src);
+      ptrdiff_t sz = THTensor_(nElement)(tensor);
+      TH_BLOCKED_SUM(sum, sz, THTensor_(pairwiseDot)(tp + block_offset, sp + block_offset, block_len));
+    } else {
+      /* BLAS may split the sum between its own threads */
+      TH_TENSOR_APPLY2(real, tensor, real, src, sum += (accreal)*tensor_data * *src_data;);
+    }
+    return sum;
+  }
   /* we use a trick here. careful with that. */
   TH_TENSOR_APPLY2(real, tensor, real, src,
                    long sz = (tensor_size-tensor_i < src_size-src_i ? tensor_size-tensor_i : src_size-src_i);
@@ -534,14 +1014,6 @@ accreal THTensor_(dot)(THTensor *tensor, THTensor *src)
 }
 
 
-#undef th_isnan
-#if defined(TH_REAL_IS_FLOAT) || defined(TH_REAL_IS_DOUBLE)
-#define th_isnan(val) \
-(isnan(val))
-#else
-#define th_isnan(val) (0)
-#endif
-
 #undef th_isnan_break
 #if defined(TH_REAL_IS_FLOAT) || defined(TH_REAL_IS_DOUBLE)
 #define th_isnan_break(val) \
@@ -616,7 +1088,15 @@ real THTensor_(medianall)(THTensor *tensor)
 accreal THTensor_(sumall)(THTensor *tensor)
 {
   accreal sum = 0;
-  TH_TENSOR_APPLY(real, tensor, sum += *tensor_data;);
+  if (THTensor_(isContiguous)(tensor) && THGetDeterministic()) {
+    real *tp = THTensor_(data)(tensor);
+    ptrdiff_t sz = THTensor_(nElement)(tensor);
+    TH_BLOCKED_SUM(sum, sz, THTensor_(pairwiseSum)(tp + block_offset, tp + block_offset, block_len));
+  } else {
+    /* sequential: an OpenMP reduction would make the result depend on the
+       number of threads, which only the blocked path above avoids */
+    TH_TENSOR_APPLY(real, tensor, sum += *tensor_data;);
+  }
   return sum;
 }
 
@@ -630,7 +1110,7 @@ accreal THTensor_(prodall)(THTensor *tensor)
 void THTensor_(add)(THTensor *r_, THTensor *t, real value)
 {
   THTensor_(resizeAs)(r_, t);
-  if (THTensor_(isContiguous)(r_) && THTensor_(isContiguous)(t) && THTensor_(nElement)(r_) == THTensor_(nElement)(t)) {
+  if (TH_TENSOR_FLAT2(r_, t)) {
     TH_TENSOR_APPLY2_CONTIG(real, r_, real, t, THVector_(adds)(r__data, t_data, value, r__len););
   } else {
     TH_TENSOR_APPLY2(real, r_, real, t, *r__data = *t_data + value;);
@@ -645,21 +1125,102 @@ void THTensor_(sub)(THTensor *r_, THTensor *t, real value)
 void THTensor_(mul)(THTensor *r_, THTensor *t, real value)
 {
   THTensor_(resizeAs)(r_, t);
-  if (THTensor_(isContiguous)(r_) && THTensor_(isContiguous)(t) && THTensor_(nElement)(r_) == THTensor_(nElement)(t)) {
+  if (TH_TENSOR_FLAT2(r_, t)) {
     TH_TENSOR_APPLY2_CONTIG(real, r_, real, t, THVector_(muls)(r__data, t_data, value, r__len););
   } else {
     TH_TENSOR_APPLY2(real, r_, real, t, *r__data = *t_data * value;);
   }
 }
 
+/* integer division by a scalar through a multiplication (see THIntDivider),
+   bytes being divided as 16-bit integers */
+#if defined(TH_REAL_IS_BYTE) || defined(TH_REAL_IS_SHORT)
+#define TH_INT_DIVIDE(DV, X) ((real)THIntDivider_div16(DV, X))
+#define TH_INT_DIVIDE_BITS 16
+#elif defined(TH_REAL_IS_CHAR)
+#define TH_INT_DIVIDE(DV, X) ((real)THIntDivider_div8(DV, X))
+#define TH_INT_DIVIDE_BITS 8
+#elif defined(TH_REAL_IS_INT) || (defined(TH_REAL_IS_LONG) && LONG_MAX == INT_MAX)
+#define TH_INT_DIVIDE(DV, X) ((real)THIntDivider_div32(DV, (int)(X)))
+#define TH_INT_DIVIDE_BITS 32
+#elif defined(TH_REAL_IS_LONG) && defined(TH_INT_DIVIDER_64)
+#define TH_INT_DIVIDE(DV, X) ((real)THIntDivider_div64(DV, X))
+#define TH_INT_DIVIDE_BITS 64
+#endif
+
+#ifdef TH_INT_DIVIDE
+#define TH_INT_DIVIDE_QUOTIENT  0
+#define TH_INT_DIVIDE_FMOD      1
+#define TH_INT_DIVIDE_REMAINDER 2
+
+/* x - (x/d)*d, modulo 2^64 so that it is 0 for the smallest integer and -1 */
+static inline real THTensor_(intFmod)(THIntDivider dv, real x)
+{
+  real q = TH_INT_DIVIDE(dv, x);
+  return (real)((unsigned long long)x - (unsigned long long)q * (unsigned long long)dv.divisor);
+}
+
+/* the remainder of the sign of d */
+static inline real THTensor_(intRemainder)(THIntDivider dv, real x)
+{
+  real r = THTensor_(intFmod)(dv, x);
+  return (r != 0 && (r < 0) != (dv.divisor < 0) ? (real)(r + dv.divisor) : r);
+}
+
+static void THTensor_(intDivide)(THTensor *r_, THTensor *t, real value, int op)
+{
+  THIntDivider dv;
+
+  THArgCheck(value != 0, 3, "division by zero");
+  dv = THIntDivider_new(value, TH_INT_DIVIDE_BITS);
+  THTensor_(resizeAs)(r_, t);
+  if (TH_TENSOR_FLAT2(r_, t)) {
+    switch (op) {
+      case TH_INT_DIVIDE_QUOTIENT:
+        TH_TENSOR_APPLY2_CONTIG(real, r_, real, t,
+                                ptrdiff_t i;
+                                for (i = 0; i < r__len; i++)
+                                  r__data[i] = TH_INT_DIVIDE(dv, t_data[i]););
+        break;
+      case TH_INT_DIVIDE_FMOD:
+        TH_TENSOR_APPLY2_CONTIG(real, r_, real, t,
+                                ptrdiff_t i;
+                                for (i = 0; i < r__len; i++)
+                                  r__data[i] = THTensor_(intFmod)(dv, t_data[i]););
+        break;
+      default:
+        TH_TENSOR_APPLY2_CONTIG(real, r_, real, t,
+                                ptrdiff_t i;
+                                for (i = 0; i < r__len; i++)
+                                  r__data[i] = THTensor_(intRemainder)(dv, t_data[i]););
+    }
+  } else {
+    switch (op) {
+      case TH_INT_DIVIDE_QUOTIENT:
+        TH_TENSOR_APPLY2(real, r_, real, t, *r__data = TH_INT_DIVIDE(dv, *t_data););
+        break;
+      case TH_INT_DIVIDE_FMOD:
+        TH_TENSOR_APPLY2(real, r_, real, t, *r__data = THTensor_(intFmod)(dv, *t_data););
+        break;
+      default:
+        TH_TENSOR_APPLY2(real, r_, real, t, *r__data = THTensor_(intRemainder)(dv, *t_data););
+    }
+  }
+}
+#endif
+
 void THTensor_(div)(THTensor *r_, THTensor *t, real value)
 {
+#ifdef TH_INT_DIVIDE
+  THTensor_(intDivide)(r_, t, value, TH_INT_DIVIDE_QUOTIENT);
+#else
   THTensor_(resizeAs)(r_, t);
-  if (THTensor_(isContiguous)(r_) && THTensor_(isContiguous)(t) && THTensor_(nElement)(r_) == THTensor_(nElement)(t)) {
+  if (TH_TENSOR_FLAT2(r_, t)) {
     TH_TENSOR_APPLY2_CONTIG(real, r_, real, t, THVector_(divs)(r__data, t_data, value, r__len););
   } else {
     TH_TENSOR_APPLY2(real, r_, real, t, *r__data = *t_data / value;);
   }
+#endif
 }
 
 void THTensor_(lshift)(THTensor *r_, THTensor *t, real value)
@@ -734,6 +1295,10 @@ void THTensor_(rshift)(THTensor *r_, THTensor *t, real value)
 
 void THTensor_(fmod)(THTensor *r_, THTensor *t, real value)
 {
+#ifdef TH_INT_DIVIDE
+  THTensor_(intDivide)(r_, t, value, TH_INT_DIVIDE_FMOD);
+  return;
+#endif
   THTensor_(resizeAs)(r_, t);
   if (THTensor_(isContiguous)(r_) && THTensor_(isContiguous)(t) && THTensor_(nElement)(r_) == THTensor_(nElement)(t)) {
 
@@ -760,6 +1325,10 @@ void THTensor_(fmod)(THTensor *r_, THTensor *t, real value)
 
 void THTensor_(remainder)(THTensor *r_, THTensor *t, real value)
 {
+#ifdef TH_INT_DIVIDE
+  THTensor_(intDivide)(r_, t, value, TH_INT_DIVIDE_REMAINDER);
+  return;
+#endif
   THTensor_(resizeAs)(r_, t);
   if (THTensor_(isContiguous)(r_) && THTensor_(isContiguous)(t) && THTensor_(nElement)(r_) == THTensor_(nElement)(t)) {
       real *tp = THTensor_(data)(t);
@@ -877,7 +1446,7 @@ void THTensor_(clamp)(THTensor *r_, THTensor *t, real min_value, real max_value)
 void THTensor_(cadd)(THTensor *r_, THTensor *t, real value, THTensor *src)
 {
   THTensor_(resizeAs)(r_, t);
-  if (THTensor_(isContiguous)(r_) && THTensor_(isContiguous)(t) && THTensor_(isContiguous)(src) && THTensor_(nElement)(r_) == THTensor_(nElement)(src)) {
+  if (TH_TENSOR_FLAT3(r_, t, src)) {
     if(r_ == t) {
       THBlas_(axpy)(THTensor_(nElement)(t), value, THTensor_(data)(src), 1, THTensor_(data)(r_), 1);
     } else {
@@ -896,7 +1465,7 @@ void THTensor_(csub)(THTensor *r_, THTensor *t, real value,THTensor *src)
 void THTensor_(cmul)(THTensor *r_, THTensor *t, THTensor *src)
 {
   THTensor_(resizeAs)(r_, t);
-  if (THTensor_(isContiguous)(r_) && THTensor_(isContiguous)(t) && THTensor_(isContiguous)(src) && THTensor_(nElement)(r_) == THTensor_(nElement)(src)) {
+  if (TH_TENSOR_FLAT3(r_, t, src)) {
     TH_TENSOR_APPLY3_CONTIG(real, r_, real, t, real, src, THVector_(cmul)(r__data, t_data, src_data, r__len););
   } else {
     TH_TENSOR_APPLY3(real, r_, real, t, real, src, *r__data = *t_data * *src_data;);
@@ -923,7 +1492,7 @@ void THTensor_(cpow)(THTensor *r_, THTensor *t, THTensor *src)
 void THTensor_(cdiv)(THTensor *r_, THTensor *t, THTensor *src)
 {
   THTensor_(resizeAs)(r_, t);
-  if (THTensor_(isContiguous)(r_) && THTensor_(isContiguous)(t) && THTensor_(isContiguous)(src) && THTensor_(nElement)(r_) == THTensor_(nElement)(src)) {
+  if (TH_TENSOR_FLAT3(r_, t, src)) {
     TH_TENSOR_APPLY3_CONTIG(real, r_, real, t, real, src, THVector_(cdiv)(r__data, t_data, src_data, r__len););
   } else {
     TH_TENSOR_APPLY3(real, r_, real, t, real, src, *r__data = *t_data / *src_data;);
@@ -1402,6 +1971,101 @@ void THTensor_(addmm)(THTensor *r_, real beta, THTensor *t, real alpha, THTensor
     THTensor_(freeCopyTo)(r__, r_);
 }
 
+#if defined(TH_REAL_IS_CHAR)
+/* r[i][j] = <a[i], b[j]> for 2 rows of a (or the last one) and 4 rows of b
+   at a time, the products being accumulated in 32 bits */
+static void THTensor_(mmIntBlock)(int *r, long ldr, const real *a, long na,
+                                  const real *b, long nb, long k)
+{
+  long i, j, jj, l;
+  for(i = 0; i < na; i += 2)
+  {
+    const real *x = a + i*k;
+    const real *y = x + k;
+    for(j = 0; j < nb; j += 4)
+    {
+      const real *b0 = b + j*k;
+      const real *b1 = (j+1 < nb ? b0 + k : b0);
+      const real *b2 = (j+2 < nb ? b0 + 2*k : b0);
+      const real *b3 = (j+3 < nb ? b0 + 3*k : b0);
+      int s[4] = {0, 0, 0, 0};
+      int t[4] = {0, 0, 0, 0};
+      if(i+1 < na)
+      {
+        int s0 = 0, s1 = 0, s2 = 0, s3 = 0, t0 = 0, t1 = 0, t2 = 0, t3 = 0;
+        for(l = 0; l < k; l++)
+        {
+          int u = x[l], v = y[l];
+          s0 += u*b0[l]; s1 += u*b1[l]; s2 += u*b2[l]; s3 += u*b3[l];
+          t0 += v*b0[l]; t1 += v*b1[l]; t2 += v*b2[l]; t3 += v*b3[l];
+        }
+        s[0] = s0; s[1] = s1; s[2] = s2; s[3] = s3;
+        t[0] = t0; t[1] = t1; t[2] = t2; t[3] = t3;
+      }
+      else
+      {
+        int s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        for(l = 0; l < k; l++)
+        {
+          int u = x[l];
+          s0 += u*b0[l]; s1 += u*b1[l]; s2 += u*b2[l]; s3 += u*b3[l];
+        }
+        s[0] = s0; s[1] = s1; s[2] = s2; s[3] = s3;
+      }
+      for(jj = 0; jj < 4 && j+jj < nb; jj++)
+      {
+        r[i*ldr + j+jj] = s[jj];
+        if(i+1 < na)
+          r[(i+1)*ldr + j+jj] = t[jj];
+      }
+    }
+  }
+}
+
+/* 8-bit matrix product with 32-bit accumulation, for quantized layers: the
+   rows of m1 and the columns of m2 are walked as contiguous vectors. A sum of
+   k products of at most 128*128 cannot overflow while k <= TH_MMINT_MAX_K */
+#ifndef TH_MMINT_MAX_K
+#define TH_MMINT_MAX_K (2147483647L / (128*128))
+#endif
+
+void THTensor_(mmInt)(THIntTensor *r_, THTensor *m1, THTensor *m2)
+{
+  THTensor *a, *b, *m2t;
+  THIntTensor *r__;
+  long n, k, p, j;
+  int *r_data;
+
+  THArgCheck(m1->nDimension == 2 && m2->nDimension == 2, 2, "matrices expected, got %dD, %dD tensors",
+             m1->nDimension, m2->nDimension);
+  THArgCheck(m1->size[1] == m2->size[0], 3, "size mismatch, m1: %s, m2: %s",
+             THTensor_(sizeDesc)(m1).str, THTensor_(sizeDesc)(m2).str);
+  THArgCheck(m1->size[1] <= TH_MMINT_MAX_K, 2, "inner dimension %ld larger than %ld would overflow the 32-bit sums",
+             m1->size[1], TH_MMINT_MAX_K);
+  n = m1->size[0];
+  k = m1->size[1];
+  p = m2->size[1];
+
+  a = THTensor_(newContiguous)(m1);
+  m2t = THTensor_(newTranspose)(m2, 0, 1);
+  b = THTensor_(newContiguous)(m2t);
+  THIntTensor_resize2d(r_, n, p);
+  r__ = THIntTensor_newContiguous(r_);
+  r_data = THIntTensor_data(r__);
+
+  /* blocks of 64 columns share the rows of m1 from the cache */
+#pragma omp parallel for if(n*p*k > TH_OMP_OVERHEAD_THRESHOLD) private(j)
+  for(j = 0; j < p; j += 64)
+    THTensor_(mmIntBlock)(r_data + j, p, THTensor_(data)(a), n,
+                          THTensor_(data)(b) + j*k, (p - j < 64 ? p - j : 64), k);
+
+  THTensor_(free)(a);
+  THTensor_(free)(m2t);
+  THTensor_(free)(b);
+  THIntTensor_freeCopyTo(r__, r_);
+}
+#endif
+
 void THTensor_(addr)(THTensor *r_, real beta, THTensor *t, real alpha, THTensor *vec1, THTensor *vec2)
 {
   if( (vec1->nDimension != 1) || (vec2->nDimension != 1) )
@@ -1606,11 +2270,13 @@ void THTensor_(max)(THTensor *values_, THLongTensor *indices_, THTensor *t, int
     // tempValues_.expand_as(t)
     tempValues_->size[dimension] = t->size[dimension];
     tempValues_->stride[dimension] = 0;
+    THTensor_(refreshGeometry)(tempValues_);
 
     THLongTensor *tempIndices_ = THLongTensor_newWithTensor(indices_);
     // tempIndices_.expand_as(t)
     tempIndices_->size[dimension] = t->size[dimension];
     tempIndices_->stride[dimension] = 0;
+    THLongTensor_refreshGeometry(tempIndices_);
 
     TH_TENSOR_APPLY3_D(real, t, real, tempValues_, long, tempIndices_, dimension,
                           if(!(*t_data <= *tempValues__data) && !th_isnan(*tempValues__data)) {
@@ -1686,11 +2352,13 @@ void THTensor_(min)(THTensor *values_, THLongTensor *indices_, THTensor *t, int
     // tempValues_.expand_as(t)
     tempValues_->size[dimension] = t->size[dimension];
     tempValues_->stride[dimension] = 0;
+    THTensor_(refreshGeometry)(tempValues_);
 
     THLongTensor *tempIndices_ = THLongTensor_newWithTensor(indices_);
     // tempIndices_.expand_as(t)
     tempIndices_->size[dimension] = t->size[dimension];
     tempIndices_->stride[dimension] = 0;
+    THLongTensor_refreshGeometry(tempIndices_);
 
     TH_TENSOR_APPLY3_D(real, t, real, tempValues_, long, tempIndices_, dimension,
                           if(!(*t_data >= *tempValues__data) && !th_isnan(*tempValues__data)) {
@@ -1719,7 +2387,18 @@ void THTensor_(sum)(THTensor *r_, THTensor *t, int dimension, int keepdim)
   THLongStorage_free(dim);
 
   // two implementations optimized for data locality
-  if (t->stride[dimension] == 1) {
+  if (THGetDeterministic() && dimension == t->nDimension-1 &&
+      THTensor_(isContiguous)(t) && THTensor_(isContiguous)(r_)) {
+    /* rows are independent, each one is summed pairwise */
+    real *tp = THTensor_(data)(t);
+    real *rp = THTensor_(data)(r_);
+    ptrdiff_t nrows = THTensor_(nElement)(r_);
+    long n = t->size[dimension];
+    ptrdiff_t p;
+    PRAGMA(omp parallel for if(nrows * n > TH_OMP_OVERHEAD_THRESHOLD) private(p))
+    for (p = 0; p < nrows; p++)
+      rp[p] = (real)THTensor_(pairwiseSum)(tp + p*n, tp + p*n, n);
+  } else if (t->stride[dimension] == 1) {
     TH_TENSOR_DIM_APPLY2(real, t, real, r_, dimension,
                          accreal sum = 0;
                          long i;
@@ -1732,6 +2411,7 @@ void THTensor_(sum)(THTensor *r_, THTensor *t, int dimension, int keepdim)
     // r_.expand_as(t)
     temp_->size[dimension] = t->size[dimension];
     temp_->stride[dimension] = 0;
+    THTensor_(refreshGeometry)(temp_);
 
     TH_TENSOR_APPLY2(real, temp_, real, t, *temp__data = *temp__data + *t_data;);
     THTensor_(free)(temp_);
@@ -1768,6 +2448,7 @@ void THTensor_(prod)(THTensor *r_, THTensor *t, int dimension, int keepdim)
     // r_.expand_as(t)
     temp_->size[dimension] = t->size[dimension];
     temp_->stride[dimension] = 0;
+    THTensor_(refreshGeometry)(temp_);
 
     TH_TENSOR_APPLY2(real, temp_, real, t, *temp__data = *temp__data * *t_data;);
     THTensor_(free)(temp_);
@@ -2074,6 +2755,103 @@ void THTensor_(reshape)(THTensor *r_, THTensor *t, THLongStorage *size)
   THTensor_(copy)(r_, t);
 }
 
+/* fills the contiguous block op with the source block sp repeated along
+   dimensions dim..ndim-1: each source slice is written once, then the
+   resulting unit is doubled in place with memcpy until all the repeats
+   along dim are written */
+static void THTensor_(repeatFill)(real *op, real *sp, long *ssize, long *sstride,
+                                  long *reps, long *ostride, int dim, int ndim)
+{
+  ptrdiff_t unit = ssize[dim]*ostride[dim];
+  ptrdiff_t total = unit*reps[dim];
+  ptrdiff_t done;
+  long i;
+
+  if(dim == ndim-1)
+    memcpy(op, sp, ssize[dim]*sizeof(real));
+  else
+    for(i = 0; i < ssize[dim]; i++)
+      THTensor_(repeatFill)(op + i*ostride[dim], sp + i*sstride[dim], ssize, sstride, reps, ostride, dim+1, ndim);
+
+  for(done = unit; done < total; done += THMin(done, total-done))
+    memcpy(op + done, op, THMin(done, total-done)*sizeof(real));
+}
+
+void THTensor_(repeat)(THTensor *r_, THTensor *t, THLongStorage *size)
+{
+  int ndim = size->size;
+  int pad = ndim - t->nDimension;
+  long *ssize, *sstride, *reps, *ostride;
+  THLongStorage *osize;
+  THTensor *src, *dst;
+  real *sp, *op;
+  ptrdiff_t unit;
+  long i;
+  int d, first;
+
+  THArgCheck(pad >= 0, 3, "Number of dimensions of repeat dims can not be smaller than number of dimensions of tensor");
+  for(d = 0; d < ndim; d++)
+    THArgCheck(size->data[d] >= 0, 3, "repeat dims can not be negative");
+
+  ssize = THAlloc(4*ndim*sizeof(long));
+  sstride = ssize + ndim;
+  reps = ssize + 2*ndim;
+  ostride = ssize + 3*ndim;
+  osize = THLongStorage_newWithSize(ndim);
+  for(d = 0; d < ndim; d++)
+  {
+    ssize[d] = (d < pad ? 1 : t->size[d-pad]);
+    reps[d] = size->data[d];
+    osize->data[d] = ssize[d]*reps[d];
+  }
+  for(d = ndim-1; d >= 0; d--)
+  {
+    sstride[d] = (d == ndim-1 ? 1 : sstride[d+1]*ssize[d+1]);
+    ostride[d] = (d == ndim-1 ? 1 : ostride[d+1]*osize->data[d+1]);
+  }
+
+  /* the source must stay valid while the result is resized */
+  if(r_->storage && r_->storage == t->storage)
+    src = THTensor_(newClone)(t);
+  else
+    src = THTensor_(newContiguous)(t);
+
+  THTensor_(resize)(r_, osize, NULL);
+  THLongStorage_free(osize);
+  dst = THTensor_(isContiguous)(r_) ? r_ : THTensor_(new)();
+  if(dst != r_)
+    THTensor_(resizeAs)(dst, r_);
+
+  if(THTensor_(nElement)(src) > 0 && THTensor_(nElement)(dst) > 0)
+  {
+    sp = THTensor_(data)(src);
+    op = THTensor_(data)(dst);
+
+    /* leading dimensions of size one which are not repeated do not change the layout */
+    for(first = 0; first < ndim-1 && ssize[first] == 1 && reps[first] == 1; first++);
+
+    /* the source slices along the first dimension, then the repeats of the */
+    /* whole unit, are written in parallel */
+    unit = ssize[first]*ostride[first];
+    if(first == ndim-1)
+      memcpy(op, sp, ssize[first]*sizeof(real));
+    else
+    {
+#pragma omp parallel for if(unit > TH_OMP_OVERHEAD_THRESHOLD) private(i)
+      for(i = 0; i < ssize[first]; i++)
+        THTensor_(repeatFill)(op + i*ostride[first], sp + i*sstride[first], ssize, sstride, reps, ostride, first+1, ndim);
+    }
+#pragma omp parallel for if(unit*reps[first] > TH_OMP_OVERHEAD_THRESHOLD) private(i)
+    for(i = 1; i < reps[first]; i++)
+      memcpy(op + i*unit, op, unit*sizeof(real));
+  }
+
+  if(dst != r_)
+    THTensor_(freeCopyTo)(dst, r_);
+  THTensor_(free)(src);
+  THFree(ssize);
+}
+
 /* I cut and pasted (slightly adapted) the quicksort code from
    Sedgewick's 1978 "Implementing Quicksort Programs" article
    http://www.csie.ntu.edu.tw/~b93076/p847-sedgewick.pdf
@@ -2853,7 +3631,14 @@ TENSOR_IMPLEMENT_LOGICAL(ne,!=)
   void THTensor_(NAME)(THTensor *r_, THTensor *t)                \
   {                                                           \
     THTensor_(resizeAs)(r_, t);                               \
-    TH_TENSOR_APPLY2(real, t, real, r_, *r__data = CFUNC(*t_data);); \
+    if (TH_TENSOR_FLAT2(r_, t)) {                             \
+      TH_TENSOR_APPLY2_CONTIG(real, r_, real, t,              \
+        ptrdiff_t i;                                          \
+        for (i = 0; i < r__len; i++)                          \
+          r__data[i] = CFUNC(t_data[i]););                    \
+    } else {                                                  \
+      TH_TENSOR_APPLY2(real, t, real, r_, *r__data = CFUNC(*t_data);); \
+    }                                                         \
   }                                                           \
 
 #if defined(TH_REAL_IS_LONG)
@@ -2882,6 +3667,535 @@ TENSOR_IMPLEMENT_LOGICAL_SUM(logicalany, ||, 0)
 
 #endif /* Byte only part */
 
+/* Streaming sketches: the values of src update a summary held in a few
+   small tensors, and are not kept. See Sketch.lua. */
+
+/* largest quantile a centroid starting at q can reach: the scale function
+   k(q) = compression/(2 pi) asin(2q-1) may grow by 1 within a centroid */
+static double THTensor_(tdigestLimit)(double q, double compression)
+{
+  double k = asin(THMin(2*q - 1, 1)) + 2*M_PI/compression;
+  return (k >= M_PI/2 ? 1 : (sin(k) + 1)/2);
+}
+
+/* merges the (mean, weight) rows of a with the rows of b (or the values of b,
+   with a weight of 1, if b is not weighted), both sorted by mean, into the
+   rows of out; neighbours are merged as long as the scale function allows.
+   Returns the number of rows of out. */
+static long THTensor_(tdigestCompress)(double *out, const double *a, long na,
+                                       const double *b, long nb, int bweighted,
+                                       double compression)
+{
+  double total = 0, done = 0, limit;
+  long i, j, n = 0;
+
+  for(i = 0; i < na; i++)
+    total += a[2*i+1];
+  if(bweighted)
+    for(j = 0; j < nb; j++)
+      total += b[2*j+1];
+  else
+    total += nb;
+
+  limit = THTensor_(tdigestLimit)(0, compression);
+  i = j = 0;
+  while(i < na || j < nb)
+  {
+    double mean, weight;
+    double bmean = (j < nb ? (bweighted ? b[2*j] : b[j]) : 0);
+    if(j >= nb || (i < na && a[2*i] <= bmean))
+    {
+      mean = a[2*i];
+      weight = a[2*i+1];
+      i++;
+    }
+    else
+    {
+      mean = bmean;
+      weight = (bweighted ? b[2*j+1] : 1);
+      j++;
+    }
+
+    if(n > 0 && (done + out[2*n-1] + weight) <= limit*total)
+    {
+      out[2*n-1] += weight;
+      out[2*n-2] += (mean - out[2*n-2]) * weight / out[2*n-1];
+    }
+    else
+    {
+      if(n > 0)
+      {
+        done += out[2*n-1];
+        limit = THTensor_(tdigestLimit)(done/total, compression);
+      }
+      out[2*n] = mean;
+      out[2*n+1] = weight;
+      n++;
+    }
+  }
+  return n;
+}
+
+static void THTensor_(tdigestSet)(THDoubleTensor *centroids, double *rows, long n)
+{
+  THDoubleTensor_resize2d(centroids, n, 2);
+  memcpy(THDoubleTensor_data(centroids), rows, 2*n*sizeof(double));
+}
+
+void THTensor_(tdigestAdd)(THTensor *src, THDoubleTensor *centroids, THDoubleTensor *range, double compression)
+{
+  ptrdiff_t n = THTensor_(nElement)(src);
+  ptrdiff_t m = 0;
+  long nc = (centroids->nDimension == 2 ? centroids->size[0] : 0);
+  double *values, *rows, *r;
+  real *sorted;
+  long *idx;
+  ptrdiff_t i;
+
+  THArgCheck(nc == 0 || (centroids->size[1] == 2 && THDoubleTensor_isContiguous(centroids)), 2,
+             "centroids must be a contiguous n x 2 tensor");
+  THArgCheck(THDoubleTensor_nElement(range) == 2 && THDoubleTensor_isContiguous(range), 3,
+             "range must be a contiguous tensor of 2 elements");
+  THArgCheck(compression >= 1, 4, "compression must be at least 1");
+  if(n == 0)
+    return;
+
+  /* NaNs are left out; the rest is sorted in its own type, and the
+     conversion to double keeps the order */
+  sorted = THAlloc(n*sizeof(real));
+  TH_TENSOR_APPLY(real, src,
+                  if(*src_data == *src_data)
+                    sorted[m++] = *src_data;);
+  if(m == 0)
+  {
+    THFree(sorted);
+    return;
+  }
+  idx = THAlloc(m*sizeof(long));
+  for(i = 0; i < m; i++)
+    idx[i] = i;
+  THTensor_(quicksortascend)(sorted, idx, m, 1);
+  THFree(idx);
+  values = THAlloc(m*sizeof(double));
+  for(i = 0; i < m; i++)
+    values[i] = (double)sorted[i];
+  THFree(sorted);
+
+  r = THDoubleTensor_data(range);
+  r[0] = THMin(r[0], values[0]);
+  r[1] = THMax(r[1], values[m-1]);
+
+  rows = THAlloc(2*(nc+m)*sizeof(double));
+  nc = THTensor_(tdigestCompress)(rows, (nc > 0 ? THDoubleTensor_data(centroids) : NULL), nc,
+                                  values, m, 0, compression);
+  THTensor_(tdigestSet)(centroids, rows, nc);
+  THFree(rows);
+  THFree(values);
+}
+
+#if defined(TH_REAL_IS_DOUBLE)
+void THTensor_(tdigestMerge)(THTensor *centroids, THTensor *other, double compression)
+{
+  long na = (centroids->nDimension == 2 ? centroids->size[0] : 0);
+  long nb = (other->nDimension == 2 ? other->size[0] : 0);
+  double *rows;
+
+  THArgCheck(na == 0 || (centroids->size[1] == 2 && THTensor_(isContiguous)(centroids)), 1,
+             "centroids must be a contiguous n x 2 tensor");
+  THArgCheck(nb == 0 || (other->size[1] == 2 && THTensor_(isContiguous)(other)), 2,
+             "centroids must be a contiguous n x 2 tensor");
+  THArgCheck(compression >= 1, 3, "compression must be at least 1");
+  if(nb == 0)
+    return;
+
+  rows = THAlloc(2*(na+nb)*sizeof(double));
+  na = THTensor_(tdigestCompress)(rows, (na > 0 ? THTensor_(data)(centroids) : NULL), na,
+                                  THTensor_(data)(other), nb, 1, compression);
+  THTensor_(tdigestSet)(centroids, rows, na);
+  THFree(rows);
+}
+#endif
+
+/* equal values hash equally whatever their type: they are hashed as doubles,
+   except for longs which a double cannot represent exactly */
+static inline uint64_t THTensor_(hyperLogLogHash)(real value)
+{
+  double d = (double)value;
+  uint64_t h;
+
+  if(d == 0)
+    d = 0; /* -0 */
+  else if(d != d)
+    d = NAN;
+  memcpy(&h, &d, sizeof(h));
+#if defined(TH_REAL_IS_LONG)
+  if((long long)value > ((long long)1 << 53) || (long long)value < -((long long)1 << 53))
+    h = (uint64_t)value;
+#endif
+
+  /* splitmix64 finalizer */
+  h += 0x9e3779b97f4a7c15ULL;
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+  return h ^ (h >> 31);
+}
+
+/* the first p bits of the hash select a register, which keeps the largest
+   position of the first 1 bit among the remaining bits */
+static inline void THTensor_(hyperLogLogUpdate)(unsigned char *registers, int p, real value)
+{
+  uint64_t h = THTensor_(hyperLogLogHash)(value);
+  uint64_t w = (h << p) | ((uint64_t)1 << (p-1));
+  unsigned char rank = 1;
+  unsigned char *reg = registers + (h >> (64-p));
+
+  while(!(w & ((uint64_t)1 << 63)))
+  {
+    w <<= 1;
+    rank++;
+  }
+  if(rank > *reg)
+    *reg = rank;
+}
+
+void THTensor_(hyperLogLogAdd)(THTensor *src, THByteTensor *registers)
+{
+  ptrdiff_t m = THByteTensor_nElement(registers);
+  unsigned char *r = THByteTensor_data(registers);
+  int p = 0;
+
+  while(((ptrdiff_t)1 << p) < m)
+    p++;
+  THArgCheck(THByteTensor_isContiguous(registers) && m == ((ptrdiff_t)1 << p) && p >= 4 && p <= 18, 2,
+             "registers must be a contiguous tensor of 2^p elements, with 4 <= p <= 18");
+
+#ifdef _OPENMP
+  if(THTensor_(isContiguous)(src) && THTensor_(nElement)(src) > TH_OMP_OVERHEAD_THRESHOLD &&
+     omp_get_max_threads() > 1 && !omp_in_parallel())
+  {
+    /* each thread fills its own registers, merged afterwards */
+    int nthreads = omp_get_max_threads();
+    unsigned char *local = THAlloc(nthreads*m);
+    real *data = THTensor_(data)(src);
+    ptrdiff_t n = THTensor_(nElement)(src);
+    ptrdiff_t i;
+    int t;
+
+    memset(local, 0, nthreads*m);
+    #pragma omp parallel num_threads(nthreads) private(i)
+    {
+      unsigned char *mine = local + omp_get_thread_num()*m;
+      #pragma omp for
+      for(i = 0; i < n; i++)
+        THTensor_(hyperLogLogUpdate)(mine, p, data[i]);
+    }
+    for(t = 0; t < nthreads; t++)
+      for(i = 0; i < m; i++)
+        if(local[t*m+i] > r[i])
+          r[i] = local[t*m+i];
+    THFree(local);
+    return;
+  }
+#endif
+
+  TH_TENSOR_APPLY(real, src, THTensor_(hyperLogLogUpdate)(r, p, *src_data););
+}
+
+/* values compare as usual, NaNs being equal to each other and greater than
+   everything else */
+static inline int THTensor_(uniqueEqual)(real a, real b)
+{
+  return a == b || (th_isnan(a) && th_isnan(b));
+}
+
+static int THTensor_(uniqueCompare)(real a, real b)
+{
+  if (a < b)
+    return -1;
+  if (a > b)
+    return 1;
+  return (th_isnan(a) != 0) - (th_isnan(b) != 0);
+}
+
+/* sorts arr along with idx, NaNs last */
+static void THTensor_(uniqueSort)(real *arr, long *idx, long n)
+{
+  long i, m = n, swap;
+  real rswap;
+
+  /* the quicksort does not order NaNs: move them to the end first */
+  for (i = 0; i < m; i++) {
+    if (th_isnan(arr[i])) {
+      m--;
+      rswap = arr[i]; arr[i] = arr[m]; arr[m] = rswap;
+      swap = idx[i]; idx[i] = idx[m]; idx[m] = swap;
+      i--;
+    }
+  }
+  if (m > 1)
+    THTensor_(quicksortascend)(arr, idx, m, 1);
+}
+
+/* estimates the number of distinct values among the n elements of data from
+   the repeats in a sample: among s elements drawn from d equally frequent
+   values, about s^2/2d pairs are equal */
+#define TH_UNIQUE_SAMPLE 4096
+
+static long THTensor_(uniqueCardinality)(real *data, long n)
+{
+  long s = THMin(n, TH_UNIQUE_SAMPLE), capacity = 2*TH_UNIQUE_SAMPLE, d = 0, i;
+  real *keys = (real *)THAlloc(capacity * sizeof(real));
+  unsigned char *used = (unsigned char *)THAlloc(capacity);
+
+  memset(used, 0, capacity);
+  for (i = 0; i < s; i++) {
+    /* scattered positions, so that sorted data is sampled fairly */
+    real v = data[s == n ? i : (long)(((uint64_t)(i + 1) * 0x9e3779b97f4a7c15ULL) % (uint64_t)n)];
+    uint64_t h = THTensor_(hyperLogLogHash)(v) & (capacity - 1);
+    while (used[h] && !THTensor_(uniqueEqual)(keys[h], v))
+      h = (h + 1) & (capacity - 1);
+    if (!used[h]) {
+      used[h] = 1;
+      keys[h] = v;
+      d++;
+    }
+  }
+  THFree(used);
+  THFree(keys);
+
+  if (s == n)
+    return d;
+  if (d == s)
+    return n;
+  return THMin(n, (long)((double)s * s / (2 * (s - d))));
+}
+
+/* one pass over data, numbering the values in the order they first appear:
+   values[k] is the k-th value and count[k] its number of occurrences. Returns
+   the number of distinct values; the arrays are reallocated as they grow */
+static long THTensor_(uniqueHash)(real *data, long n, long *inv, real **values, long **count, long expected)
+{
+  long capacity = 64, d = 0, i, j;
+  long *slots;
+
+  while (capacity < 2 * expected && capacity < 2 * n)
+    capacity *= 2;
+  slots = (long *)THAlloc(capacity * sizeof(long));
+  for (j = 0; j < capacity; j++)
+    slots[j] = -1;
+  *values = (real *)THAlloc(capacity / 2 * sizeof(real));
+  *count = (long *)THAlloc(capacity / 2 * sizeof(long));
+
+  for (i = 0; i < n; i++) {
+    real v = data[i];
+    uint64_t h;
+    long k;
+    /* keep the table at most half full: grow it before a new value could
+       take the last entry of values and count */
+    if (d >= capacity / 2) {
+      capacity *= 2;
+      THFree(slots);
+      slots = (long *)THAlloc(capacity * sizeof(long));
+      for (j = 0; j < capacity; j++)
+        slots[j] = -1;
+      for (j = 0; j < d; j++) {
+        uint64_t g = THTensor_(hyperLogLogHash)((*values)[j]) & (capacity - 1);
+        while (slots[g] >= 0)
+          g = (g + 1) & (capacity - 1);
+        slots[g] = j;
+      }
+      *values = (real *)THRealloc(*values, capacity / 2 * sizeof(real));
+      *count = (long *)THRealloc(*count, capacity / 2 * sizeof(long));
+    }
+    h = THTensor_(hyperLogLogHash)(v) & (capacity - 1);
+    while ((k = slots[h]) >= 0 && !THTensor_(uniqueEqual)((*values)[k], v))
+      h = (h + 1) & (capacity - 1);
+    if (k < 0) {
+      k = d++;
+      (*values)[k] = v;
+      (*count)[k] = 0;
+      slots[h] = k;
+    }
+    (*count)[k]++;
+    if (inv)
+      inv[i] = k;
+  }
+  THFree(slots);
+  return d;
+}
+
+void THTensor_(unique)(THTensor *r_, THLongTensor *inverse, THLongTensor *counts, THTensor *src, int sorted)
+{
+  THTensor *r;
+  THLongTensor *inv = NULL;
+  real *data, *values;
+  long *invData = NULL, *count;
+  long n, d, i, expected;
+
+  src = THTensor_(newContiguous)(src);
+  data = THTensor_(data)(src);
+  n = THTensor_(nElement)(src);
+  if (inverse) {
+    THLongStorage *size = THTensor_(newSizeOf)(src);
+    THLongTensor_resize(inverse, size, NULL);
+    THLongStorage_free(size);
+    inv = THLongTensor_newContiguous(inverse);
+    invData = THLongTensor_data(inv);
+  }
+
+  expected = THTensor_(uniqueCardinality)(data, n);
+  if (!sorted || 4 * expected <= n) {
+    /* repeated values (or no order): hash the elements, then sort the
+       distinct values only */
+    d = THTensor_(uniqueHash)(data, n, invData, &values, &count, expected);
+    if (sorted && d > 1) {
+      long *order = (long *)THAlloc(d * sizeof(long));
+      long *rank = (long *)THAlloc(d * sizeof(long));
+      long *sortedCount = (long *)THAlloc(d * sizeof(long));
+      for (i = 0; i < d; i++)
+        order[i] = i;
+      THTensor_(uniqueSort)(values, order, d);
+      for (i = 0; i < d; i++) {
+        rank[order[i]] = i;
+        sortedCount[i] = count[order[i]];
+      }
+      if (invData)
+        for (i = 0; i < n; i++)
+          invData[i] = rank[invData[i]];
+      THFree(count);
+      count = sortedCount;
+      THFree(rank);
+      THFree(order);
+    }
+  } else {
+    /* mostly distinct values: sort all of them, equal values are then
+       adjacent */
+    long *order = (long *)THAlloc(n * sizeof(long));
+    values = (real *)THAlloc(n * sizeof(real));
+    count = (long *)THAlloc(n * sizeof(long));
+    for (i = 0; i < n; i++) {
+      values[i] = data[i];
+      order[i] = i;
+    }
+    THTensor_(uniqueSort)(values, order, n);
+    d = 0;
+    for (i = 0; i < n; i++) {
+      if (i == 0 || !THTensor_(uniqueEqual)(values[i], values[d-1])) {
+        values[d] = values[i];
+        count[d++] = 0;
+      }
+      count[d-1]++;
+      if (invData)
+        invData[order[i]] = d-1;
+    }
+    THFree(order);
+  }
+
+  THTensor_(resize1d)(r_, d);
+  r = THTensor_(newContiguous)(r_);
+  memcpy(THTensor_(data)(r), values, d * sizeof(real));
+  THTensor_(freeCopyTo)(r, r_);
+  if (counts) {
+    THLongTensor *c;
+    THLongTensor_resize1d(counts, d);
+    c = THLongTensor_newContiguous(counts);
+    memcpy(THLongTensor_data(c), count, d * sizeof(long));
+    THLongTensor_freeCopyTo(c, counts);
+  }
+
+  THFree(values);
+  THFree(count);
+  if (inv)
+    THLongTensor_freeCopyTo(inv, inverse);
+  THTensor_(free)(src);
+}
+
+/* lexicographic order of rows, NaNs being greater than everything */
+static int THTensor_(uniqueCompareRows)(real *data, long rowSize, long a, long b)
+{
+  long k;
+  for (k = 0; k < rowSize; k++) {
+    int c = THTensor_(uniqueCompare)(data[a*rowSize+k], data[b*rowSize+k]);
+    if (c)
+      return c;
+  }
+  return 0;
+}
+
+/* stable merge sort of the row numbers idx by the rows they point to */
+static void THTensor_(uniqueSortRows)(long *idx, long *tmp, long m, real *data, long rowSize)
+{
+  long width, i;
+
+  for (width = 1; width < m; width *= 2) {
+    for (i = 0; i < m; i += 2 * width) {
+      long lo = i, mid = THMin(i + width, m), hi = THMin(i + 2 * width, m);
+      long a = lo, b = mid, k = lo;
+      while (a < mid && b < hi)
+        tmp[k++] = (THTensor_(uniqueCompareRows)(data, rowSize, idx[b], idx[a]) < 0 ? idx[b++] : idx[a++]);
+      while (a < mid)
+        tmp[k++] = idx[a++];
+      while (b < hi)
+        tmp[k++] = idx[b++];
+    }
+    memcpy(idx, tmp, m * sizeof(long));
+  }
+}
+
+void THTensor_(uniqueDim)(THTensor *r_, THLongTensor *inverse, THLongTensor *counts, THTensor *src, int dimension)
+{
+  THTensor *rows;
+  THLongTensor *first;
+  real *data;
+  long *idx, *tmp, *invData, *countData, *firstData;
+  long m, rowSize, d, i;
+
+  THArgCheck(dimension >= 0 && dimension < src->nDimension, 5, "dimension %d out of range",
+             dimension + TH_INDEX_BASE);
+
+  /* the slices along dimension, as contiguous rows */
+  {
+    THTensor *transposed = THTensor_(newTranspose)(src, 0, dimension);
+    rows = THTensor_(newContiguous)(transposed);
+    THTensor_(free)(transposed);
+  }
+  data = THTensor_(data)(rows);
+  m = rows->size[0];
+  rowSize = (m > 0 ? THTensor_(nElement)(rows) / m : 0);
+
+  idx = (long *)THAlloc(m * sizeof(long));
+  tmp = (long *)THAlloc(m * sizeof(long));
+  for (i = 0; i < m; i++)
+    idx[i] = i;
+  THTensor_(uniqueSortRows)(idx, tmp, m, data, rowSize);
+
+  THLongTensor_resize1d(inverse, m);
+  invData = THLongTensor_data(inverse);
+  first = THLongTensor_newWithSize1d(m);
+  firstData = THLongTensor_data(first);
+  countData = tmp;
+  d = 0;
+  for (i = 0; i < m; i++) {
+    if (i == 0 || THTensor_(uniqueCompareRows)(data, rowSize, idx[i], firstData[d-1] - TH_INDEX_BASE)) {
+      firstData[d] = idx[i] + TH_INDEX_BASE;
+      countData[d++] = 0;
+    }
+    countData[d-1]++;
+    invData[idx[i] * inverse->stride[0]] = d-1;
+  }
+
+  THLongTensor_resize1d(first, d);
+  THTensor_(indexSelect)(r_, src, dimension, first);
+  THLongTensor_resize1d(counts, d);
+  for (i = 0; i < d; i++)
+    THLongTensor_set1d(counts, i, countData[i]);
+
+  THLongTensor_free(first);
+  THFree(tmp);
+  THFree(idx);
+  THTensor_(free)(rows);
+}
+
 /* floating point only now */
 #if defined(TH_REAL_IS_FLOAT) || defined(TH_REAL_IS_DOUBLE)
 
@@ -2894,8 +4208,11 @@ TENSOR_IMPLEMENT_LOGICAL_SUM(logicalany, ||, 0)
 LAB_IMPLEMENT_BASIC_FUNCTION(log,TH_MATH_NAME(log))
 LAB_IMPLEMENT_BASIC_FUNCTION(lgamma,TH_MATH_NAME(lgamma))
 LAB_IMPLEMENT_BASIC_FUNCTION(log1p,TH_MATH_NAME(log1p))
+LAB_IMPLEMENT_BASIC_FUNCTION(log2,TH_MATH_NAME(log2))
 LAB_IMPLEMENT_BASIC_FUNCTION(sigmoid,TH_MATH_NAME(TH_sigmoid))
 LAB_IMPLEMENT_BASIC_FUNCTION(exp,TH_MATH_NAME(exp))
+LAB_IMPLEMENT_BASIC_FUNCTION(expm1,TH_MATH_NAME(expm1))
+LAB_IMPLEMENT_BASIC_FUNCTION(exp2,TH_MATH_NAME(exp2))
 LAB_IMPLEMENT_BASIC_FUNCTION(cos,TH_MATH_NAME(cos))
 LAB_IMPLEMENT_BASIC_FUNCTION(acos,TH_MATH_NAME(acos))
 LAB_IMPLEMENT_BASIC_FUNCTION(cosh,TH_MATH_NAME(cosh))
@@ -2952,6 +4269,34 @@ void THTensor_(atan2)(THTensor *r_, THTensor *tx, THTensor *ty)
   TH_TENSOR_APPLY3(real, r_, real, tx, real, ty, *r__data = TH_MATH_NAME(atan2)(*tx_data,*ty_data););
 }
 
+void THTensor_(logaddexp)(THTensor *r_, THTensor *a, THTensor *b)
+{
+  THArgCheck(THTensor_(nElement)(a) == THTensor_(nElement)(b), 2, "sizes do not match");
+  THTensor_(resizeAs)(r_, a);
+  if (THTensor_(isContiguous)(r_) && THTensor_(isContiguous)(a) && THTensor_(isContiguous)(b)) {
+    TH_TENSOR_APPLY3_CONTIG(real, r_, real, a, real, b,
+      ptrdiff_t i;
+      for (i = 0; i < r__len; i++)
+        r__data[i] = TH_MATH_NAME(TH_logaddexpFast)(a_data[i], b_data[i]););
+  } else {
+    TH_TENSOR_APPLY3(real, r_, real, a, real, b, *r__data = TH_MATH_NAME(TH_logaddexp)(*a_data, *b_data););
+  }
+}
+
+void THTensor_(logsubexp)(THTensor *r_, THTensor *a, THTensor *b)
+{
+  THArgCheck(THTensor_(nElement)(a) == THTensor_(nElement)(b), 2, "sizes do not match");
+  THTensor_(resizeAs)(r_, a);
+  if (THTensor_(isContiguous)(r_) && THTensor_(isContiguous)(a) && THTensor_(isContiguous)(b)) {
+    TH_TENSOR_APPLY3_CONTIG(real, r_, real, a, real, b,
+      ptrdiff_t i;
+      for (i = 0; i < r__len; i++)
+        r__data[i] = TH_MATH_NAME(TH_logsubexp)(a_data[i], b_data[i]););
+  } else {
+    TH_TENSOR_APPLY3(real, r_, real, a, real, b, *r__data = TH_MATH_NAME(TH_logsubexp)(*a_data, *b_data););
+  }
+}
+
 void THTensor_(lerp)(THTensor *r_, THTensor *a, THTensor *b, real weight)
 {
   THArgCheck(THTensor_(nElement)(a) == THTensor_(nElement)(b), 2, "sizes do not match");
@@ -3093,9 +4438,22 @@ void THTensor_(norm)(THTensor *r_, THTensor *t, real value, int dimension, int k
   }
 }
 
+IMPLEMENT_PAIRWISE_SUM(pairwiseAbsSum, real, TH_MATH_NAME(fabs)(x[i]))
+IMPLEMENT_PAIRWISE_SUM(pairwiseSquareSum, real, (accreal)x[i] * x[i])
+
 accreal THTensor_(normall)(THTensor *tensor, real value)
 {
   accreal sum = 0;
+  if ((value == 1 || value == 2) && THGetDeterministic() && THTensor_(isContiguous)(tensor)) {
+    real *tp = THTensor_(data)(tensor);
+    ptrdiff_t sz = THTensor_(nElement)(tensor);
+    if (value == 1) {
+      TH_BLOCKED_SUM(sum, sz, THTensor_(pairwiseAbsSum)(tp + block_offset, tp + block_offset, block_len));
+      return sum;
+    }
+    TH_BLOCKED_SUM(sum, sz, THTensor_(pairwiseSquareSum)(tp + block_offset, tp + block_offset, block_len));
+    return sqrt(sum);
+  }
   if(value == 0) {
     TH_TENSOR_APPLY(real, tensor, sum += *tensor_data != 0.0;);
     return sum;
@@ -3312,7 +4670,153 @@ void THTensor_(bhistc)(THTensor *hist, THTensor *tensor, long nbins, real minval
   );
 }
 
+
+/* Mixed-type arithmetic: the source is read in its own (narrower) type and
+   converted on the fly, so e.g. statistics over a ByteTensor do not need a
+   DoubleTensor copy of it. Sums are accumulated in accreal. */
+
+
+#define IMPLEMENT_THTensor_MIXED(TYPENAMESRC, TYPE_SRC, CONVERT)     \
+void THTensor_(sum##TYPENAMESRC)(THTensor *r_, TH##TYPENAMESRC##Tensor *t, int dimension, int keepdim) \
+{                                                                       \
+  THLongStorage *dim;                                                   \
+                                                                        \
+  THArgCheck(dimension >= 0 && dimension < TH##TYPENAMESRC##Tensor_nDimension(t), 2, \
+      "dimension %d out of range", dimension + TH_INDEX_BASE);          \
+                                                                        \
+  dim = TH##TYPENAMESRC##Tensor_newSizeOf(t);                           \
+  THLongStorage_set(dim, dimension, 1);                                 \
+  THTensor_(resize)(r_, dim, NULL);                                     \
+  THLongStorage_free(dim);                                              \
+                                                                        \
+  if (THTensor_(isContiguous)(r_) && TH##TYPENAMESRC##Tensor_isContiguous(t)) { \
+    /* t seen as outer x n x inner, one output per (outer, inner) pair */ \
+    TYPE_SRC *tp = TH##TYPENAMESRC##Tensor_data(t);                     \
+    real *rp = THTensor_(data)(r_);                                     \
+    ptrdiff_t nOutput = THTensor_(nElement)(r_);                        \
+    long n = t->size[dimension];                                        \
+    ptrdiff_t inner = 1;                                                \
+    ptrdiff_t p;                                                        \
+    int d;                                                              \
+    for (d = dimension+1; d < t->nDimension; d++)                       \
+      inner *= t->size[d];                                              \
+    PRAGMA(omp parallel for if(nOutput * n > TH_OMP_OVERHEAD_THRESHOLD) private(p)) \
+    for (p = 0; p < nOutput; p++) {                                     \
+      TYPE_SRC *tq = tp + (p / inner) * n * inner + p % inner;          \
+      accreal sum = 0;                                                  \
+      long i;                                                           \
+      for (i = 0; i < n; i++)                                           \
+        sum += CONVERT(tq[i*inner]);                                    \
+      rp[p] = (real)sum;                                                \
+    }                                                                   \
+  } else {                                                              \
+    TH_TENSOR_DIM_APPLY2(TYPE_SRC, t, real, r_, dimension,              \
+                         accreal sum = 0;                               \
+                         long i;                                        \
+                         for(i = 0; i < t_size; i++)                    \
+                           sum += CONVERT(t_data[i*t_stride]);          \
+                         *r__data = (real)sum;);                        \
+  }                                                                     \
+                                                                        \
+  if (!keepdim) {                                                       \
+    THTensor_(squeeze1d)(r_, r_, dimension);                            \
+  }                                                                     \
+}                                                                       \
+                                                                        \
+void THTensor_(mean##TYPENAMESRC)(THTensor *r_, TH##TYPENAMESRC##Tensor *t, int dimension, int keepdim) \
+{                                                                       \
+  THTensor_(sum##TYPENAMESRC)(r_, t, dimension, keepdim);               \
+  THTensor_(div)(r_, r_, t->size[dimension]);                           \
+}                                                                       \
+                                                                        \
+static accreal THTensor_(blockSum##TYPENAMESRC)(TYPE_SRC *x, ptrdiff_t n) \
+{                                                                       \
+  accreal sum = 0;                                                      \
+  ptrdiff_t i;                                                          \
+  for (i = 0; i < n; i++)                                               \
+    sum += CONVERT(x[i]);                                               \
+  return sum;                                                           \
+}                                                                       \
+                                                                        \
+accreal THTensor_(meanall##TYPENAMESRC)(TH##TYPENAMESRC##Tensor *t)     \
+{                                                                       \
+  ptrdiff_t n = TH##TYPENAMESRC##Tensor_nElement(t);                    \
+  accreal sum = 0;                                                      \
+  THArgCheck(t->nDimension > 0, 1, "empty Tensor");                     \
+  if (TH##TYPENAMESRC##Tensor_isContiguous(t) && THGetDeterministic()) { \
+    TYPE_SRC *tp = TH##TYPENAMESRC##Tensor_data(t);                     \
+    TH_BLOCKED_SUM(sum, n, THTensor_(blockSum##TYPENAMESRC)(tp + block_offset, block_len)); \
+  } else if (TH##TYPENAMESRC##Tensor_isContiguous(t)) {                 \
+    TYPE_SRC *tp = TH##TYPENAMESRC##Tensor_data(t);                     \
+    ptrdiff_t i;                                                        \
+    PRAGMA(omp parallel for if(n > TH_OMP_OVERHEAD_THRESHOLD) private(i) reduction(+:sum)) \
+    for (i = 0; i < n; i++)                                             \
+      sum += CONVERT(tp[i]);                                            \
+  } else {                                                              \
+    TH_TENSOR_APPLY(TYPE_SRC, t, sum += CONVERT(*t_data););             \
+  }                                                                     \
+  return sum / n;                                                       \
+}                                                                       \
+                                                                        \
+void THTensor_(cadd##TYPENAMESRC)(THTensor *r_, THTensor *t, real value, TH##TYPENAMESRC##Tensor *src) \
+{                                                                       \
+  THArgCheck(THTensor_(nElement)(t) == TH##TYPENAMESRC##Tensor_nElement(src), 4, "sizes do not match"); \
+  THTensor_(resizeAs)(r_, t);                                           \
+  if (THTensor_(isContiguous)(r_) && THTensor_(isContiguous)(t) && TH##TYPENAMESRC##Tensor_isContiguous(src)) { \
+    real *rp = THTensor_(data)(r_);                                     \
+    real *tp = THTensor_(data)(t);                                      \
+    TYPE_SRC *sp = TH##TYPENAMESRC##Tensor_data(src);                   \
+    ptrdiff_t sz = THTensor_(nElement)(r_);                             \
+    ptrdiff_t i;                                                        \
+    PRAGMA(omp parallel for if(sz > TH_OMP_OVERHEAD_THRESHOLD) private(i)) \
+    for (i = 0; i < sz; i++)                                            \
+      rp[i] = tp[i] + value * (real)CONVERT(sp[i]);                     \
+  } else {                                                              \
+    TH_TENSOR_APPLY3(real, r_, real, t, TYPE_SRC, src,                  \
+                     *r__data = *t_data + value * (real)CONVERT(*src_data););  \
+  }                                                                     \
+}                                                                       \
+                                                                        \
+void THTensor_(cmul##TYPENAMESRC)(THTensor *r_, THTensor *t, TH##TYPENAMESRC##Tensor *src) \
+{                                                                       \
+  THArgCheck(THTensor_(nElement)(t) == TH##TYPENAMESRC##Tensor_nElement(src), 3, "sizes do not match"); \
+  THTensor_(resizeAs)(r_, t);                                           \
+  if (THTensor_(isContiguous)(r_) && THTensor_(isContiguous)(t) && TH##TYPENAMESRC##Tensor_isContiguous(src)) { \
+    real *rp = THTensor_(data)(r_);                                     \
+    real *tp = THTensor_(data)(t);                                      \
+    TYPE_SRC *sp = TH##TYPENAMESRC##Tensor_data(src);                   \
+    ptrdiff_t sz = THTensor_(nElement)(r_);                             \
+    ptrdiff_t i;                                                        \
+    PRAGMA(omp parallel for if(sz > TH_OMP_OVERHEAD_THRESHOLD) private(i)) \
+    for (i = 0; i < sz; i++)                                            \
+      rp[i] = tp[i] * (real)CONVERT(sp[i]);                             \
+  } else {                                                              \
+    TH_TENSOR_APPLY3(real, r_, real, t, TYPE_SRC, src,                  \
+                     *r__data = *t_data * (real)CONVERT(*src_data););   \
+  }                                                                     \
+}
+
+#define TH_MIXED_CAST(x) (x)
+
+IMPLEMENT_THTensor_MIXED(Byte, unsigned char, TH_MIXED_CAST)
+IMPLEMENT_THTensor_MIXED(Char, char, TH_MIXED_CAST)
+IMPLEMENT_THTensor_MIXED(Short, short, TH_MIXED_CAST)
+IMPLEMENT_THTensor_MIXED(Int, int, TH_MIXED_CAST)
+IMPLEMENT_THTensor_MIXED(Half, THHalf, TH_half2float)
+#if defined(TH_REAL_IS_DOUBLE)
+IMPLEMENT_THTensor_MIXED(Long, long, TH_MIXED_CAST)
+IMPLEMENT_THTensor_MIXED(Float, float, TH_MIXED_CAST)
+#endif
+
+#undef TH_MIXED_CAST
+#undef IMPLEMENT_THTensor_MIXED
+
 #undef TH_MATH_NAME
 #endif /* floating point only part */
 #undef IS_NONZERO
+#undef TH_INT_DIVIDE
+#undef TH_INT_DIVIDE_BITS
+#undef TH_INT_DIVIDE_QUOTIENT
+#undef TH_INT_DIVIDE_FMOD
+#undef TH_INT_DIVIDE_REMAINDER
 #endif
@@ -21,6 +21,20 @@ TH_API void THTensor_(scatter)(THTensor *tensor, int dim, THLongTensor *index, T
 TH_API void THTensor_(scatterAdd)(THTensor *tensor, int dim, THLongTensor *index, THTensor *src);
 TH_API void THTensor_(scatterFill)(THTensor *tensor, int dim, THLongTensor *index, real val);
 
+/* reductions of the rows of src over the segments starting at offsets */
+TH_API void THTensor_(segmentSum)(THTensor *r_, THTensor *src, THLongTensor *offsets);
+TH_API void THTensor_(segmentMean)(THTensor *r_, THTensor *src, THLongTensor *offsets);
+TH_API void THTensor_(segmentMax)(THTensor *r_, THTensor *src, THLongTensor *offsets);
+TH_API void THTensor_(segmentMin)(THTensor *r_, THTensor *src, THLongTensor *offsets);
+/* mode: 0 for sum, 1 for mean, 2 for max of the rows of weight in each bag */
+TH_API void THTensor_(embeddingBag)(THTensor *r_, THTensor *weight, THLongTensor *indices, THLongTensor *offsets, int mode);
+TH_API void THTensor_(embeddingBagWeighted)(THTensor *r_, THTensor *weight, THLongTensor *indices, THLongTensor *offsets, THTensor *perSampleWeights);
+
+/* positions (from 0, like the indices of sort) at which values would be
+   inserted in the sorted rows, before the equal elements or after them if right */
+TH_API void THTensor_(searchsorted)(THLongTensor *r_, THTensor *sorted, THTensor *values, int right);
+TH_API void THTensor_(bucketize)(THLongTensor *r_, THTensor *values, THTensor *boundaries, int right);
+
 TH_API accreal THTensor_(dot)(THTensor *t, THTensor *src);
 
 TH_API real THTensor_(minall)(THTensor *t);
@@ -100,6 +114,7 @@ TH_API void THTensor_(range)(THTensor *r_, accreal xmin, accreal xmax, accreal s
 TH_API void THTensor_(randperm)(THTensor *r_, THGenerator *_generator, long n);
 
 TH_API void THTensor_(reshape)(THTensor *r_, THTensor *t, THLongStorage *size);
+TH_API void THTensor_(repeat)(THTensor *r_, THTensor *t, THLongStorage *size);
 TH_API void THTensor_(sort)(THTensor *rt_, THLongTensor *ri_, THTensor *t, int dimension, int descendingOrder);
 TH_API void THTensor_(topk)(THTensor *rt_, THLongTensor *ri_, THTensor *t, long k, int dim, int dir, int sorted);
 TH_API void THTensor_(tril)(THTensor *r_, THTensor *t, long k);
@@ -107,6 +122,16 @@ TH_API void THTensor_(triu)(THTensor *r_, THTensor *t, long k);
 TH_API void THTensor_(cat)(THTensor *r_, THTensor *ta, THTensor *tb, int dimension);
 TH_API void THTensor_(catArray)(THTensor *result, THTensor **inputs, int numInputs, int dimension);
 
+TH_API void THTensor_(tdigestAdd)(THTensor *src, THDoubleTensor *centroids, THDoubleTensor *range, double compression);
+TH_API void THTensor_(hyperLogLogAdd)(THTensor *src, THByteTensor *registers);
+
+/* distinct values of src, sorted or in the order they appear, with the
+   position in r_ of each element (from 0) and the number of occurrences of
+   each value, which unique does not compute if NULL; uniqueDim compares the
+   slices along dimension, and sorts them */
+TH_API void THTensor_(unique)(THTensor *r_, THLongTensor *inverse, THLongTensor *counts, THTensor *src, int sorted);
+TH_API void THTensor_(uniqueDim)(THTensor *r_, THLongTensor *inverse, THLongTensor *counts, THTensor *src, int dimension);
+
 TH_API int THTensor_(equal)(THTensor *ta, THTensor *tb);
 
 TH_API void THTensor_(ltValue)(THByteTensor *r_, THTensor* t, real value);
@@ -141,13 +166,24 @@ TH_API void THTensor_(eqTensorT)(THTensor *r_, THTensor *ta, THTensor *tb);
 TH_API void THTensor_(abs)(THTensor *r_, THTensor *t);
 #endif
 
+#if defined(TH_REAL_IS_LONG)
+TH_API void THTensor_(segmentOffsets)(THTensor *offsets, THTensor *ids, long nsegments);
+#endif
+
+#if defined(TH_REAL_IS_CHAR)
+TH_API void THTensor_(mmInt)(THIntTensor *r_, THTensor *m1, THTensor *m2);
+#endif
+
 #if defined(TH_REAL_IS_FLOAT) || defined(TH_REAL_IS_DOUBLE)
 
 TH_API void THTensor_(sigmoid)(THTensor *r_, THTensor *t);
 TH_API void THTensor_(log)(THTensor *r_, THTensor *t);
 TH_API void THTensor_(lgamma)(THTensor *r_, THTensor *t);
 TH_API void THTensor_(log1p)(THTensor *r_, THTensor *t);
+TH_API void THTensor_(log2)(THTensor *r_, THTensor *t);
 TH_API void THTensor_(exp)(THTensor *r_, THTensor *t);
+TH_API void THTensor_(expm1)(THTensor *r_, THTensor *t);
+TH_API void THTensor_(exp2)(THTensor *r_, THTensor *t);
 TH_API void THTensor_(cos)(THTensor *r_, THTensor *t);
 TH_API void THTensor_(acos)(THTensor *r_, THTensor *t);
 TH_API void THTensor_(cosh)(THTensor *r_, THTensor *t);
@@ -168,6 +204,8 @@ TH_API void THTensor_(round)(THTensor *r_, THTensor *t);
 TH_API void THTensor_(abs)(THTensor *r_, THTensor *t);
 TH_API void THTensor_(trunc)(THTensor *r_, THTensor *t);
 TH_API void THTensor_(frac)(THTensor *r_, THTensor *t);
+TH_API void THTensor_(logaddexp)(THTensor *r_, THTensor *a, THTensor *b);
+TH_API void THTensor_(logsubexp)(THTensor *r_, THTensor *a, THTensor *b);
 TH_API void THTensor_(lerp)(THTensor *r_, THTensor *a, THTensor *b, real weight);
 
 TH_API void THTensor_(mean)(THTensor *r_, THTensor *t, int dimension, int keepdim);
@@ -184,12 +222,37 @@ TH_API accreal THTensor_(varall)(THTensor *self, int biased);
 TH_API accreal THTensor_(stdall)(THTensor *self, int biased);
 TH_API accreal THTensor_(normall)(THTensor *t, real value);
 
+/* Mixed-type arithmetic, reading a narrower source type */
+
+#define TH_DECLARE_MIXED(TYPENAMESRC) \
+TH_API void THTensor_(sum##TYPENAMESRC)(THTensor *r_, struct TH##TYPENAMESRC##Tensor *t, int dimension, int keepdim); \
+TH_API void THTensor_(mean##TYPENAMESRC)(THTensor *r_, struct TH##TYPENAMESRC##Tensor *t, int dimension, int keepdim); \
+TH_API accreal THTensor_(meanall##TYPENAMESRC)(struct TH##TYPENAMESRC##Tensor *t); \
+TH_API void THTensor_(cadd##TYPENAMESRC)(THTensor *r_, THTensor *t, real value, struct TH##TYPENAMESRC##Tensor *src); \
+TH_API void THTensor_(cmul##TYPENAMESRC)(THTensor *r_, THTensor *t, struct TH##TYPENAMESRC##Tensor *src);
+
+TH_DECLARE_MIXED(Byte)
+TH_DECLARE_MIXED(Char)
+TH_DECLARE_MIXED(Short)
+TH_DECLARE_MIXED(Int)
+TH_DECLARE_MIXED(Half)
+#if defined(TH_REAL_IS_DOUBLE)
+TH_DECLARE_MIXED(Long)
+TH_DECLARE_MIXED(Float)
+#endif
+
+#undef TH_DECLARE_MIXED
+
 TH_API void THTensor_(linspace)(THTensor *r_, real a, real b, long n);
 TH_API void THTensor_(logspace)(THTensor *r_, real a, real b, long n);
 TH_API void THTensor_(rand)(THTensor *r_, THGenerator *_generator, THLongStorage *size);
 TH_API void THTensor_(randn)(THTensor *r_, THGenerator *_generator, THLongStorage *size);
 #endif
 
+#if defined(TH_REAL_IS_DOUBLE)
+TH_API void THTensor_(tdigestMerge)(THTensor *centroids, THTensor *other, double compression);
+#endif
+
 #if defined(TH_REAL_IS_BYTE)
 
 TH_API int THTensor_(logicalall)(THTensor *self);
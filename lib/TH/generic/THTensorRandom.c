@@ -40,7 +40,33 @@ void THTensor_(geometric)(THTensor *self, THGenerator *_generator, double p)
 
 void THTensor_(bernoulli)(THTensor *self, THGenerator *_generator, double p)
 {
-  TH_TENSOR_APPLY(real, self, *self_data = (real)THRandom_bernoulli(_generator, p););
+  ptrdiff_t n = THTensor_(nElement)(self);
+  unsigned char *mask;
+  ptrdiff_t i;
+
+#if defined(TH_REAL_IS_BYTE)
+  if(THTensor_(isContiguous)(self))
+  {
+    THRandom_bernoulliMask(_generator, p, THTensor_(data)(self), n);
+    return;
+  }
+#endif
+
+  mask = THAlloc(n);
+  THRandom_bernoulliMask(_generator, p, mask, n);
+  if(THTensor_(isContiguous)(self))
+  {
+    real *self_data = THTensor_(data)(self);
+    #pragma omp parallel for if(n > TH_OMP_OVERHEAD_THRESHOLD) private(i)
+    for(i = 0; i < n; i++)
+      self_data[i] = (real)mask[i];
+  }
+  else
+  {
+    i = 0;
+    TH_TENSOR_APPLY(real, self, *self_data = (real)mask[i++];);
+  }
+  THFree(mask);
 }
 
 void THTensor_(bernoulli_FloatTensor)(THTensor *self, THGenerator *_generator, THFloatTensor *p)
@@ -103,6 +129,51 @@ void THTensor_(logNormal)(THTensor *self, THGenerator *_generator, double mean,
   TH_TENSOR_APPLY(real, self, *self_data = (real)THRandom_logNormal(_generator, mean, stdv););
 }
 
+/* float and double only, like the rest of this block: the 1/(1-p) scale
+   would be truncated by an integer type */
+void THTensor_(dropout)(THTensor *r_, THGenerator *_generator, THTensor *t, double p, THByteTensor *mask)
+{
+  ptrdiff_t n = THTensor_(nElement)(t);
+  real scale;
+  unsigned char *mask_data;
+  ptrdiff_t i;
+
+  THArgCheck(p >= 0 && p < 1, 4, "dropout probability must be >= 0 and < 1");
+  scale = (real)(1/(1-p));
+
+  THTensor_(resizeAs)(r_, t);
+  if(mask)
+  {
+    THLongStorage *size = THTensor_(newSizeOf)(t);
+    THByteTensor_resize(mask, size, NULL);
+    THLongStorage_free(size);
+    THArgCheck(THByteTensor_isContiguous(mask), 5, "mask must be contiguous");
+    mask_data = THByteTensor_data(mask);
+  }
+  else
+    mask_data = THAlloc(n);
+
+  /* elements are kept with probability 1-p */
+  THRandom_bernoulliMask(_generator, 1-p, mask_data, n);
+
+  if(THTensor_(isContiguous)(r_) && THTensor_(isContiguous)(t))
+  {
+    real *r__data = THTensor_(data)(r_);
+    real *t_data = THTensor_(data)(t);
+    #pragma omp parallel for if(n > TH_OMP_OVERHEAD_THRESHOLD) private(i)
+    for(i = 0; i < n; i++)
+      r__data[i] = t_data[i] * (mask_data[i] * scale);
+  }
+  else
+  {
+    i = 0;
+    TH_TENSOR_APPLY2(real, r_, real, t, *r__data = *t_data * (mask_data[i++] * scale););
+  }
+
+  if(!mask)
+    THFree(mask_data);
+}
+
 
 void THTensor_(multinomialAliasSetup)(THTensor *probs, THLongTensor *J, THTensor *q)
 {
@@ -11,7 +11,9 @@ TH_API void THVector_(cdiv)(real *z, const real *x, const real *y, const ptrdiff
 TH_API void THVector_(divs)(real *y, const real *x, const real c, const ptrdiff_t n);
 TH_API void THVector_(copy)(real *y, const real *x, const ptrdiff_t n);
 
-/* Initialize the dispatch pointers */
+/* Initialize the dispatch pointers, following the "vector.<op>.<Real>" tuning parameters */
 TH_API void THVector_(vectorDispatchInit)(void);
+/* SIMD extension of the implementation selected for op ("cadd", ...), or -1 for an unknown op */
+TH_API int THVector_(vectorDispatchSelected)(const char *op);
 
 #endif
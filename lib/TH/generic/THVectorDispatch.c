@@ -244,7 +244,8 @@ void THVector_(copy)(real *y, const real *x, const ptrdiff_t n) {
  * to choose the best function.
  * NOTE: As implemented, it will initialize the dispatch pointer to the first supported function.
  *       This means that in the dispatch tables, implementations supporting more recent extensions
- *       need to come first
+ *       need to come first. A tuning parameter can select another supported function (see THTune.h),
+ *       and calling this again applies changes to the tuning parameters.
  */
 void THVector_(vectorDispatchInit)(void)
 {
@@ -259,4 +260,17 @@ void THVector_(vectorDispatchInit)(void)
   INIT_DISPATCH_PTR(copy);
 }
 
+int THVector_(vectorDispatchSelected)(const char *op)
+{
+  DISPATCH_SELECTED(fill);
+  DISPATCH_SELECTED(cadd);
+  DISPATCH_SELECTED(adds);
+  DISPATCH_SELECTED(cmul);
+  DISPATCH_SELECTED(muls);
+  DISPATCH_SELECTED(cdiv);
+  DISPATCH_SELECTED(divs);
+  DISPATCH_SELECTED(copy);
+  return -1;
+}
+
 #endif
@@ -20,15 +20,37 @@
       .supportedSimdExt=EXT      \
     }
 
+/* Picks the first implementation supported by the host, unless the tuning
+ * parameter "vector.<op>.<Real>" asks for a given SIMD extension (0 for the
+ * default C implementation) which the host supports.
+ * The default implementation must come last in the table. */
 #define INIT_DISPATCH_PTR(OP)    \
   do {                           \
     int i;                       \
-    for (i = 0; i < sizeof(THVector_(OP ## _DISPATCHTABLE)) / sizeof(FunctionDescription); ++i) { \
-      THVector_(OP ## _DISPATCHPTR) = THVector_(OP ## _DISPATCHTABLE)[i].function;                     \
-      if (THVector_(OP ## _DISPATCHTABLE)[i].supportedSimdExt & hostSimdExts) {                       \
-        break;                                                                                     \
-      }                                                                                            \
-    }                                                                                              \
+    int n = sizeof(THVector_(OP ## _DISPATCHTABLE)) / sizeof(FunctionDescription);                      \
+    long tuned = THTuneGet("vector." #OP "." TH_CONCAT_STRING_2(Real,), -1);                           \
+    for (i = 0; i < n - 1; ++i) {                                                                      \
+      uint32_t ext = THVector_(OP ## _DISPATCHTABLE)[i].supportedSimdExt;                              \
+      if ((ext & hostSimdExts) && (tuned < 0 || ext == (uint32_t)tuned)) {                             \
+        break;                                                                                         \
+      }                                                                                                \
+    }                                                                                                  \
+    if (i == n - 1 && tuned > 0) {                                                                     \
+      for (i = 0; i < n - 1 && !(THVector_(OP ## _DISPATCHTABLE)[i].supportedSimdExt & hostSimdExts); ++i); \
+    }                                                                                                  \
+    THVector_(OP ## _DISPATCHPTR) = THVector_(OP ## _DISPATCHTABLE)[i].function;                       \
+  } while(0)
+
+#define DISPATCH_SELECTED(OP)    \
+  do {                           \
+    int i;                       \
+    if (strcmp(op, #OP) == 0) {  \
+      for (i = 0; i < sizeof(THVector_(OP ## _DISPATCHTABLE)) / sizeof(FunctionDescription); ++i) {    \
+        if (THVector_(OP ## _DISPATCHTABLE)[i].function == (void *)THVector_(OP ## _DISPATCHPTR)) {    \
+          return THVector_(OP ## _DISPATCHTABLE)[i].supportedSimdExt;                                  \
+        }                                                                                              \
+      }                                                                                                \
+    }                                                                                                  \
   } while(0)
 
 
@@ -1136,7 +1136,26 @@ static int luaT_mt__index(lua_State *L)
   if(!lua_istable(L, -1))
     luaL_error(L, "critical internal indexing error: not a metatable");
 
-  /* test for __index__ method first */
+  /* fast path for method calls: string keys are looked up raw in the */
+  /* metatable and its parents, without going through __index__ */
+  if(lua_type(L, 2) == LUA_TSTRING)
+  {
+    int depth = 0;
+    for(;;)
+    {
+      lua_pushvalue(L, 2);
+      lua_rawget(L, -2);
+      if(!lua_isnil(L, -1))
+        return 1;
+      lua_pop(L, 1);
+      if(!lua_getmetatable(L, -1))
+        break;
+      depth++;
+    }
+    lua_pop(L, depth); /* back to the object metatable */
+  }
+
+  /* test for __index__ method */
   lua_getfield(L, -1, "__index__");
   if(!lua_isnil(L, -1))
   {
@@ -562,6 +562,59 @@ function torchtest.lerp()
    mytester:assertalmosteq(expected, result, precision, 'error in torch.lerp(scalar, scalar, weight)')
 end
 
+function torchtest.logaddexp()
+   for _, t in ipairs{'torch.FloatTensor', 'torch.DoubleTensor'} do
+      local a = torch.rand(msize, msize):mul(20):add(-10):type(t)
+      local b = torch.rand(msize, msize):mul(20):add(-10):type(t)
+      local expected = torch.exp(a):add(torch.exp(b)):log()
+      local tol = t == 'torch.FloatTensor' and 1e-4 or precision
+      mytester:assertTensorEq(torch.logaddexp(a, b), expected, tol, 'error in torch.logaddexp - contiguous ' .. t)
+      mytester:assertTensorEq(torch.logaddexp(a:t(), b:t()), expected:t(), tol,
+                              'error in torch.logaddexp - non-contiguous ' .. t)
+      local c = a:clone():logaddexp(b)
+      mytester:assertTensorEq(c, expected, tol, 'error in logaddexp - in-place ' .. t)
+
+      local d = a - torch.rand(msize, msize):mul(3):add(0.1):type(t)
+      expected = torch.exp(a):add(-1, torch.exp(d)):log()
+      mytester:assertTensorEq(torch.logsubexp(a, d), expected, tol, 'error in torch.logsubexp - contiguous ' .. t)
+      mytester:assertTensorEq(torch.logsubexp(a:t(), d:t()), expected:t(), tol,
+                              'error in torch.logsubexp - non-contiguous ' .. t)
+
+      -- no overflow for large arguments, and exact special values
+      local x = torch.Tensor{1000, -1000, 0, math.huge, -math.huge, 5}:type(t)
+      local y = torch.Tensor{1000, -1000, -math.huge, 1, -math.huge, -1000}:type(t)
+      local r = torch.logaddexp(x, y)
+      mytester:assertalmosteq(r[1], 1000 + math.log(2), tol * 1000, 'error in torch.logaddexp - large ' .. t)
+      mytester:assertalmosteq(r[2], -1000 + math.log(2), tol * 1000, 'error in torch.logaddexp - small ' .. t)
+      mytester:asserteq(r[3], 0, 'error in torch.logaddexp - -inf ' .. t)
+      mytester:asserteq(r[4], math.huge, 'error in torch.logaddexp - inf ' .. t)
+      mytester:asserteq(r[5], -math.huge, 'error in torch.logaddexp - -inf, -inf ' .. t)
+      mytester:asserteq(r[6], 5, 'error in torch.logaddexp - underflow ' .. t)
+      local s = torch.logsubexp(x, y)
+      mytester:asserteq(s[1], -math.huge, 'error in torch.logsubexp - equal ' .. t)
+      mytester:asserteq(s[3], 0, 'error in torch.logsubexp - -inf ' .. t)
+   end
+end
+
+function torchtest.expm1_log2_exp2()
+   for _, t in ipairs{'torch.FloatTensor', 'torch.DoubleTensor'} do
+      local x = torch.rand(msize, msize):add(-0.5):type(t)
+      local tol = t == 'torch.FloatTensor' and 1e-5 or precision
+      mytester:assertTensorEq(torch.expm1(x), torch.exp(x):add(-1), tol, 'error in torch.expm1 ' .. t)
+      mytester:assertTensorEq(torch.expm1(x:t()), torch.exp(x:t()):add(-1), tol,
+                              'error in torch.expm1 - non-contiguous ' .. t)
+      mytester:assertTensorEq(torch.exp2(x), torch.Tensor():type(t):resizeAs(x):fill(2):cpow(x), tol,
+                              'error in torch.exp2 ' .. t)
+      local y = torch.exp2(x)
+      mytester:assertTensorEq(torch.log2(y), x, tol, 'error in torch.log2 ' .. t)
+      mytester:assertTensorEq(y:t():log2(), x:t(), tol, 'error in log2 - non-contiguous ' .. t)
+   end
+   -- expm1 keeps the precision of tiny arguments
+   local tiny = torch.DoubleTensor{1e-10, -1e-12}
+   mytester:assertalmosteq(torch.expm1(tiny)[1], 1e-10, 1e-20, 'error in torch.expm1 - tiny')
+   mytester:assertalmosteq(torch.expm1(tiny)[2], -1e-12, 1e-22, 'error in torch.expm1 - tiny')
+end
+
 for i, v in ipairs{{10}, {5, 5}} do
    torchtest['allAndAny' .. i] =
       function ()
@@ -942,6 +995,47 @@ function torchtest.remainder()
    mytester:assertlt(err, precision, 'error in torch.remainder - scalar, non contiguous')
 end
 
+function torchtest.intDivision()
+   local ranges = {
+      Byte = {0, 255, {1, 2, 3, 7, 16, 100, 255}},
+      Char = {-128, 127, {1, -1, 2, -3, 7, -16, 100, 127}},
+      Short = {-32768, 32767, {1, -1, 2, 3, -7, 64, 1000, -32768}},
+      Int = {-2^31, 2^31-1, {1, -1, 2, 3, -7, 1024, 100003, -2^31}},
+      Long = {-2^40, 2^40, {1, -1, 2, 3, -7, 1024, 100003, -2^35}},
+   }
+   local function trunc(x)
+      return x < 0 and math.ceil(x) or math.floor(x)
+   end
+   for typename, range in pairs(ranges) do
+      local lo, hi, divisors = range[1], range[2], range[3]
+      local m = torch.DoubleTensor(20, 30):uniform(lo, hi):floor()
+      m[1][1], m[1][2], m[1][3] = lo, hi, 0
+      m = m:type('torch.' .. typename .. 'Tensor')
+      for _, d in ipairs(divisors) do
+         for _, x in ipairs{m, m:t()} do
+            local div = x:clone():div(d)
+            local fmod = x:clone():fmod(d)
+            local remainder = x:clone():remainder(d)
+            local err = 0
+            for i=1,x:size(1) do
+               for j=1,x:size(2) do
+                  local v = x[i][j]
+                  -- the quotient of the smallest value by -1 overflows
+                  if not (v == lo and d == -1) then
+                     err = math.max(err, math.abs(div[i][j] - trunc(v / d)))
+                  end
+                  err = math.max(err, math.abs(fmod[i][j] - math.fmod(v, d)))
+                  err = math.max(err, math.abs(remainder[i][j] - v % d))
+               end
+            end
+            mytester:asserteq(err, 0, 'error in integer division of ' .. typename .. ' by ' .. d)
+         end
+      end
+      mytester:assertError(function() m:clone():div(0) end, 'division by zero of ' .. typename)
+      mytester:assertError(function() m:clone():fmod(0) end, 'modulo by zero of ' .. typename)
+   end
+end
+
 function torchtest.bitand()
    local m1 = torch.LongTensor(10,10):random(0,100)
    local res1 = m1:clone()
@@ -1088,6 +1182,45 @@ function torchtest.mm()
 
 end
 
+function torchtest.mmInt()
+   local function reference(a, b)
+      return torch.mm(a:double(), b:double())
+   end
+
+   -- odd sizes exercise the tails of the 2x4 blocks
+   for _, sizes in ipairs{{1, 17, 1}, {7, 33, 5}, {10, 64, 70}, {3, 1000, 130}} do
+      local n, k, p = sizes[1], sizes[2], sizes[3]
+      local a = torch.CharTensor(n, k):random(-128, 127)
+      local b = torch.CharTensor(k, p):random(-128, 127)
+      local r = a:mmInt(b)
+      mytester:assert(r:type() == 'torch.IntTensor', 'mmInt: IntTensor expected')
+      mytester:assertTensorEq(r:double(), reference(a, b), 0, 'mmInt: wrong product ' .. n .. 'x' .. k .. 'x' .. p)
+
+      -- non contiguous operands and result
+      local at = torch.CharTensor(k, n):random(-128, 127):t()
+      local bt = torch.CharTensor(p, k):random(-128, 127):t()
+      local rt = torch.IntTensor(p, n):t()
+      torch.CharTensor.mmInt(rt, at, bt)
+      mytester:assertTensorEq(rt:double(), reference(at, bt), 0, 'mmInt: wrong non contiguous product')
+   end
+
+   -- sums far out of the 8-bit range
+   local a = torch.CharTensor(2, 300):fill(-128)
+   local b = torch.CharTensor(300, 3):fill(127)
+   mytester:assertTensorEq(a:mmInt(b):double(), torch.DoubleTensor(2, 3):fill(-128*127*300), 0,
+                           'mmInt: 32-bit accumulation expected')
+
+   -- the largest inner dimension whose sums cannot overflow
+   local k = 131071
+   local a1 = torch.CharTensor(1, k):fill(-128)
+   mytester:asserteq(a1:mmInt(a1:t())[1][1], 128*128*k, 'mmInt: largest exact sum')
+   local a2 = torch.CharTensor(1, k + 1):fill(-128)
+   mytester:assertError(function() a2:mmInt(a2:t()) end, 'mmInt: overflowing inner dimension expected')
+
+   mytester:assertError(function() a:mmInt(a) end, 'mmInt: size mismatch expected')
+   mytester:assertError(function() a:mmInt(torch.CharTensor(300)) end, 'mmInt: matrices expected')
+end
+
 function torchtest.bmm()
    local num_batches = 10
    local M, N, O = 23, 8, 12
@@ -1161,6 +1294,50 @@ function torchtest.baddbmm()
    mytester:assertTensorEq(res6, res2*.1 + res*.5, precision, 'baddbmm result wrong')
 end
 
+function torchtest.einsum()
+   local a = torch.randn(3, 4)
+   local b = torch.randn(4, 5)
+   local c = torch.randn(5, 2)
+   mytester:assertTensorEq(torch.einsum('ij,jk->ik', a, b), torch.mm(a, b), precision, 'einsum mm')
+   mytester:assertTensorEq(torch.einsum('ij,jk', a, b), torch.mm(a, b), precision, 'einsum implicit output')
+   mytester:assertTensorEq(torch.einsum('ji,jk->ik', a:t(), b), torch.mm(a, b), precision, 'einsum transposed operand')
+   mytester:assertTensorEq(torch.einsum('ij,jk,kl->il', a, b, c), a * b * c, precision, 'einsum chain')
+   mytester:assertTensorEq(torch.einsum('ij->ji', a), a:t(), 0, 'einsum transpose')
+   mytester:assertTensorEq(torch.einsum('ij->j', a), a:sum(1)[1], precision, 'einsum sum')
+   mytester:assertlt(math.abs(torch.einsum('ij,ij', a, a) - a:dot(a)), precision, 'einsum full contraction')
+   mytester:assertTensorEq(torch.einsum('i,j->ij', a[1], b[1]), torch.ger(a[1], b[1]), precision, 'einsum outer product')
+   mytester:assertTensorEq(torch.einsum('ij,ij->ij', a, a), torch.cmul(a, a), precision, 'einsum element-wise')
+
+   local m = torch.randn(4, 4)
+   mytester:assertTensorEq(torch.einsum('ii->i', m), torch.diag(m), 0, 'einsum diagonal')
+   mytester:assertlt(math.abs(torch.einsum('ii', m) - torch.trace(m)), precision, 'einsum trace')
+
+   local b1 = torch.randn(6, 3, 4)
+   local b2 = torch.randn(6, 4, 5)
+   mytester:assertTensorEq(torch.einsum('bij,bjk->bik', b1, b2), torch.bmm(b1, b2), precision, 'einsum bmm')
+   mytester:assertTensorEq(torch.einsum('bij,bjk->ik', b1, b2), torch.bmm(b1, b2):sum(1)[1], precision, 'einsum addbmm')
+
+   -- batch dimensions interleaved with the others
+   local q = torch.randn(2, 3, 4, 5)
+   local k = torch.randn(2, 3, 6, 5)
+   local scores = torch.einsum('bhqd,bhkd->bhqk', q, k)
+   for i = 1, 2 do
+      for h = 1, 3 do
+         mytester:assertTensorEq(scores[i][h], torch.mm(q[i][h], k[i][h]:t()), precision, 'einsum attention')
+      end
+   end
+
+   local x = torch.randn(3, 4, 5)
+   local y = torch.randn(4, 5, 6)
+   local ref = torch.mm(x:view(3, 20), y:view(20, 6))
+   mytester:assertTensorEq(torch.tensordot(x, y), ref, precision, 'tensordot')
+   mytester:assertTensorEq(torch.tensordot(x, y, {{2, 3}, {1, 2}}), ref, precision, 'tensordot dims')
+   mytester:assertTensorEq(torch.tensordot(x, y:permute(3, 1, 2), {{2, 3}, {2, 3}}), ref, precision, 'tensordot permuted')
+
+   mytester:assertError(function() torch.einsum('ij,jk->ik', a, a) end, 'einsum size mismatch')
+   mytester:assertError(function() torch.einsum('ij->ik', a) end, 'einsum unknown output subscript')
+end
+
 function torchtest.clamp()
    local m1 = torch.rand(100):mul(5):add(-2.5)  -- uniform in [-2.5, 2.5]
    -- just in case we're extremely lucky:
@@ -1647,6 +1824,42 @@ function torchtest.sum()
       mytester:asserteq(maxdiff(a, b), 0, 'torch.sum value')
    end
 end
+function torchtest.mixedTypes()
+   local bytes = torch.ByteTensor(20, 30, 40):random(0, 255)
+   local doubles = bytes:double()
+   local floats = bytes:float()
+   for dim=1,3 do
+      -- sums of 255s overflow a ByteTensor, not the accumulator
+      mytester:assertTensorEq(torch.DoubleTensor():sum(bytes, dim), doubles:sum(dim), 0,
+                              'sum of a ByteTensor into a DoubleTensor')
+      mytester:assertTensorEq(torch.FloatTensor():sum(bytes, dim), floats:sum(dim), 0,
+                              'sum of a ByteTensor into a FloatTensor')
+      mytester:assertTensorEq(torch.DoubleTensor():mean(bytes:transpose(1, 3), dim),
+                              doubles:transpose(1, 3):mean(dim), 1e-12,
+                              'mean of a non-contiguous ByteTensor into a DoubleTensor')
+      local mean = torch.mean(bytes, dim)
+      mytester:asserteq(torch.type(mean), 'torch.DoubleTensor', 'mean of a ByteTensor should be double')
+      mytester:assertTensorEq(mean, doubles:mean(dim), 1e-12, 'mean of a ByteTensor')
+   end
+   mytester:assertalmosteq(bytes:mean(), doubles:mean(), 1e-9, 'mean of all elements of a ByteTensor')
+   mytester:asserteq(bytes:sum(), doubles:sum(), 'sum of all elements of a ByteTensor')
+
+   local ints = torch.IntTensor(100):random(-1000, 1000)
+   mytester:assertalmosteq(ints:mean(), ints:double():mean(), 1e-9, 'mean of an IntTensor')
+
+   local acc = torch.FloatTensor(20, 30, 40):fill(0.5)
+   local expected = floats:clone():mul(2):add(0.5)
+   mytester:assertTensorEq(torch.add(acc, 2, bytes), expected, 0, 'torch.add with a ByteTensor')
+   acc:add(2, bytes)
+   mytester:assertTensorEq(acc, expected, 0, 'add of a ByteTensor in-place')
+   mytester:assertTensorEq(acc:clone():cmul(bytes), torch.cmul(expected, floats), 0,
+                           'cmul with a ByteTensor')
+   local t = doubles:transpose(1, 2):clone()
+   mytester:assertTensorEq(torch.DoubleTensor():add(t, bytes:transpose(1, 2)), t:clone():mul(2), 0,
+                           'add with a non-contiguous ByteTensor')
+   mytester:assertTensorEq(torch.add(doubles, floats), doubles:clone():mul(2), 0,
+                           'add of a FloatTensor into a DoubleTensor')
+end
 function torchtest.prod()
    local x = torch.rand(msize,msize)
    local mx = torch.prod(x,2)
@@ -2762,6 +2975,75 @@ function torchtest.conv2()
    mytester:asserteq(maxdiff(immfc[1],imfc),0,'torch.conv2')
 end
 
+function torchtest.conv2nhwc()
+   local x = torch.rand(3, 4, 13, 11)
+   local k = torch.rand(5, 4, 3, 2)
+   local xh = x:channelsLast():permute(1, 3, 4, 2)
+   mytester:assert(xh:isContiguous(), 'torch.channelsLast')
+   for _, mode in ipairs({'V', 'F'}) do
+      local c = torch.conv2nhwc(xh, k, mode)
+      local xc = torch.xcorr2nhwc(xh, k, mode)
+      for i = 1, x:size(1) do
+         local ci = torch.conv2(x[i], k, mode)
+         local xci = torch.xcorr2(x[i], k, mode)
+         mytester:assertlt(maxdiff(c[i]:permute(3, 1, 2), ci), precision, 'torch.conv2nhwc ' .. mode)
+         mytester:assertlt(maxdiff(xc[i]:permute(3, 1, 2), xci), precision, 'torch.xcorr2nhwc ' .. mode)
+         local c3 = torch.conv2nhwc(xh[i], k, mode)
+         mytester:asserteq(maxdiff(c3, c[i]), 0, 'torch.conv2nhwc 3D ' .. mode)
+      end
+   end
+end
+
+function torchtest.conv2revger()
+   local oldmin = torch.gettune('conv2.revger.unfold.min')
+   -- input planes, kernel planes, input size, kernel size, strides
+   local cases = {{2, 4, 13, 17, 3, 5, 2, 3},
+                  {3, 6, 20, 15, 5, 2, 1, 2},
+                  {1, 5, 9, 9, 4, 4, 2, 2}}
+   for _, case in ipairs(cases) do
+      local nIn, nK, ir, ic, kr, kc, sr, sc = unpack(case)
+      local name = string.format('torch.conv2revger %dx%d kernel, strides %d %d', kr, kc, sr, sc)
+      local x = torch.randn(nIn, ir, ic)
+      local k = torch.randn(nK, kr, kc)
+      local xb = torch.randn(3, nIn, ir, ic)
+      local kb = torch.randn(3, nK, kr, kc)
+
+      -- the direct cross-correlations, then the unfolded matrix products
+      torch.settune('conv2.revger.unfold.min', 2^30)
+      local direct = torch.conv2revger(x, k, sr, sc)
+      local directb = torch.conv2revger(xb, kb, sr, sc)
+      torch.settune('conv2.revger.unfold.min', 0)
+      local unfolded = torch.conv2revger(x, k, sr, sc)
+      local unfoldedb = torch.conv2revger(xb, kb, sr, sc)
+
+      mytester:assertTableEq(direct:size():totable(), {nK, nIn, ir - (kr-1)*sr, ic - (kc-1)*sc}, name .. ' size')
+      mytester:assertlt(maxdiff(unfolded, direct), precision, name)
+      mytester:assertlt(maxdiff(unfoldedb, directb), precision, name .. ' batch')
+      local sum = direct:clone():zero()
+      for b = 1, 3 do
+         sum:add(torch.conv2revger(xb[b], kb[b], sr, sc))
+      end
+      mytester:assertlt(maxdiff(unfoldedb, sum), precision, name .. ' batch sum')
+   end
+   torch.settune('conv2.revger.unfold.min', oldmin)
+end
+
+function torchtest.channelsLast()
+   local x = torch.rand(2, 3, 4, 5)
+   local y = x:channelsLast()
+   mytester:assert(not y:isContiguous() and y:isDense(), 'channelsLast layout')
+   mytester:asserteq(maxdiff(x, y), 0, 'channelsLast values')
+   mytester:assert(torch.pointer(y:channelsLast()) == torch.pointer(y), 'channelsLast is idempotent')
+   mytester:assert(not x:narrow(2, 1, 2):isDense(), 'isDense on a narrowed tensor')
+
+   -- element-wise operations between channels-last tensors keep their layout
+   local z = torch.rand(2, 3, 4, 5):channelsLast()
+   local ref = x:clone():cmul(z):add(2):exp()
+   y:cmul(z):add(2):exp()
+   mytester:assert(y:isDense() and not y:isContiguous(), 'channelsLast layout kept')
+   mytester:assertlt(maxdiff(y, ref), precision, 'element-wise operations on channelsLast')
+end
+
 function torchtest.conv3()
    local x = torch.rand(math.floor(torch.uniform(20,40)),
                         math.floor(torch.uniform(20,40)),
@@ -2805,6 +3087,23 @@ function torchtest.conv3()
    mytester:asserteq(maxdiff(immfc[1],imfc),0,'torch.conv3')
 end
 
+function torchtest.conv3_mv()
+   -- enough planes for conv3Dmv to take the unfold + gemm path
+   local x = torch.rand(3, 12, 13, 14)
+   local k = torch.rand(6, 3, 3, 4, 5)
+
+   for _,f in ipairs({'conv3', 'xcorr3'}) do
+      local o = torch[f](x, k)
+      local o2 = torch.zeros(o:size())
+      for i=1,k:size(1) do
+         for j=1,k:size(2) do
+            o2[i]:add(torch[f](x[j], k[i][j]))
+         end
+      end
+      mytester:assertlt(maxdiff(o, o2), precision, 'torch.' .. f .. ' (5D kernel)')
+   end
+end
+
 function torchtest.xcorr3_xcorr2_eq()
     local ix = math.floor(torch.uniform(20,40))
     local iy = math.floor(torch.uniform(20,40))
@@ -3107,6 +3406,70 @@ local function consecutive(size, start)
     return sequence:resize(unpack(size))
 end
 
+function torchtest.rowsAndValue()
+    local reference = consecutive{3, 4, 5}
+
+    local n = 0
+    for i, row in reference:rows() do
+        n = n + 1
+        mytester:asserteq(i, n, 'rows() should return consecutive indices')
+        mytester:assertTensorEq(row, reference[i], 0, 'rows() should return the slices along dim 1')
+    end
+    mytester:asserteq(n, 3, 'rows() should stop after the last slice')
+
+    local views = {}
+    for j, column in reference:rows(2) do
+        mytester:assertTensorEq(column, reference:select(2, j), 0, 'rows(2) should return the slices along dim 2')
+        views[j] = column
+    end
+    mytester:asserteq(#views, 4, 'rows(2) should iterate over dim 2')
+    mytester:assert(views[1] == views[4], 'rows() should reuse a single view')
+
+    local transposed = reference:transpose(1, 3)
+    for k, slice in transposed:rows(3) do
+        mytester:assertTensorEq(slice, transposed:select(3, k), 0, 'rows() on a non-contiguous tensor')
+    end
+
+    -- the source is restrided over the same storage mid-iteration: later
+    -- rows must follow its new size and stride
+    local source = consecutive{4, 6}
+    for i, row in source:rows() do
+        mytester:assertTensorEq(row, source[i], 0, 'rows() after the source was restrided')
+        if i == 2 then
+            source:set(source:storage(), 1, torch.LongStorage{4, 3}, torch.LongStorage{6, 2})
+        end
+    end
+    source = consecutive{4, 6}
+    for i, row in source:rows() do
+        mytester:assertTensorEq(row, source[i], 0, 'rows() after the source was resized')
+        if i == 2 then
+            source:resize(6, 4)
+        end
+    end
+
+    local vector = torch.Tensor{4, 5, 6}
+    for i, v in vector:rows() do
+        mytester:asserteq(v, vector[i], 'rows() on a 1D tensor should return the elements')
+    end
+
+    local view = torch.Tensor()
+    mytester:assert(view:setSelect(reference, 2, 3) == view, 'setSelect() should return self')
+    mytester:assertTensorEq(view, reference:select(2, 3), 0, 'setSelect() should select')
+    view:setSelect(reference, 1, 2):fill(0)
+    mytester:asserteq(reference:select(1, 2):sum(), 0, 'setSelect() should share the storage')
+    mytester:assertError(function() view:setSelect(vector, 1, 1) end, 'setSelect() on a vector')
+    mytester:assertError(function() view:setSelect(reference, 1, 4) end, 'setSelect() out of range')
+
+    local x = consecutive{3, 4}:t()
+    mytester:asserteq(x:value(2, 3), x[{2, 3}], 'value() should return the element')
+    mytester:asserteq(x:value(-1, -1), x[{4, 3}], 'value() with negative indices')
+    mytester:assert(x:setValue(1, 2, -7) == x, 'setValue() should return self')
+    mytester:asserteq(x[1][2], -7, 'setValue() should set the element')
+    mytester:assertError(function() x:value(1) end, 'value() with too few indices')
+    mytester:assertError(function() x:value(5, 1) end, 'value() out of bound')
+    mytester:assertError(function() x:setValue(1, 1, 1, 2) end, 'setValue() with too many indices')
+end
+
 function torchtest.index()
     local badIndexMsg = "Lookup with valid index should return correct result"
     local reference = consecutive{3, 3, 3}
@@ -3306,6 +3669,186 @@ function torchtest.scatterFill()
                         "Invalid index not detected")
 end
 
+function torchtest.segmentReductions()
+   local n = 50
+   local x = torch.randn(n, 3, 4)
+   local ids = torch.LongTensor(n):random(8):sort()
+   local offsets = torch.segmentOffsets(ids, 10)
+   mytester:assert(offsets:size(1) == 10, "segmentOffsets: wrong number of segments")
+   for _, reduction in ipairs{'Sum', 'Mean', 'Max', 'Min'} do
+      local actual = torch['segment' .. reduction](x, offsets)
+      mytester:assertTableEq(actual:size():totable(), {10, 3, 4}, "segment" .. reduction .. ": wrong size")
+      for s = 1, 10 do
+         local rows = torch.range(1, n)[ids:eq(s)]
+         local expected = torch.zeros(3, 4)
+         if rows:nElement() > 0 then
+            local segment = x:index(1, rows:long())
+            if reduction == 'Sum' then
+               expected = segment:sum(1)[1]
+            elseif reduction == 'Mean' then
+               expected = segment:mean(1)[1]
+            elseif reduction == 'Max' then
+               expected = segment:max(1)[1]
+            else
+               expected = segment:min(1)[1]
+            end
+         end
+         mytester:assertTensorEq(actual[s], expected, 1e-12, "segment" .. reduction .. ": wrong segment " .. s)
+      end
+   end
+
+   local y = torch.IntTensor{1, 2, 3, 4, 5}
+   mytester:assertTensorEq(y:segmentSum(torch.LongTensor{1, 3, 6}), torch.IntTensor{3, 12, 0}, 0,
+                           "segmentSum: wrong IntTensor result")
+   mytester:assertError(function() torch.segmentSum(x, torch.LongTensor{1, 3, 2}) end,
+                        "decreasing offsets not detected")
+   mytester:assertError(function() torch.segmentSum(x, torch.LongTensor{1, n + 2}) end,
+                        "offset out of range not detected")
+   mytester:assertError(function() torch.segmentOffsets(torch.LongTensor{2, 1}) end,
+                        "unsorted ids not detected")
+end
+
+function torchtest.embeddingBag()
+   local weight = torch.randn(20, 6)
+   local indices = torch.LongTensor(30):random(20)
+   local offsets = torch.LongTensor{1, 4, 4, 17}
+   local perSampleWeights = torch.rand(30)
+   local bags = {{1, 3}, {4, 3}, {4, 16}, {17, 30}}
+
+   local sum = torch.embeddingBag(weight, indices, offsets)
+   local mean = torch.embeddingBag(weight, indices, offsets, 'mean')
+   local max = torch.embeddingBag(weight, indices, offsets, 'max')
+   local weighted = torch.embeddingBag(weight, indices, offsets, perSampleWeights)
+   mytester:assertTableEq(sum:size():totable(), {4, 6}, "embeddingBag: wrong size")
+   for b, bag in ipairs(bags) do
+      local expectedSum, expectedMean, expectedMax = torch.zeros(6), torch.zeros(6), torch.zeros(6)
+      local expectedWeighted = torch.zeros(6)
+      if bag[2] >= bag[1] then
+         local rows = weight:index(1, indices[{bag}])
+         expectedSum, expectedMean, expectedMax = rows:sum(1)[1], rows:mean(1)[1], rows:max(1)[1]
+         expectedWeighted = torch.mv(rows:t(), perSampleWeights[{bag}])
+      end
+      mytester:assertTensorEq(sum[b], expectedSum, 1e-12, "embeddingBag: wrong sum " .. b)
+      mytester:assertTensorEq(mean[b], expectedMean, 1e-12, "embeddingBag: wrong mean " .. b)
+      mytester:assertTensorEq(max[b], expectedMax, 0, "embeddingBag: wrong max " .. b)
+      mytester:assertTensorEq(weighted[b], expectedWeighted, 1e-12, "embeddingBag: wrong weighted sum " .. b)
+   end
+
+   -- non-contiguous table
+   local transposed = torch.randn(6, 20):t()
+   mytester:assertTensorEq(torch.embeddingBag(transposed, indices, offsets),
+                           torch.segmentSum(transposed:index(1, indices), offsets), 1e-12,
+                           "embeddingBag: wrong sum on a transposed table")
+
+   indices[5] = 21
+   mytester:assertError(function() torch.embeddingBag(weight, indices, offsets) end,
+                        "invalid index not detected")
+   mytester:assertError(function() torch.embeddingBag(weight, indices, offsets, 'median') end,
+                        "invalid mode not detected")
+end
+
+function torchtest.searchsorted()
+   local function expected(sorted, values, right)
+      local r = torch.LongTensor(values:size())
+      for i = 1, values:size(1) do
+         local count = right and sorted:le(values[i]):sum() or sorted:lt(values[i]):sum()
+         r[i] = count + 1
+      end
+      return r
+   end
+
+   local saved = torch.gettune('searchsorted.eytzinger.min')
+   local sorted = torch.Tensor(200):random(50):sort()
+   local values = torch.Tensor(300):random(0, 52)
+   values:narrow(1, 1, 100):add(0.5)
+   -- both the binary search and the Eytzinger layout
+   for _, minimum in ipairs{0, 2^30} do
+      torch.settune('searchsorted.eytzinger.min', minimum)
+      mytester:assertTensorEq(torch.searchsorted(sorted, values), expected(sorted, values, false), 0,
+                              "searchsorted: wrong left positions")
+      mytester:assertTensorEq(torch.searchsorted(sorted, values, 'right'), expected(sorted, values, true), 0,
+                              "searchsorted: wrong right positions")
+      mytester:assertTensorEq(torch.searchsorted(sorted:narrow(1, 1, 7), values), expected(sorted:narrow(1, 1, 7), values, false), 0,
+                              "searchsorted: wrong positions in a small vector")
+   end
+   torch.settune('searchsorted.eytzinger.min', saved)
+
+   -- batched rows
+   local rows = torch.IntTensor{{1, 2, 3, 4}, {10, 20, 30, 40}}
+   mytester:assertTensorEq(torch.searchsorted(rows, torch.IntTensor{{3, 5}, {10, 45}}), torch.LongTensor{{3, 5}, {1, 5}}, 0,
+                           "searchsorted: wrong positions in batched rows")
+   mytester:assertError(function() torch.searchsorted(rows, torch.IntTensor{{3, 5}}) end,
+                        "mismatching number of rows not detected")
+
+   mytester:asserteq(torch.searchsorted(torch.Tensor{1, 2}, torch.Tensor{0/0})[1], 3, "searchsorted: NaN not at the end")
+   mytester:asserteq(torch.searchsorted(torch.Tensor(), torch.Tensor{5})[1], 1, "searchsorted: empty sorted vector")
+
+   local x = torch.Tensor{0.5, 2, 2.5, 10, 100}
+   mytester:assertTensorEq(torch.bucketize(x, torch.Tensor{1, 2, 5}), torch.LongTensor{1, 2, 3, 4, 4}, 0,
+                           "bucketize: wrong buckets")
+   mytester:assertTensorEq(torch.bucketize(x, torch.Tensor{1, 2, 5}, true), torch.LongTensor{1, 3, 3, 4, 4}, 0,
+                           "bucketize: wrong right buckets")
+end
+
+function torchtest.unique()
+   local function check(x, sorted, y, inverse, counts, name)
+      local seen = {}
+      for i = 1, y:size(1) do
+         mytester:assert(not seen[y[i]], name .. ": repeated value")
+         seen[y[i]] = true
+         if sorted and i > 1 then
+            mytester:assert(y[i-1] < y[i], name .. ": values not sorted")
+         end
+      end
+      mytester:assertTensorEq(y:index(1, inverse:view(-1)):viewAs(x), x, 0, name .. ": wrong inverse")
+      local expectedCounts = torch.LongTensor(y:size(1)):zero()
+      expectedCounts:indexAdd(1, inverse:view(-1), torch.LongTensor(x:nElement()):fill(1))
+      mytester:assertTensorEq(counts, expectedCounts, 0, name .. ": wrong counts")
+   end
+
+   -- repeated values are hashed, distinct ones sorted
+   for _, range in ipairs{20, 1e9} do
+      local x = torch.LongTensor(30, 40):random(range)
+      for _, sorted in ipairs{true, false} do
+         local y, inverse, counts = torch.unique(x, sorted)
+         check(x, sorted, y, inverse, counts, 'unique ' .. range .. (sorted and ' sorted' or ''))
+      end
+   end
+   local y = torch.unique(torch.Tensor{3, 1, 2, 3, 1}, false)
+   mytester:assertTensorEq(y, torch.Tensor{3, 1, 2}, 0, "unique: not in the order of appearance")
+
+   -- skewed data: the sample sees mostly the frequent values, so the hash
+   -- table is sized too small and grows while it is filled
+   local x = torch.LongTensor(100000)
+   x:apply(function() return math.random() < 0.9 and math.random(7) or math.random(1e9) end)
+   local sortedX = torch.sort(x)
+   local distinct = {sortedX[1]}
+   for i = 2, sortedX:size(1) do
+      if sortedX[i] ~= sortedX[i-1] then
+         table.insert(distinct, sortedX[i])
+      end
+   end
+   for _, sorted in ipairs{true, false} do
+      local y, inverse, counts = torch.unique(x, sorted)
+      mytester:asserteq(y:size(1), #distinct, "unique skewed: wrong number of values")
+      check(x, sorted, y, inverse, counts, 'unique skewed' .. (sorted and ' sorted' or ''))
+   end
+   mytester:assertTensorEq(torch.unique(x), torch.LongTensor(distinct), 0, "unique skewed: differs from sort")
+
+   local x = torch.Tensor{2, 0/0, 1, 0/0, 2}
+   local y, inverse, counts = torch.unique(x)
+   mytester:asserteq(y:size(1), 3, "unique: NaNs not equal")
+   mytester:assert(y[3] ~= y[3], "unique: NaN not last")
+   mytester:assertTensorEq(counts, torch.LongTensor{1, 2, 2}, 0, "unique: wrong counts with NaNs")
+
+   local m = torch.IntTensor{{1, 2, 1, 2}, {5, 0, 5, 1}}
+   local y, inverse, counts = torch.unique(m, 2)
+   mytester:assertTensorEq(y, torch.IntTensor{{1, 2, 2}, {5, 0, 1}}, 0, "unique: wrong slices")
+   mytester:assertTensorEq(inverse, torch.LongTensor{1, 2, 1, 3}, 0, "unique: wrong slice inverse")
+   mytester:assertTensorEq(counts, torch.LongTensor{2, 1, 1}, 0, "unique: wrong slice counts")
+   mytester:assertTensorEq(torch.unique(m, 1), m, 0, "unique: distinct rows")
+end
+
 function torchtest.maskedCopy()
    local nCopy, nDest = 3, 10
    local dest = torch.randn(nDest)
@@ -3600,6 +4143,70 @@ function torchtest_repeatTensor(func, mean)
    result:repeatTensor(tensor,sizeStorage)
    mytester:assertTableEq(result:size():totable(), target, 'Error in repeatTensor using result and LongStorage')
    mytester:asserteq((result:mean(1):view(8,4)-tensor):abs():max(), 0, 'Error in repeatTensor (not equal)')
+   mytester:assertTableEq(torch.repeatTensor(tensor, unpack(size)):size():totable(), target, 'Error in torch.repeatTensor')
+   result = func(torch.Tensor())
+   torch.repeatTensor(result, tensor, sizeStorage)
+   mytester:assertTableEq(result:size():totable(), target, 'Error in torch.repeatTensor using result')
+   mytester:asserteq((result:mean(1):view(8,4)-tensor):abs():max(), 0, 'Error in torch.repeatTensor (not equal)')
+end
+
+function torchtest.repeatTensorLayouts()
+   -- element (i1, ..., in) of the result is element (i1 mod size1, ...) of x
+   local function reference(x, reps)
+      local pad = #reps - x:dim()
+      local size, idx = {}, {}
+      for d = 1, #reps do
+         size[d] = (d <= pad and 1 or x:size(d - pad)) * reps[d]
+         idx[d] = 1
+      end
+      local r = x.new(torch.LongStorage(size))
+      local flat = r:view(-1)
+      for n = 1, r:nElement() do
+         local src = {}
+         for d = pad + 1, #reps do
+            src[d - pad] = (idx[d] - 1) % x:size(d - pad) + 1
+         end
+         flat[n] = x[src]
+         for d = #reps, 1, -1 do
+            idx[d] = idx[d] + 1
+            if idx[d] <= size[d] then
+               break
+            end
+            idx[d] = 1
+         end
+      end
+      return r
+   end
+
+   local x = torch.rand(3, 4, 5)
+   local sources = {
+      {x, 'contiguous'},
+      {x:transpose(1, 3), 'transposed'},
+      {x:narrow(2, 2, 3), 'narrowed'},
+      {x:select(3, 2):t(), 'transposed slice'}
+   }
+   local repeats = {{1, 2, 3}, {2, 1, 1}, {1, 1, 4}, {2, 1, 3, 1}, {3, 2, 1, 2}}
+   for _, source in ipairs(sources) do
+      for _, reps in ipairs(repeats) do
+         if #reps >= source[1]:dim() then
+            local name = 'repeatTensor ' .. source[2] .. ' by ' .. table.concat(reps, 'x')
+            local r = source[1]:repeatTensor(torch.LongStorage(reps))
+            mytester:assertTensorEq(r, reference(source[1], reps), 0, name)
+         end
+      end
+   end
+
+   -- the result may be the source, or share its storage
+   local y = x:clone()
+   y:repeatTensor(y, 1, 2, 3)
+   mytester:assertTensorEq(y, reference(x, {1, 2, 3}), 0, 'repeatTensor into its source')
+   local big = torch.rand(40)
+   local v = big:narrow(1, 3, 4)
+   local expected = reference(v:clone(), {2, 3})
+   big:repeatTensor(v, 2, 3)
+   mytester:assertTensorEq(big, expected, 0, 'repeatTensor into the storage of its source')
+
+   mytester:assertError(function() x:repeatTensor(2, -1, 1) end, 'repeatTensor with a negative repeat')
 end
 
 function torchtest.isSameSizeAs()
@@ -3639,6 +4246,84 @@ function torchtest_isSetTo(func)
                    "to each other")
 end
 
+function torchtest.geometry()
+   -- nElement and isContiguous are cached in the tensor: they must follow
+   -- every change of its geometry
+   local function check(t, name)
+      local n = t:dim() > 0 and 1 or 0
+      local contiguous = true
+      local z = 1
+      for d=t:dim(),1,-1 do
+         n = n * t:size(d)
+         if t:size(d) ~= 1 then
+            contiguous = contiguous and t:stride(d) == z
+            z = z * t:size(d)
+         end
+      end
+      mytester:asserteq(t:nElement(), n, 'wrong nElement after ' .. name)
+      mytester:asserteq(t:isContiguous(), contiguous, 'wrong isContiguous after ' .. name)
+   end
+   local x = torch.Tensor(4, 5, 6)
+   check(x, 'new')
+   check(torch.Tensor(), 'new empty')
+   check(x:narrow(3, 2, 3), 'narrow')
+   check(x:narrow(1, 2, 2), 'narrow of the first dimension')
+   check(x:select(3, 2), 'select')
+   check(x:select(1, 2), 'select of the first dimension')
+   check(x:transpose(1, 3), 'transpose')
+   check(x:unfold(3, 2, 2), 'unfold')
+   check(x:view(4, 1, 30):squeeze(), 'squeeze')
+   check(x:view(4, 1, 30):squeeze(2), 'squeeze of a dimension')
+   check(x:view(4, 30):t():unsqueeze(2), 'unsqueeze')
+   check(torch.Tensor(5):expand(3, 5), 'expand')
+   check(x:clone():resize(7, 2), 'resize')
+   check(x:clone():resize(0), 'resize to empty')
+   check(torch.Tensor():set(x:t()), 'set')
+   check(torch.Tensor():set(x:storage(), 1, torch.LongStorage{3, 4}, torch.LongStorage{1, 3}), 'set to a storage')
+   local values, indices = x:uniform():max(2)
+   check(values, 'max')
+   local f = torch.MemoryFile()
+   f:writeObject(x:transpose(1, 2))
+   f:seek(1)
+   check(f:readObject(), 'read')
+   f:close()
+end
+
+function torchtest.dlpack()
+   for _, typename in ipairs{'Byte', 'Char', 'Short', 'Int', 'Long', 'Float', 'Double'} do
+      local x = torch[typename .. 'Tensor'](4, 5):random(100)
+      local y = torch.fromDLPack(x:t():toDLPack())
+      mytester:asserteq(torch.type(y), 'torch.' .. typename .. 'Tensor', 'wrong type imported from DLPack')
+      mytester:assertTensorEq(y:double(), x:t():double(), 0, 'wrong elements imported from DLPack')
+      mytester:asserteq(y:stride(1), 1, 'strides not kept through DLPack')
+      y[2][3] = 101
+      mytester:asserteq(x[3][2], 101, 'memory not shared through DLPack')
+   end
+
+   -- the descriptor keeps the storage alive
+   local x = torch.range(1, 12):resize(3, 4)
+   local d = x:narrow(2, 2, 2):toDLPack()
+   x = nil
+   collectgarbage()
+   local y = torch.fromDLPack(d)
+   mytester:assertTensorEq(y, torch.Tensor{{2, 3}, {6, 7}, {10, 11}}, 0, 'storage not retained by DLPack')
+   mytester:assertError(function() torch.fromDLPack(d) end, 'consumed DLPack imported again')
+   mytester:assertError(function() y:storage():resize(100) end, 'storage imported from DLPack resized')
+
+   -- through an address, as from another library
+   local x = torch.FloatTensor(3, 2):uniform()
+   local address = x:toDLPack():release()
+   mytester:assert(type(address) == 'number', 'address expected from release')
+   local y = torch.fromDLPack(address)
+   mytester:assertTensorEq(y, x, 0, 'wrong tensor imported from an address')
+
+   mytester:asserteq(torch.fromDLPack(torch.Tensor():toDLPack()):nElement(), 0, 'empty tensor through DLPack')
+   local d = torch.Tensor(2):toDLPack()
+   mytester:assert(tostring(d):find('2') ~= nil, 'DLPack tostring')
+   d = nil
+   collectgarbage()
+end
+
 function torchtest.equal()
   -- Contiguous, 1D
   local t1 = torch.Tensor{3, 4, 9, 10}
@@ -3821,6 +4506,31 @@ function torchtest_totable(func, storageType)
                          'totable() incorrect for non-contiguous tensors')
 end
 
+function torchtest.tostring()
+   local x = torch.DoubleTensor({{1, 2, 3}, {4, 5, 6}})
+   mytester:asserteq(tostring(x), ' 1  2  3\n 4  5  6\n[torch.DoubleTensor of size 2x3]\n',
+                     'tostring of a small tensor')
+   mytester:asserteq(tostring(torch.FloatTensor({0.5, -0.25})),
+                     ' 0.5000\n-0.2500\n[torch.FloatTensor of size 2]\n',
+                     'tostring of a non-integer tensor')
+   mytester:asserteq(tostring(torch.IntTensor()), '[torch.IntTensor with no dimension]\n',
+                     'tostring of an empty tensor')
+
+   local options = torch.getprintoptions()
+   torch.setprintoptions{threshold = 10, edgeitems = 2, precision = 2}
+   local ok, str = pcall(tostring, torch.range(1, 100):view(10, 10):div(2))
+   torch.setprintoptions(options)
+   mytester:assert(ok, str)
+   mytester:asserteq(str, '  0.50   1.00 ...   4.50   5.00\n'
+                        .. '  5.50   6.00 ...   9.50  10.00\n'
+                        .. '...\n'
+                        .. ' 40.50  41.00 ...  44.50  45.00\n'
+                        .. ' 45.50  46.00 ...  49.50  50.00\n'
+                        .. '[torch.DoubleTensor of size 10x10]\n',
+                     'tostring of a summarized tensor')
+   mytester:assertTableEq(torch.getprintoptions(), options, 'print options not restored')
+end
+
 function torchtest.permute()
    for k,v in ipairs({"real", "half"}) do
       torchtest_permute(torch.getmetatable(torch.Tensor():type())[v])
@@ -3949,6 +4659,266 @@ function torchtest.testheaptracking()
   torch.setheaptracking(oldheaptracking)
 end
 
+function torchtest.heaplimits()
+  local oldheaptracking = torch._heaptracking
+  if oldheaptracking == nil then
+    oldheaptracking = false
+  end
+  local oldlimits = torch.getheaplimits()
+  torch.setheaptracking(true)
+
+  -- a low soft maximum makes the allocations below run incremental steps
+  torch.setheaplimits{floor = 1e7}
+  mytester:asserteq(torch.getheaplimits().floor, 1e7, 'heap limit floor')
+  mytester:asserteq(torch.getheaplimits().hardmax, oldlimits.hardmax, 'heap limit hardmax kept')
+  torch.heapstats(true)
+  for i=1,50 do
+     local x = torch.FloatTensor(1e6)
+  end
+  local stats = torch.heapstats()
+  mytester:assertgt(stats.steps, 0, 'allocations above the soft maximum should run GC steps')
+  mytester:asserteq(stats.fullCollections, 0, 'no full collection without a hard maximum')
+  mytester:assertge(stats.heapSoftmax, 1e7, 'soft maximum should not go below the floor')
+  mytester:assertge(stats.stepTime, stats.maxStepTime, 'total step time')
+  mytester:asserteq(torch.heapstats().steps, stats.steps, 'stats kept without reset')
+
+  mytester:assertError(function() torch.setheaplimits{floor = 0} end, 'floor must be positive')
+  mytester:assertError(function() torch.setheaplimits{hardmax = 'a'} end, 'limits must be numbers')
+
+  torch.setheaplimits(oldlimits)
+  torch.setheaptracking(oldheaptracking)
+end
+
+function torchtest.deterministicReductions()
+  local olddeterministic = torch.getdeterministic()
+  local oldthreads = torch.getnumthreads()
+  local x = torch.randn(1000, 1537)
+  local y = torch.randn(1000, 1537)
+  local b = torch.ByteTensor(100003):random(0, 255)
+
+  local function reductions()
+    return {x:sum(), x:dot(y), x:norm(), x:norm(1), x:mean(), b:mean(), x:sum(2)}
+  end
+
+  torch.setdeterministic(true)
+  mytester:assert(torch.getdeterministic(), 'deterministic mode set')
+  torch.setnumthreads(1)
+  local ref = reductions()
+  for threads = 2, math.max(2, torch.getnumcores()) do
+    torch.setnumthreads(threads)
+    local r = reductions()
+    for i = 1, #ref - 1 do
+      mytester:asserteq(r[i], ref[i], 'result of reduction ' .. i .. ' with ' .. threads .. ' threads')
+    end
+    mytester:assertTensorEq(r[#r], ref[#ref], 0, 'sum along a dimension with ' .. threads .. ' threads')
+  end
+
+  torch.setnumthreads(oldthreads)
+  torch.setdeterministic(olddeterministic)
+  mytester:assertError(function() torch.setdeterministic(1) end, 'boolean expected')
+end
+
+function torchtest.threadAffinity()
+  local oldthreads = torch.getnumthreads()
+  local oldnested = torch.getnestedparallelism()
+  local cpus = torch.topology()
+  mytester:assert(#cpus >= 1, 'at least one CPU')
+  for _, cpu in ipairs(cpus) do
+    for _, field in ipairs{'id', 'core', 'package', 'node', 'smt'} do
+      mytester:assert(type(cpu[field]) == 'number', 'field ' .. field .. ' of the topology')
+    end
+  end
+
+  if torch.setaffinity({cpus[1].id}, 'compact') then
+    local subset, placement = torch.getaffinity()
+    mytester:assertTableEq(subset, {cpus[1].id}, 'CPUs of the subset')
+    mytester:asserteq(placement, 'compact', 'placement')
+    mytester:asserteq(torch.getnumthreads(), 1, 'one thread per CPU at most')
+    local x = torch.randn(1000, 1000)
+    mytester:assertalmosteq(x:sum(), x:double():sum(), 1e-6, 'sum on a pinned thread')
+
+    local ids = {}
+    for i, cpu in ipairs(cpus) do
+      ids[i] = cpu.id
+    end
+    torch.setaffinity(ids, 'scatter')
+    subset = torch.getaffinity()
+    table.sort(subset)
+    table.sort(ids)
+    mytester:assertTableEq(subset, ids, 'all CPUs scattered')
+    torch.setaffinity()
+    mytester:asserteq(#torch.getaffinity(), 0, 'no restriction')
+  end
+  mytester:assertError(function() torch.setaffinity({-1}) end, 'unknown CPU')
+  mytester:assertError(function() torch.setaffinity({cpus[1].id, cpus[1].id}) end, 'CPU given twice')
+  mytester:assertError(function() torch.setaffinity(nil, 'spread') end, 'unknown placement')
+
+  torch.setnestedparallelism(false)
+  mytester:assert(not torch.getnestedparallelism(), 'nested parallelism disabled')
+  torch.setnestedparallelism(oldnested)
+  torch.setnumthreads(oldthreads)
+end
+
+function torchtest.parallelMap()
+  local x = torch.DoubleTensor(4, 100):fill(1)
+  local shards = {}
+  for i = 1, 4 do
+    shards[i] = x[i]
+  end
+  local res = torch.parallelMap(function(row, i)
+    row:mul(i)
+    return {sum = row:sum(), name = 'row' .. i, row = row}
+  end, shards, 2)
+  for i = 1, 4 do
+    mytester:asserteq(res[i].sum, 100 * i, 'result ' .. i)
+    mytester:asserteq(res[i].name, 'row' .. i, 'string result ' .. i)
+    mytester:asserteq(torch.pointer(res[i].row:storage()), torch.pointer(x:storage()), 'same storage ' .. i)
+  end
+  mytester:asserteq(x:sum(), 1000, 'shards modified in place')
+
+  res = torch.parallelMap(function(n) return torch.range(1, n) end, {3, 5}, 4)
+  mytester:assertTensorEq(res[2], torch.range(1, 5), 1e-16, 'tensor created in a worker')
+  mytester:asserteq(#torch.parallelMap(function() end, {}), 0, 'no shards')
+
+  local ok, err = pcall(torch.parallelMap, function(n) if n == 2 then error('failed') end end, {1, 2, 3})
+  mytester:assert(not ok and err:find('shard 2') ~= nil, 'error in a worker')
+  local y = 1
+  mytester:assertError(function() torch.parallelMap(function(n) return n + y end, {1}) end, 'upvalues')
+  mytester:assertError(function() torch.parallelMap(function(n) return n end, {print}) end, 'function shard')
+
+  -- the memory pressure of this thread still collects the garbage of this
+  -- state, once the workers are created and once they are closed
+  local oldheaptracking = torch._heaptracking
+  if oldheaptracking == nil then
+    oldheaptracking = false
+  end
+  local oldlimits = torch.getheaplimits()
+  torch.setheaptracking(true)
+  local function pressure(name)
+    collectgarbage('stop')
+    local weak = setmetatable({}, {__mode = 'v'})
+    weak[1] = torch.FloatTensor(10)
+    torch.setheaplimits{floor = 1e7}
+    for i = 1, 50 do
+      local x = torch.FloatTensor(1e6)
+    end
+    collectgarbage('restart')
+    mytester:assert(weak[1] == nil, name .. ': garbage not collected above the soft maximum')
+  end
+  torch.parallelMap(function(n) return torch.FloatTensor(1e6):sum() end, {1, 2, 3, 4}, 4)
+  pressure('parallelMap')
+  debug.getregistry()['torch.parallelMap.pool'] = nil
+  collectgarbage()
+  collectgarbage()
+  pressure('closed workers')
+  torch.setheaplimits(oldlimits)
+  torch.setheaptracking(oldheaptracking)
+end
+
+function torchtest.tune()
+  local names = {'vector.cadd.Float', 'omp.threshold', 'copy.transpose.min', 'copy.transpose.block.Float'}
+  local saved = {}
+  for _, name in ipairs(names) do
+    saved[name] = torch.gettune(name)
+  end
+
+  torch.settune('omp.threshold', 1234)
+  mytester:asserteq(torch.gettune('omp.threshold'), 1234, 'settune')
+  mytester:asserteq(torch.tunetable()['omp.threshold'], 1234, 'tunetable')
+  torch.settune('omp.threshold', nil)
+  mytester:asserteq(torch.gettune('omp.threshold', 42), 42, 'unset parameter')
+
+  -- the plain C kernel can always be selected, and computes the same
+  local x = torch.FloatTensor(1001):uniform()
+  local y = torch.FloatTensor(1001):uniform()
+  local ref = torch.add(x, 3, y)
+  torch.settune('vector.cadd.Float', 0)
+  mytester:asserteq(torch.vectordispatch('cadd', 'torch.FloatTensor'), 0, 'plain C kernel selected')
+  mytester:assertTensorEq(torch.add(x, 3, y), ref, 1e-6, 'plain C kernel')
+  mytester:assertError(function() torch.vectordispatch('nosuchop') end, 'unknown operation')
+
+  -- parallel and blocked paths for any threshold or block size
+  torch.settune('omp.threshold', 0)
+  mytester:assertTensorEq(torch.add(x, 3, y), ref, 1e-6, 'parallel kernel')
+  local m = torch.DoubleTensor(97, 45):uniform()
+  torch.settune('copy.transpose.min', 0)
+  torch.settune('copy.transpose.block.Float', 7)
+  local mt = torch.FloatTensor(45, 97):copy(m:float():t())
+  mytester:assertTensorEq(mt:double(), m:t(), 1e-6, 'blocked transposed copy')
+
+  local path = os.tmpname()
+  torch.savetune(path)
+  for _, name in ipairs(names) do
+    torch.settune(name, nil)
+  end
+  mytester:assertge(torch.loadtune(path), 4, 'loadtune')
+  mytester:asserteq(torch.gettune('copy.transpose.block.Float'), 7, 'loadtune value')
+  os.remove(path)
+  mytester:asserteq(torch.loadtune(path), nil, 'loadtune on a missing file')
+
+  for _, name in ipairs(names) do
+    torch.settune(name, saved[name])
+  end
+  torch.vectordispatch()
+end
+
+function torchtest.tdigest()
+  local x = torch.randn(20000)
+  local sorted = x:sort()
+  local digest = torch.TDigest()
+  for i = 1, 20000, 1000 do
+    digest:add(x:narrow(1, i, 1000))
+  end
+  mytester:asserteq(digest:count(), 20000, 'count')
+  mytester:asserteq(digest:min(), sorted[1], 'min')
+  mytester:asserteq(digest:max(), sorted[20000], 'max')
+  mytester:assertlt(digest.centroids:size(1), 100, 'bounded number of centroids')
+  for _, q in ipairs{0.01, 0.1, 0.5, 0.9, 0.99} do
+    local estimate = digest:quantile(q)
+    local rank = sorted:le(estimate):sum() / 20000
+    mytester:assertlt(math.abs(rank - q), 0.01, 'quantile ' .. q)
+    mytester:assertlt(math.abs(digest:cdf(sorted[q*20000]) - q), 0.01, 'cdf ' .. q)
+  end
+  mytester:asserteq(digest:quantile(0), sorted[1], 'quantile 0')
+  mytester:asserteq(digest:quantile(1), sorted[20000], 'quantile 1')
+  mytester:assertTensorEq(digest:quantile(torch.Tensor{0.5, 0.9}),
+                          torch.DoubleTensor{digest:quantile(0.5), digest:quantile(0.9)}, 0, 'quantiles of a tensor')
+
+  -- merging two halves is as good as one digest
+  local a = torch.TDigest():add(x:narrow(1, 1, 10000))
+  local b = torch.TDigest():add(x:narrow(1, 10001, 10000))
+  a:merge(b)
+  mytester:asserteq(a:count(), 20000, 'merged count')
+  mytester:asserteq(a:max(), sorted[20000], 'merged max')
+  mytester:assertlt(math.abs(sorted:le(a:quantile(0.5)):sum() / 20000 - 0.5), 0.01, 'merged median')
+
+  -- serialization and NaNs
+  local c = torch.deserialize(torch.serialize(digest))
+  mytester:asserteq(c:quantile(0.3), digest:quantile(0.3), 'serialized digest')
+  local d = torch.TDigest():add(torch.FloatTensor{1, 0/0, 3}):add(2)
+  mytester:asserteq(d:count(), 3, 'NaNs ignored')
+  mytester:asserteq(d:quantile(0.5), 2, 'median of few values')
+  mytester:assertError(function() torch.TDigest():quantile(0.5) end, 'empty digest')
+end
+
+function torchtest.hyperLogLog()
+  local hll = torch.HyperLogLog()
+  local x = torch.range(1, 50000)
+  hll:add(x)
+  hll:add(x:float())
+  hll:add(x:long())
+  mytester:assertlt(math.abs(hll:count() / 50000 - 1), 0.05, 'count of distinct values')
+
+  local a = torch.HyperLogLog(12):add(torch.range(1, 1000))
+  local b = torch.HyperLogLog(12):add(torch.range(501, 1500):int())
+  mytester:assertlt(math.abs(a:merge(b):count() / 1500 - 1), 0.05, 'merged count')
+  mytester:assertlt(math.abs(torch.HyperLogLog():add(7):add(7):count() - 1), 0.01, 'small count')
+
+  local c = torch.deserialize(torch.serialize(a))
+  mytester:asserteq(c:count(), a:count(), 'serialized HyperLogLog')
+  mytester:assertError(function() a:merge(torch.HyperLogLog(10)) end, 'different precisions')
+end
+
 function torchtest.bernoulli()
   local size = torch.LongStorage{10, 10}
   local t = torch.ByteTensor(size)
@@ -3964,6 +4934,35 @@ function torchtest.bernoulli()
   local p = torch.rand(size)
   t:bernoulli(p)
   mytester:assert(isBinary(t), 'Sample from torch.bernoulli is not binary')
+
+  t:bernoulli(0)
+  mytester:asserteq(t:sum(), 0, 'torch.bernoulli with p = 0')
+  t:bernoulli(1)
+  mytester:asserteq(t:sum(), t:nElement(), 'torch.bernoulli with p = 1')
+
+  local n = 100000
+  for _,p in ipairs({0.5, 0.25, 0.3}) do
+    local mean = torch.FloatTensor(n):bernoulli(p):mean()
+    mytester:assertlt(math.abs(mean - p), 0.01, 'torch.bernoulli mean with p = ' .. p)
+  end
+end
+
+function torchtest.dropout()
+  local x = torch.rand(100, 200):add(1)
+  local mask = torch.ByteTensor()
+  local p = 0.3
+  local res = torch.dropout(x, p, mask)
+  mytester:assertTableEq(mask:size():totable(), x:size():totable(), 'dropout mask size')
+  mytester:assertTensorEq(res, torch.cmul(x, mask:double()):div(1-p), 1e-12,
+                          'dropout does not match its mask')
+  mytester:assertlt(math.abs(mask:double():mean() - (1-p)), 0.02, 'dropout keep rate')
+
+  local y = x:t():clone():t()
+  mytester:assert(not y:isContiguous(), 'invalid test')
+  y:dropout(p)
+  local kept = y:ne(0):double()
+  mytester:assertTensorEq(kept:cmul(x), y:mul(1-p), 1e-12,
+                          'in-place dropout of a non-contiguous tensor')
 end
 
 function torchtest.logNormal()
@@ -472,6 +472,43 @@ function tests.runStatusAndAssertCounts()
                    "failSucTest should have 2 asserts")
 end
 
+function tests.benchmark()
+   local myTester = torch.Tester()
+   local myTests = torch.TestSuite()
+   local x = torch.rand(1000)
+   function myTests.sum()
+      myTester:benchmark('sum', function() x:sum() end,
+                         {samples = 3, sampleTime = 0.001, bytes = 8000})
+   end
+   myTester:add(myTests)
+
+   disableIoWrite()
+   local success = pcall(myTester.run, myTester)
+   enableIoWrite()
+   tester:assert(success, "a benchmark without baseline should not fail")
+   local result = myTester.benchmarks['sum.sum']
+   tester:assert(result ~= nil, "benchmark result not recorded")
+   tester:assertgt(result.median, 0, "benchmark median should be positive")
+   tester:assertge(result.mad, 0, "benchmark MAD should not be negative")
+
+   local filename = os.tmpname()
+   myTester:saveBenchmarks(filename)
+   local baseline = torch.Tester():setBenchmarkBaseline(filename)
+   tester:assertalmosteq(baseline._benchmarkBaseline['sum.sum'].median,
+                         result.median, 1e-15, "baseline not read back")
+
+   -- a baseline much faster than anything achievable must be flagged
+   local f = io.open(filename, 'w')
+   f:write('{"sum.sum": {"median": 1e-15, "mad": 0}}')
+   f:close()
+   myTester:setBenchmarkBaseline(filename)
+   disableIoWrite()
+   success = pcall(myTester.run, myTester)
+   enableIoWrite()
+   os.remove(filename)
+   tester:assert(not success, "a significant slowdown should fail")
+end
+
 function tests.checkNestedTestsForbidden()
    disableIoWrite()
 
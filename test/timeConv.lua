@@ -0,0 +1,58 @@
+-- Compares the planar (NCHW) convolution torch.conv2, applied image by
+-- image, with the channels-last (NHWC) torch.conv2nhwc on whole batches,
+-- for a few common layer shapes
+require 'torch'
+
+local unpack = unpack or table.unpack
+
+local cmd = torch.CmdLine()
+cmd:option('-r', 3, 'Number of repetitions')
+cmd:option('-type', 'torch.FloatTensor', 'Tensor type')
+
+local options = cmd:parse(arg or {})
+torch.setdefaulttensortype(options.type)
+
+local function time(f)
+   local best = math.huge
+   for r=1,options.r do
+      collectgarbage()
+      local timer = torch.Timer()
+      f()
+      best = math.min(best, timer:time().real)
+   end
+   return best
+end
+
+-- batch, input planes, height, width, output planes, kernel size
+local shapes = {
+   {32,   3, 64, 64, 16, 5},
+   {32,  16, 32, 32, 32, 3},
+   {16,  64, 16, 16, 64, 3},
+   {16, 128,  8,  8, 128, 3},
+}
+
+function main()
+   print(string.format('%-24s %10s %10s %8s', 'shape', 'NCHW (s)', 'NHWC (s)', 'speedup'))
+   for _, s in ipairs(shapes) do
+      local b, p, h, w, q, ks = unpack(s)
+      local x = torch.rand(b, p, h, w)
+      local k = torch.rand(q, p, ks, ks)
+      local xh = x:channelsLast():permute(1, 3, 4, 2)
+      local res = torch.Tensor()
+      local resh = torch.Tensor()
+
+      local tplanar = time(function()
+         for i=1,b do
+            torch.conv2(res, x[i], k)
+         end
+      end)
+      local tnhwc = time(function()
+         torch.conv2nhwc(resh, xh, k)
+      end)
+      print(string.format('%-24s %10.4f %10.4f %7.1fx',
+                          string.format('%dx%dx%dx%d k%dx%dx%d', b, p, h, w, q, ks, ks),
+                          tplanar, tnhwc, tplanar/tnhwc))
+   end
+end
+
+main()
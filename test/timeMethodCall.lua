@@ -0,0 +1,87 @@
+-- Measures the cost of method dispatch on tensors (t:method(...)),
+-- versus indexing (t[i]) which still goes through __index__, and of
+-- iterating over rows with t[i] versus the reused view of t:rows()
+require 'torch'
+
+local cmd = torch.CmdLine()
+cmd:option('-n', 10^6, 'Number of calls per measure')
+cmd:option('-r', 5, 'Number of repetitions')
+
+local options = cmd:parse(arg or {})
+
+local function time(name, f)
+   local best = math.huge
+   for r=1,options.r do
+      collectgarbage()
+      local timer = torch.Timer()
+      f(options.n)
+      best = math.min(best, timer:time().real)
+   end
+   print(string.format('%-28s %8.2f ns/call', name, best/options.n*1e9))
+end
+
+function main()
+   local x = torch.FloatTensor(16):fill(1)
+   local y = torch.FloatTensor(4,4):fill(1)
+
+   time('t:dim()', function(n)
+      for i=1,n do
+         x:dim()
+      end
+   end)
+
+   time('t:nElement()', function(n)
+      for i=1,n do
+         x:nElement()
+      end
+   end)
+
+   time('t:size(1)', function(n)
+      for i=1,n do
+         x:size(1)
+      end
+   end)
+
+   time('t:add(1) [16 elements]', function(n)
+      for i=1,n do
+         x:add(1)
+      end
+   end)
+
+   time('t[i] [1D]', function(n)
+      for i=1,n do
+         local v = x[1]
+      end
+   end)
+
+   time('t[{i,j}] [2D]', function(n)
+      for i=1,n do
+         local v = y[{1,1}]
+      end
+   end)
+
+   time('t:value(i,j) [2D]', function(n)
+      for i=1,n do
+         local v = y:value(1,1)
+      end
+   end)
+
+   local z = torch.FloatTensor(1000, 4):fill(1)
+
+   time('t[i] per row [1000x4]', function(n)
+      for k=1,n/1000 do
+         for i=1,1000 do
+            local row = z[i]
+         end
+      end
+   end)
+
+   time('t:rows() per row [1000x4]', function(n)
+      for k=1,n/1000 do
+         for i, row in z:rows() do
+         end
+      end
+   end)
+end
+
+main()
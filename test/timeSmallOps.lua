@@ -0,0 +1,59 @@
+-- Measures the latency of pointwise ops on small tensors, where the cost of
+-- dispatch and of the geometry checks (size, contiguity) of the operands
+-- rivals the arithmetic
+require 'torch'
+
+local cmd = torch.CmdLine()
+cmd:option('-n', 10^6, 'Number of calls per measure')
+cmd:option('-r', 5, 'Number of repetitions')
+cmd:option('-type', 'torch.FloatTensor', 'Tensor type')
+
+local options = cmd:parse(arg or {})
+
+local function time(name, size, f)
+   local best = math.huge
+   for r=1,options.r do
+      collectgarbage()
+      local timer = torch.Timer()
+      f(options.n)
+      best = math.min(best, timer:time().real)
+   end
+   print(string.format('%-24s %6d %8.2f ns/call', name, size, best/options.n*1e9))
+end
+
+function main()
+   torch.setdefaulttensortype(options.type)
+   for _, size in ipairs{16, 64, 256, 1024} do
+      local x = torch.Tensor(size):fill(1)
+      local y = torch.Tensor(size):fill(2)
+      local z = torch.Tensor(size)
+      local xt = torch.Tensor(size/4, 4):fill(1):t()
+      local zt = torch.Tensor(4, size/4)
+
+      time('z:add(x, 1)', size, function(n)
+         for i=1,n do
+            z:add(x, 1)
+         end
+      end)
+
+      time('z:cmul(x, y)', size, function(n)
+         for i=1,n do
+            z:cmul(x, y)
+         end
+      end)
+
+      time('z:copy(x)', size, function(n)
+         for i=1,n do
+            z:copy(x)
+         end
+      end)
+
+      time('z:add(x, 1) [transposed]', size, function(n)
+         for i=1,n do
+            zt:add(xt, 1)
+         end
+      end)
+   end
+end
+
+main()
@@ -1,5 +1,7 @@
 #include "general.h"
 #include "utils.h"
+#include <limits.h>
+#include <stdint.h>
 
 #ifdef WIN32
 # include <time.h>
@@ -177,32 +179,318 @@ static int torch_setnumthreads(lua_State *L)
   return 0;
 }
 
+static int torch_setdeterministic(lua_State *L)
+{
+  luaL_checktype(L, 1, LUA_TBOOLEAN);
+  THSetDeterministic(lua_toboolean(L, 1));
+  return 0;
+}
+
+static int torch_getdeterministic(lua_State *L)
+{
+  lua_pushboolean(L, THGetDeterministic());
+  return 1;
+}
+
 static int torch_getnumcores(lua_State *L)
 {
   lua_pushinteger(L, THGetNumCores());
   return 1;
 }
 
+static const char *torch_placements[] = {"none", "compact", "scatter", NULL};
+
+static int torch_topology(lua_State *L)
+{
+  int n = THGetCpuTopology(NULL, 0);
+  THCpu *cpus = THAlloc(sizeof(THCpu)*n);
+  int i;
+  THGetCpuTopology(cpus, n);
+  lua_createtable(L, n, 0);
+  for(i = 0; i < n; i++)
+  {
+    lua_createtable(L, 0, 5);
+    lua_pushinteger(L, cpus[i].id);
+    lua_setfield(L, -2, "id");
+    lua_pushinteger(L, cpus[i].core);
+    lua_setfield(L, -2, "core");
+    lua_pushinteger(L, cpus[i].package);
+    lua_setfield(L, -2, "package");
+    lua_pushinteger(L, cpus[i].node);
+    lua_setfield(L, -2, "node");
+    lua_pushinteger(L, cpus[i].smt);
+    lua_setfield(L, -2, "smt");
+    lua_rawseti(L, -2, i+1);
+  }
+  THFree(cpus);
+  return 1;
+}
+
+/* torch.setaffinity([cpus], [placement]): cpus is a table of CPU ids, nil
+   for all the CPUs of the process */
+static int torch_setaffinity(lua_State *L)
+{
+  int placement = luaL_checkoption(L, 2, "none", torch_placements);
+  int n = 0;
+  int *cpus = NULL;
+  int i, ok;
+  if(!lua_isnoneornil(L, 1))
+  {
+    luaL_checktype(L, 1, LUA_TTABLE);
+    n = lua_objlen(L, 1);
+    luaL_argcheck(L, n > 0, 1, "at least one CPU expected");
+    /* collected by Lua if TH raises an error */
+    cpus = lua_newuserdata(L, sizeof(int)*n);
+    for(i = 0; i < n; i++)
+    {
+      lua_rawgeti(L, 1, i+1);
+      luaL_argcheck(L, lua_isnumber(L, -1), 1, "table of CPU ids expected");
+      cpus[i] = lua_tointeger(L, -1);
+      lua_pop(L, 1);
+    }
+  }
+  ok = THSetThreadAffinity(cpus, n, placement);
+  lua_pushboolean(L, ok);
+  return 1;
+}
+
+static int torch_getaffinity(lua_State *L)
+{
+  int n = THGetThreadAffinity(NULL, 0);
+  int *cpus = THAlloc(sizeof(int)*(n > 0 ? n : 1));
+  int i;
+  THGetThreadAffinity(cpus, n);
+  lua_createtable(L, n, 0);
+  for(i = 0; i < n; i++)
+  {
+    lua_pushinteger(L, cpus[i]);
+    lua_rawseti(L, -2, i+1);
+  }
+  THFree(cpus);
+  lua_pushstring(L, torch_placements[THGetThreadPlacement()]);
+  return 2;
+}
+
+static int torch_setnestedparallelism(lua_State *L)
+{
+  luaL_checktype(L, 1, LUA_TBOOLEAN);
+  THSetNestedParallelism(lua_toboolean(L, 1));
+  return 0;
+}
+
+static int torch_getnestedparallelism(lua_State *L)
+{
+  lua_pushboolean(L, THGetNestedParallelism());
+  return 1;
+}
+
+static int torch_gettune(lua_State *L)
+{
+  const char *name = luaL_checkstring(L, 1);
+  long value = THTuneGet(name, LONG_MIN);
+  if(value == LONG_MIN)
+  {
+    lua_settop(L, 2);
+    return 1;
+  }
+  lua_pushnumber(L, value);
+  return 1;
+}
+
+static int torch_settune(lua_State *L)
+{
+  const char *name = luaL_checkstring(L, 1);
+  if(lua_isnoneornil(L, 2))
+    THTuneUnset(name);
+  else
+    THTuneSet(name, (long)luaL_checknumber(L, 2));
+  return 0;
+}
+
+static int torch_cleartune(lua_State *L)
+{
+  THTuneClear();
+  return 0;
+}
+
+static int torch_tunetable(lua_State *L)
+{
+  const char *name;
+  long value;
+  int i;
+  lua_newtable(L);
+  for(i = 0; THTuneEntry(i, &name, &value); i++)
+  {
+    lua_pushnumber(L, value);
+    lua_setfield(L, -2, name);
+  }
+  return 1;
+}
+
+static int torch_tunepath(lua_State *L)
+{
+  lua_pushstring(L, THTuneDefaultPath());
+  return 1;
+}
+
+static int torch_loadtune(lua_State *L)
+{
+  int count = THTuneLoad(luaL_optstring(L, 1, NULL));
+  if(count < 0)
+    return 0;
+  lua_pushinteger(L, count);
+  return 1;
+}
+
+static int torch_savetune(lua_State *L)
+{
+  const char *path = luaL_optstring(L, 1, NULL);
+  if(!THTuneSave(path))
+    luaL_error(L, "cannot write tuning cache <%s>", path ? path : THTuneDefaultPath());
+  return 0;
+}
+
+/* re-selects the vector kernels of every type after a change of tuning
+   parameters, and returns the SIMD extension chosen for op on the given type */
+static int torch_vectordispatch(lua_State *L)
+{
+  static const struct {
+    const char *name;
+    void (*init)(void);
+    int (*selected)(const char *op);
+  } types[] = {
+    {"torch.ByteTensor", THByteVector_vectorDispatchInit, THByteVector_vectorDispatchSelected},
+    {"torch.CharTensor", THCharVector_vectorDispatchInit, THCharVector_vectorDispatchSelected},
+    {"torch.ShortTensor", THShortVector_vectorDispatchInit, THShortVector_vectorDispatchSelected},
+    {"torch.IntTensor", THIntVector_vectorDispatchInit, THIntVector_vectorDispatchSelected},
+    {"torch.LongTensor", THLongVector_vectorDispatchInit, THLongVector_vectorDispatchSelected},
+    {"torch.FloatTensor", THFloatVector_vectorDispatchInit, THFloatVector_vectorDispatchSelected},
+    {"torch.DoubleTensor", THDoubleVector_vectorDispatchInit, THDoubleVector_vectorDispatchSelected},
+  };
+  const char *op = luaL_optstring(L, 1, NULL);
+  const char *type = luaL_optstring(L, 2, "torch.DoubleTensor");
+  int i, ext = -1;
+
+  for(i = 0; i < sizeof(types)/sizeof(types[0]); i++)
+  {
+    types[i].init();
+    if(op && strcmp(types[i].name, type) == 0)
+      ext = types[i].selected(op);
+  }
+  if(!op)
+    return 0;
+  luaL_argcheck(L, ext >= 0, 1, "unknown vector operation or tensor type");
+  lua_pushinteger(L, ext);
+  return 1;
+}
+
 static void luaTorchGCFunction(void *data)
 {
   lua_State *L = data;
   lua_gc(L, LUA_GCCOLLECT, 0);
 }
 
+/* an incremental step doing as much work as if size bytes had been
+   allocated by Lua, returns 1 when a collection cycle is finished */
+static int luaTorchGCStepFunction(void *data, ptrdiff_t size)
+{
+  lua_State *L = data;
+  ptrdiff_t kbytes = size >> 10;
+  return lua_gc(L, LUA_GCSTEP, (int)(kbytes > INT_MAX ? INT_MAX : (kbytes < 1 ? 1 : kbytes)));
+}
+
+void torch_setgchandlers(lua_State *L)
+{
+  if(L) {
+    THSetGCHandler(luaTorchGCFunction, L);
+    THSetGCStepHandler(luaTorchGCStepFunction, L);
+  } else {
+    THSetGCHandler(NULL, NULL);
+    THSetGCStepHandler(NULL, NULL);
+  }
+}
+
 static int torch_setheaptracking(lua_State *L)
 {
   int enabled = luaT_checkboolean(L,1);
   lua_getglobal(L, "torch");
   lua_pushboolean(L, enabled);
   lua_setfield(L, -2, "_heaptracking");
-  if(enabled) {
-    THSetGCHandler(luaTorchGCFunction, L);
-  } else {
-    THSetGCHandler(NULL, NULL);
+  torch_setgchandlers(enabled ? L : NULL);
+  return 0;
+}
+
+static ptrdiff_t torch_optheapfield(lua_State *L, const char *name, ptrdiff_t def)
+{
+  lua_Number value;
+  lua_getfield(L, 1, name);
+  if(lua_isnil(L, -1))
+  {
+    lua_pop(L, 1);
+    return def;
   }
+  if(!lua_isnumber(L, -1))
+    luaL_error(L, "heap limit <%s> must be a number", name);
+  value = lua_tonumber(L, -1);
+  lua_pop(L, 1);
+  if(value < 0 || value > (lua_Number)PTRDIFF_MAX)
+    luaL_error(L, "heap limit <%s> out of range", name);
+  return (ptrdiff_t)value;
+}
+
+static int torch_setheaplimits(lua_State *L)
+{
+  ptrdiff_t floor, hardmax;
+  THGetGCLimits(&floor, &hardmax);
+  luaL_checktype(L, 1, LUA_TTABLE);
+  floor = torch_optheapfield(L, "floor", floor);
+  hardmax = torch_optheapfield(L, "hardmax", hardmax);
+  luaL_argcheck(L, floor > 0, 1, "floor must be positive");
+  THSetGCLimits(floor, hardmax);
   return 0;
 }
 
+static int torch_getheaplimits(lua_State *L)
+{
+  ptrdiff_t floor, hardmax;
+  THGetGCLimits(&floor, &hardmax);
+  lua_newtable(L);
+  lua_pushnumber(L, (lua_Number)floor);
+  lua_setfield(L, -2, "floor");
+  lua_pushnumber(L, (lua_Number)hardmax);
+  lua_setfield(L, -2, "hardmax");
+  return 1;
+}
+
+static int torch_heapstats(lua_State *L)
+{
+  THGCStats stats;
+  int reset = lua_toboolean(L, 1);
+  THGetGCStats(&stats);
+  if(reset)
+    THResetGCStats();
+  lua_newtable(L);
+  lua_pushnumber(L, (lua_Number)stats.heapSize);
+  lua_setfield(L, -2, "heapSize");
+  lua_pushnumber(L, (lua_Number)stats.heapSoftmax);
+  lua_setfield(L, -2, "heapSoftmax");
+  lua_pushnumber(L, stats.steps);
+  lua_setfield(L, -2, "steps");
+  lua_pushnumber(L, stats.cycles);
+  lua_setfield(L, -2, "cycles");
+  lua_pushnumber(L, stats.fullCollections);
+  lua_setfield(L, -2, "fullCollections");
+  lua_pushnumber(L, stats.stepTime);
+  lua_setfield(L, -2, "stepTime");
+  lua_pushnumber(L, stats.maxStepTime);
+  lua_setfield(L, -2, "maxStepTime");
+  lua_pushnumber(L, stats.fullTime);
+  lua_setfield(L, -2, "fullTime");
+  lua_pushnumber(L, stats.maxFullTime);
+  lua_setfield(L, -2, "maxFullTime");
+  return 1;
+}
+
 static void luaTorchErrorHandlerFunction(const char *msg, void *data)
 {
   lua_State *L = data;
@@ -215,13 +503,69 @@ static void luaTorchArgErrorHandlerFunction(int argNumber, const char *msg, void
   luaL_argcheck(L, 0, argNumber, msg);
 }
 
-static int torch_updateerrorhandlers(lua_State *L)
+void torch_seterrorhandlers(lua_State *L)
 {
   THSetErrorHandler(luaTorchErrorHandlerFunction, L);
   THSetArgErrorHandler(luaTorchArgErrorHandlerFunction, L);
+}
+
+static int torch_updateerrorhandlers(lua_State *L)
+{
+  torch_seterrorhandlers(L);
   return 0;
 }
 
+static torch_PrintOptions torch_printoptions = {4, 1000, 3, 80};
+
+const torch_PrintOptions* torch_getprintoptions(void)
+{
+  return &torch_printoptions;
+}
+
+static long torch_optprintfield(lua_State *L, const char *name, long def, long min, long max)
+{
+  lua_Number value;
+  lua_getfield(L, 1, name);
+  if(lua_isnil(L, -1))
+  {
+    lua_pop(L, 1);
+    return def;
+  }
+  if(!lua_isnumber(L, -1))
+    luaL_error(L, "print option <%s> must be a number", name);
+  value = lua_tonumber(L, -1);
+  lua_pop(L, 1);
+  if(value < min)
+    luaL_error(L, "print option <%s> must be at least %d", name, (int)min);
+  return (value > max ? max : (long)value);
+}
+
+static int torch_setprintoptions(lua_State *L)
+{
+  torch_PrintOptions options = torch_printoptions;
+  luaL_checktype(L, 1, LUA_TTABLE);
+  options.precision = (int)torch_optprintfield(L, "precision", options.precision, 0, 16);
+  options.threshold = torch_optprintfield(L, "threshold", options.threshold, 0, LONG_MAX);
+  options.edgeitems = torch_optprintfield(L, "edgeitems", options.edgeitems, 1, LONG_MAX/4);
+  options.linewidth = (int)torch_optprintfield(L, "linewidth", options.linewidth, 1, 1024);
+  torch_printoptions = options;
+  return 0;
+}
+
+static int torch_lua_getprintoptions(lua_State *L)
+{
+  lua_newtable(L);
+  lua_pushnumber(L, torch_printoptions.precision);
+  lua_setfield(L, -2, "precision");
+  lua_pushnumber(L, torch_printoptions.threshold);
+  lua_setfield(L, -2, "threshold");
+  lua_pushnumber(L, torch_printoptions.edgeitems);
+  lua_setfield(L, -2, "edgeitems");
+  lua_pushnumber(L, torch_printoptions.linewidth);
+  lua_setfield(L, -2, "linewidth");
+  return 1;
+}
+
 static const struct luaL_Reg torch_utils__ [] = {
   {"getdefaulttensortype", torch_lua_getdefaulttensortype},
   {"isatty", torch_isatty},
@@ -230,6 +574,23 @@ static const struct luaL_Reg torch_utils__ [] = {
   {"setnumthreads", torch_setnumthreads},
   {"getnumthreads", torch_getnumthreads},
   {"getnumcores", torch_getnumcores},
+  {"topology", torch_topology},
+  {"setaffinity", torch_setaffinity},
+  {"getaffinity", torch_getaffinity},
+  {"setnestedparallelism", torch_setnestedparallelism},
+  {"getnestedparallelism", torch_getnestedparallelism},
+  {"setdeterministic", torch_setdeterministic},
+  {"getdeterministic", torch_getdeterministic},
+  {"gettune", torch_gettune},
+  {"settune", torch_settune},
+  {"cleartune", torch_cleartune},
+  {"tunetable", torch_tunetable},
+  {"tunepath", torch_tunepath},
+  {"loadtune", torch_loadtune},
+  {"savetune", torch_savetune},
+  {"vectordispatch", torch_vectordispatch},
+  {"setprintoptions", torch_setprintoptions},
+  {"getprintoptions", torch_lua_getprintoptions},
   {"factory", luaT_lua_factory},
   {"getconstructortable", luaT_lua_getconstructortable},
   {"typename", luaT_lua_typename},
@@ -244,6 +605,9 @@ static const struct luaL_Reg torch_utils__ [] = {
   {"version", luaT_lua_version},
   {"pointer", luaT_lua_pointer},
   {"setheaptracking", torch_setheaptracking},
+  {"setheaplimits", torch_setheaplimits},
+  {"getheaplimits", torch_getheaplimits},
+  {"heapstats", torch_heapstats},
   {"updateerrorhandlers", torch_updateerrorhandlers},
   {NULL, NULL}
 };
@@ -251,5 +615,7 @@ static const struct luaL_Reg torch_utils__ [] = {
 void torch_utils_init(lua_State *L)
 {
   torch_updateerrorhandlers(L);
+  /* before the tensor types select their vector kernels */
+  THTuneLoad(NULL);
   luaT_setfuncs(L, torch_utils__, 0);
 }
@@ -32,5 +32,20 @@
 TORCH_API THLongStorage* torch_checklongargs(lua_State *L, int index);
 TORCH_API int torch_islongargs(lua_State *L, int index);
 TORCH_API const char* torch_getdefaulttensortype(lua_State *L);
+/* TH errors of the calling thread are raised in L */
+TORCH_API void torch_seterrorhandlers(lua_State *L);
+/* TH memory pressure on the calling thread collects the garbage of L, or
+   of no state when L is NULL */
+TORCH_API void torch_setgchandlers(lua_State *L);
+
+typedef struct torch_PrintOptions
+{
+  int precision;   /* digits after the decimal point */
+  long threshold;  /* tensors with more elements are summarized */
+  long edgeitems;  /* items kept at each end of a summarized dimension */
+  int linewidth;   /* characters per line before columns are wrapped */
+} torch_PrintOptions;
+
+TORCH_API const torch_PrintOptions* torch_getprintoptions(void);
 
 #endif